@@ -0,0 +1,80 @@
+#!/usr/bin/env python
+#
+# Message codec check: the generated Python module (msg_codec_gen.py) must decode the frames
+# encoded by the generated C codec (msg_codec_frames.bin, written by test_msg_codec), and
+# encode the same bytes again. Malformed varints must be rejected as they are in C.
+#
+# Usage: check_msg_codec.py <msg_codec_gen.py folder> <msg_codec_frames.bin>
+
+from __future__ import print_function
+
+import sys
+
+# Frames written by test_msg_codec.c (test_round_trips), in the same order
+EXPECTED = [
+    ('echo_request', {'seq': 0, 'payload': b''}),
+    ('echo_request', {'seq': 0xFFFFFFFF, 'payload': bytes(bytearray(i & 0xFF for i in range(1000)))}),
+    ('echo_response', {'seq': 300, 'uptime_ms': 0xDEADBEEF, 'payload': b'hello'}),
+    ('echo_response', {'seq': 127, 'uptime_ms': 0, 'payload': b''}),
+    ('error', {'seq': 1, 'code': 2, 'text': 'unknown message'}),
+    ('error', {'seq': 0, 'code': 0xFFFFFFFF, 'text': 't' * 64}),
+    ('sensor_sample', {'sensor_id': 255, 'timestamp': 0xFFFFFFFF, 'value': -2**31}),
+    ('sensor_sample', {'sensor_id': 0, 'timestamp': 0, 'value': 2**31 - 1}),
+    ('sensor_sample', {'sensor_id': 1, 'timestamp': 1000, 'value': -1}),
+]
+
+# Frame headers with a payload length that doesn't fit 32 bits
+INVALID_HEADERS = [
+    b'\x01\xff\xff\xff\xff\x1f',
+    b'\x01\x80\x80\x80\x80\x70',
+    b'\x01\x80\x80\x80\x80\x80\x00',
+]
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('Usage: check_msg_codec.py <msg_codec_gen.py folder> <msg_codec_frames.bin>')
+
+    sys.path.insert(0, sys.argv[1])
+    import msg_codec_gen
+
+    with open(sys.argv[2], 'rb') as f:
+        data = f.read()
+
+    ok = True
+    pos = 0
+    for name, fields in EXPECTED:
+        decoded = msg_codec_gen.decode_frame(data[pos:])
+        if decoded is None:
+            print('{}: incomplete frame at offset {}'.format(name, pos))
+            return 1
+        frame = data[pos:pos + decoded[2]]
+        if (decoded[0], decoded[1]) != (name, fields):
+            print('{} at offset {}: decoded {}'.format(name, pos, decoded[:2]))
+            ok = False
+        elif msg_codec_gen.encode(name, **fields) != frame:
+            print('{} at offset {}: encoded differently'.format(name, pos))
+            ok = False
+        pos += decoded[2]
+
+    if pos != len(data):
+        print('{} bytes left after the expected frames'.format(len(data) - pos))
+        ok = False
+
+    for header in INVALID_HEADERS:
+        try:
+            msg_codec_gen.decode_frame(header)
+            print('invalid header {!r} accepted'.format(header))
+            ok = False
+        except ValueError:
+            pass
+
+    # Incomplete header: more bytes may come
+    ok &= (msg_codec_gen.decode_frame(b'\x01\xff\xff\xff\xff') is None)
+
+    print('check_msg_codec: {} ({} frames)'.format('OK' if ok else 'FAILED', len(EXPECTED)))
+    return 0 if ok else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,269 @@
+#!/usr/bin/env python
+#
+# Resumable sessions check: a client talks to the host server (host_server_sessions, built with
+# CONFIG_TCP_SERVER_SESSIONS) on the data port and drops the connection at random points: while
+# frames are in flight in both directions, in the middle of a frame it sends, with a normal close
+# or a reset. After each drop it resumes with RESUME. Every message must arrive exactly once and
+# in order, in both directions (server messages are the echoes of client messages, in the order
+# the server accepted them). Then:
+#   - a message sent again after it was acknowledged is acknowledged, not echoed twice
+#   - a second HELLO on a live session releases that session (another client can still resume)
+#   - a session whose replay buffer overflowed can't be resumed
+#
+# Usage: check_tcp_session.py <host_server_sessions executable>
+
+from __future__ import print_function
+
+import random
+import socket
+import struct
+import subprocess
+import sys
+import time
+
+HOST = '127.0.0.1'
+DATA_PORT = 5000
+ROUNDS = 300
+READ_TIME_S = 0.02
+PAYLOAD_MAX = 200
+UNACKED_MAX = 12                # echoes not acknowledged stay well below the replay buffer (4096 bytes)
+REPLAY_BUFFER_SIZE = 4096       # CONFIG_TCP_SERVER_SESSIONS_REPLAY_BUFFER_SIZE of host_server_sessions
+
+FRAME_HELLO = 0x01
+FRAME_RESUME = 0x02
+FRAME_DATA = 0x03
+FRAME_ACK = 0x04
+FRAME_SESSION = 0x81
+FRAME_DATA_SERVER = 0x83
+FRAME_ACK_SERVER = 0x84
+FRAME_HEADER = struct.Struct('>BIH')
+
+
+class CheckError(Exception):
+    pass
+
+
+def check(cond, text):
+    if not cond:
+        raise CheckError(text)
+
+
+def frame(frame_type, seq, payload=b''):
+    return FRAME_HEADER.pack(frame_type, seq, len(payload)) + payload
+
+
+def message(seq):
+    # Printable bytes: the server echoes them with "%.*s"
+    return bytes(bytearray(33 + ((seq + i) % 90) for i in range(1 + (seq * 37) % PAYLOAD_MAX)))
+
+
+def echo(seq):
+    return b'\n\rReceived: ' + message(seq)
+
+
+class Client(object):
+    def __init__(self):
+        self.token = None
+        self.sock = None
+        self.rx = b''
+        self.next_tx_seq = 1        # next client message
+        self.last_rx_seq = 0        # last server message received
+        self.last_ack_sent = 0
+        self.server_last_rx = 0     # last client message acknowledged by the server
+
+    def connect(self, token=None):
+        # The server may still hold the previous connection: a rejected connection is closed at once
+        for _ in range(200):
+            sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            sock.settimeout(5)
+            sock.connect((HOST, DATA_PORT))
+            if token is None:
+                sock.sendall(frame(FRAME_HELLO, 0))
+            else:
+                sock.sendall(frame(FRAME_RESUME, self.last_rx_seq, struct.pack('>I', token)))
+            self.sock = sock
+            self.rx = b''
+            try:
+                return self.read_until(lambda: self.handshake is not None)
+            except (socket.error, EOFError):
+                sock.close()
+                time.sleep(0.01)
+        raise CheckError('data port not accepting connections')
+
+    def hello_again(self):
+        # HELLO on the connection that already has a session
+        self.sock.sendall(frame(FRAME_HELLO, 0))
+        return self.read_until(lambda: self.handshake is not None)
+
+    def read_until(self, done, timeout=5.0):
+        self.handshake = None
+        deadline = time.time() + timeout
+        while not done():
+            check(time.time() < deadline, 'timeout')
+            self.receive(self.sock.recv(4096))
+        return self.handshake
+
+    def receive(self, data):
+        if not data:
+            raise EOFError()
+        self.rx += data
+        while len(self.rx) >= FRAME_HEADER.size:
+            frame_type, seq, length = FRAME_HEADER.unpack_from(self.rx)
+            if len(self.rx) < FRAME_HEADER.size + length:
+                break
+            payload = self.rx[FRAME_HEADER.size:FRAME_HEADER.size + length]
+            self.rx = self.rx[FRAME_HEADER.size + length:]
+            self.handle(frame_type, seq, payload)
+
+    def handle(self, frame_type, seq, payload):
+        if frame_type == FRAME_SESSION:
+            check(len(payload) == 5, 'SESSION payload of {} bytes'.format(len(payload)))
+            token, resumed = struct.unpack('>IB', payload)
+            if resumed == 1:
+                check(token == self.token, 'resumed another token')
+            self.token = token
+            self.handshake = resumed
+            # Send again what the server hasn't received
+            self.server_last_rx = seq
+            for resend in range(seq + 1, self.next_tx_seq):
+                self.sock.sendall(frame(FRAME_DATA, resend, message(resend)))
+        elif frame_type == FRAME_DATA_SERVER:
+            # Exactly the next echo: nothing lost, nothing received twice
+            check(seq == self.last_rx_seq + 1, 'server message {} after {}'.format(seq, self.last_rx_seq))
+            check(payload == echo(seq), 'server message {}: wrong payload'.format(seq))
+            self.last_rx_seq = seq
+        elif frame_type == FRAME_ACK_SERVER:
+            check(seq <= self.next_tx_seq - 1, 'ACK of message {} not sent yet'.format(seq))
+            self.server_last_rx = seq
+        else:
+            raise CheckError('unexpected frame type 0x{:02x}'.format(frame_type))
+
+    def send_messages(self, count):
+        for _ in range(count):
+            self.sock.sendall(frame(FRAME_DATA, self.next_tx_seq, message(self.next_tx_seq)))
+            self.next_tx_seq += 1
+
+    def send_ack(self):
+        self.sock.sendall(frame(FRAME_ACK, self.last_rx_seq))
+        self.last_ack_sent = self.last_rx_seq
+
+    def read_some(self, budget):
+        # Whatever arrives within READ_TIME_S, up to budget bytes (so frames are cut too)
+        self.sock.settimeout(READ_TIME_S)
+        try:
+            while budget > 0:
+                data = self.sock.recv(min(budget, 4096))
+                budget -= len(data)
+                self.receive(data)
+        except socket.timeout:
+            pass
+        self.sock.settimeout(5)
+
+    def drop(self, reset):
+        if reset:
+            self.sock.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER, struct.pack('ii', 1, 0))
+        self.sock.close()
+        self.sock = None
+
+
+def test_resets(client, rng):
+    check(client.connect() == 0, 'HELLO resumed a session')
+    resumes = 0
+
+    for _ in range(ROUNDS):
+        if rng.random() < 0.5:
+            client.send_ack()
+        if (client.next_tx_seq - 1 - client.last_ack_sent) < UNACKED_MAX:
+            client.send_messages(rng.randint(0, UNACKED_MAX - (client.next_tx_seq - 1 - client.last_ack_sent)))
+        client.read_some(rng.randint(0, 3000))
+
+        # Connection lost in the middle of a frame sent by the client
+        if rng.random() < 0.2:
+            data = frame(FRAME_DATA, client.next_tx_seq, message(client.next_tx_seq))
+            client.sock.sendall(data[:rng.randint(1, len(data) - 1)])
+
+        client.drop(rng.random() < 0.5)
+        check(client.connect(client.token) == 1, 'RESUME failed')
+        resumes += 1
+
+    # Last connection: everything in flight is delivered
+    client.read_until(lambda: (client.last_rx_seq == client.next_tx_seq - 1) and
+                      (client.server_last_rx == client.next_tx_seq - 1))
+    client.send_ack()
+    print('resumes: {}, messages: {} each way'.format(resumes, client.last_rx_seq))
+    check(client.last_rx_seq > ROUNDS, 'too few messages')
+
+
+def test_duplicate(client):
+    # Message 1 again: acknowledged, not echoed (an echo would fail the seq check)
+    client.sock.sendall(frame(FRAME_DATA, 1, message(1)))
+    client.send_messages(1)
+    client.read_until(lambda: (client.last_rx_seq == client.next_tx_seq - 1) and
+                      (client.server_last_rx == client.next_tx_seq - 1))
+    client.send_ack()
+
+
+def test_hello_releases_session(client):
+    # Another client says HELLO twice: its first session is released, so the new one doesn't evict
+    # the first client's session (2 sessions)
+    client.drop(False)
+    other = Client()
+    check(other.connect() == 0, 'HELLO resumed a session')
+    first_token = other.token
+    check(other.hello_again() == 0, 'second HELLO resumed a session')
+    check(other.token != first_token, 'second HELLO kept the token')
+    other.drop(False)
+    check(client.connect(client.token) == 1, 'session evicted by another client HELLO')
+
+
+def test_overflow(client):
+    # Echoes never acknowledged: the replay buffer overflows, so the session can't be resumed
+    count = 0
+    while count * (6 + len(echo(client.next_tx_seq))) < 2 * REPLAY_BUFFER_SIZE:
+        client.send_messages(1)
+        count += 1
+    client.read_until(lambda: client.server_last_rx == client.next_tx_seq - 1)
+    client.drop(False)
+    check(client.connect(client.token) == 0, 'session resumed after a replay buffer overflow')
+    client.drop(False)
+
+
+def wait_server(proc):
+    for _ in range(100):
+        if proc.poll() is not None:
+            sys.exit('host server exited ({})'.format(proc.returncode))
+        try:
+            socket.create_connection((HOST, DATA_PORT), 1).close()
+            return
+        except socket.error:
+            time.sleep(0.05)
+    sys.exit('host server not listening on port {}'.format(DATA_PORT))
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit('Usage: check_tcp_session.py <host_server_sessions executable>')
+
+    proc = subprocess.Popen([sys.argv[1]], stdout=subprocess.DEVNULL)
+    ok = True
+
+    try:
+        wait_server(proc)
+        client = Client()
+        test_resets(client, random.Random(0x12345678))
+        test_duplicate(client)
+        test_hello_releases_session(client)
+        test_overflow(client)
+    except (CheckError, socket.error, EOFError) as e:
+        print('check failed: {!r}'.format(e))
+        ok = False
+    finally:
+        proc.terminate()
+        proc.wait()
+
+    print('check_tcp_session: {}'.format('OK' if ok else 'FAILED'))
+    return 0 if ok else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
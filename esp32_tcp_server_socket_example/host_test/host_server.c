@@ -0,0 +1,209 @@
+/* Host server: the socket TCP server (all listeners) built and run on the development machine
+ *
+ * The server modules are compiled as they are against the stand-ins of stubs/ (POSIX sockets,
+ * one thread per task). Client sockets get a send buffer as small as lwIP's (accept is wrapped
+ * at link time), so the TX queues fill up as they do on the ESP32. Used by slow_reader_bench.py,
+ * which checks that a client that doesn't read its answers only slows itself down.
+ */
+
+/* Includes */
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "socket_tcp_server/socket_tcp_server.h"
+#include "request_trace/request_trace.h"
+
+/* Defines - send buffer of client sockets (lwIP default TCP_SND_BUF) */
+#define HOST_SERVER_SNDBUF                 5744
+
+/* Types - task started as a thread */
+typedef struct
+{
+    void (*task)(void *);
+    void *arg;
+} host_task_t;
+
+/* Function: thread running a task
+ * Params: task
+ * Return: none
+ */
+static void * host_task_thread(void *arg)
+{
+    host_task_t *pt_task = (host_task_t *)arg;
+
+    pt_task->task(pt_task->arg);
+    free(pt_task);
+    return NULL;
+}
+
+/* Function: create a task (a detached thread: priority, stack size and core are ignored)
+ * Params: task function, name, stack size, argument, priority, handle (output) and core
+ * Return: pdPASS: success
+ *         pdFALSE: fail
+ */
+BaseType_t xTaskCreatePinnedToCore(void (*task)(void *), const char *pt_name, uint32_t stack_size, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *pt_handle, BaseType_t core)
+{
+    host_task_t *pt_task = malloc(sizeof(host_task_t));
+    pthread_t thread;
+
+    if (pt_task == NULL)
+    {
+        return pdFALSE;
+    }
+
+    pt_task->task = task;
+    pt_task->arg = arg;
+
+    if (pthread_create(&thread, NULL, host_task_thread, pt_task) != 0)
+    {
+        free(pt_task);
+        return pdFALSE;
+    }
+
+    pthread_detach(thread);
+
+    if (pt_handle != NULL)
+    {
+        *pt_handle = NULL;
+    }
+
+    return pdPASS;
+}
+
+/* Function: delete the calling task
+ * Params: task handle (unused)
+ * Return: none
+ */
+void vTaskDelete(TaskHandle_t handle)
+{
+    pthread_exit(NULL);
+}
+
+/* Function: ticks since start (monotonic clock)
+ * Params: none
+ * Return: ticks
+ */
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(esp_timer_get_time() / (portTICK_PERIOD_MS * 1000));
+}
+
+/* Function: delay the calling task
+ * Params: ticks
+ * Return: none
+ */
+void vTaskDelay(TickType_t ticks)
+{
+    usleep(ticks * portTICK_PERIOD_MS * 1000);
+}
+
+/* Function: time since start
+ * Params: none
+ * Return: time (us)
+ */
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((int64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+/* Function: CPU cycle counter (a nanosecond clock stands in for it, wrapping like the 32-bit counter)
+ * Params: none
+ * Return: cycles
+ */
+uint32_t cpu_hal_get_cycle_count(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec);
+}
+
+/* Function: random number
+ * Params: none
+ * Return: number
+ */
+uint32_t esp_random(void)
+{
+    return (uint32_t)rand();
+}
+
+/* Function: task watchdog (nothing to watch on host)
+ * Params: task handle (unused)
+ * Return: ESP_OK
+ */
+esp_err_t esp_task_wdt_add(TaskHandle_t handle)
+{
+    return ESP_OK;
+}
+
+/* Function: task watchdog reset (nothing to watch on host)
+ * Params: none
+ * Return: ESP_OK
+ */
+esp_err_t esp_task_wdt_reset(void)
+{
+    return ESP_OK;
+}
+
+/* Function: wi-fi status (host network is always up)
+ * Params: none
+ * Return: true
+ */
+bool get_status_wifi(void)
+{
+    return true;
+}
+
+/* Function: IPv4 address to string (lwIP reentrant variant)
+ * Params: address, output buffer and its size
+ * Return: output buffer
+ */
+char *inet_ntoa_r(struct in_addr addr, char *pt_buf, int size)
+{
+    snprintf(pt_buf, size, "%s", inet_ntoa(addr));
+    return pt_buf;
+}
+
+/* Function: accept a client (the server calls accept through the linker's --wrap) with a small send buffer
+ * Params: listening socket, client address (output) and its length
+ * Return: client socket (-1: fail)
+ */
+int __real_accept(int sock, struct sockaddr *pt_addr, socklen_t *pt_addr_len);
+int __wrap_accept(int sock, struct sockaddr *pt_addr, socklen_t *pt_addr_len)
+{
+    int client_sock = __real_accept(sock, pt_addr, pt_addr_len);
+    int sndbuf = HOST_SERVER_SNDBUF;
+
+    if (client_sock >= 0)
+    {
+        setsockopt(client_sock, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+    }
+
+    return client_sock;
+}
+
+int main(void)
+{
+    /* Clients closing during a send mustn't kill the server */
+    signal(SIGPIPE, SIG_IGN);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    request_trace_init();
+    tcp_socket_server_init();
+
+    while (1)
+    {
+        pause();
+    }
+
+    return 0;
+}
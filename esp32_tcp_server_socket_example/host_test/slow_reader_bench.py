@@ -0,0 +1,302 @@
+#!/usr/bin/env python
+#
+# Slow reader benchmark: control port latency while data port clients don't read their answers
+#
+# Runs the host server (host_server, built by host_test/CMakeLists.txt) and measures "ping"
+# round trips on the control port:
+#   1. idle
+#   2. while a bulk client uploads as fast as it can
+#   3. while a data client floods echo requests and never reads (it must be dropped after
+#      WIFI_SOCKET_TCP_SERVER_SEND_TIMEOUT_MS without progress)
+#   4. while a second control client downloads the request trace ("trace dump") slowly
+#   5. while a control client reads a long "tslog query" answer slowly (host_server_ts_log:
+#      binary protocol and time-series log, samples sent as sensor_sample messages first,
+#      encoded by the generated Python codec msg_codec_gen.py)
+#   6. while a control client downloads the traffic capture of those messages ("capture dump")
+#      slowly
+# The server task serves every port, so a send waiting for one client would show up here.
+#
+# Usage: slow_reader_bench.py <host_server executable> [<host_server_ts_log executable> <msg_codec_gen.py folder>]
+
+from __future__ import print_function
+
+import json
+import os
+import shutil
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+HOST = '127.0.0.1'
+DATA_PORT = 5000
+CONTROL_PORT = 5001
+BULK_PORT = 5002
+BULK_UPLOAD_S = 1.0
+PINGS = 200
+SEND_TIMEOUT_S = 2.0            # WIFI_SOCKET_TCP_SERVER_SEND_TIMEOUT_MS
+MAX_PING_LATENCY_MS = 250.0     # a blocked send loop stalls every port for up to SEND_TIMEOUT_S
+SLOW_RCVBUF = 4096              # small receive window, so the server queue fills up
+TS_LOG_SAMPLES = 10000          # about 180 kB of CSV, several hundred query chunks
+TS_LOG_FIRST_TIMESTAMP = 1000
+PCAPNG_BLOCK_SHB = 0x0A0D0D0A
+PCAPNG_BLOCK_IDB = 0x00000001
+PCAPNG_BLOCK_EPB = 0x00000006
+
+
+def connect(port, rcvbuf=None):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    if rcvbuf is not None:
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, rcvbuf)
+    sock.settimeout(5)
+    sock.connect((HOST, port))
+    return sock
+
+
+def wait_server(proc):
+    for _ in range(100):
+        if proc.poll() is not None:
+            sys.exit('host server exited ({})'.format(proc.returncode))
+        try:
+            connect(CONTROL_PORT).close()
+            return
+        except socket.error:
+            time.sleep(0.05)
+    sys.exit('host server not listening on port {}'.format(CONTROL_PORT))
+
+
+def ping_latency(control, count, busy=None):
+    # At least count pings, and more until the busy client thread is done
+    latency_ms = []
+    while (len(latency_ms) < count) or ((busy is not None) and busy.is_alive()):
+        time.sleep(0.001)
+        start = time.perf_counter()
+        control.sendall(b'ping\n')
+        answer = control.recv(16)
+        latency_ms.append((time.perf_counter() - start) * 1e3)
+        if answer != b'pong\n':
+            sys.exit('unexpected control answer: {!r}'.format(answer))
+    latency_ms.sort()
+    return latency_ms[len(latency_ms) // 2], latency_ms[-1], len(latency_ms)
+
+
+def report(name, latency):
+    print('{:<32} median {:7.3f} ms, max {:7.3f} ms ({} pings)'.format(name, latency[0], latency[1], latency[2]))
+    return latency[1] <= MAX_PING_LATENCY_MS
+
+
+def flood(sock, sent):
+    chunk = b'x' * 1000
+    sock.settimeout(0.5)
+    try:
+        while True:
+            sock.sendall(chunk)
+            sent[0] += len(chunk)
+    except socket.error:
+        pass
+
+
+def upload(sock, sent):
+    chunk = b'\0' * 65536
+    end = time.time() + BULK_UPLOAD_S
+    while time.time() < end:
+        sock.sendall(chunk)
+        sent[0] += len(chunk)
+
+
+def is_dropped(sock):
+    # Server closed the connection: end of stream (or reset) once the queued answers are read
+    sock.settimeout(SEND_TIMEOUT_S)
+    try:
+        while sock.recv(65536):
+            pass
+    except socket.timeout:
+        return False
+    except socket.error:
+        pass
+    return True
+
+
+def slow_download(sock, out, end=b']}\n'):
+    data = b''
+    while not data.endswith(end):
+        block = sock.recv(256)
+        if not block:
+            break
+        data += block
+        time.sleep(0.005)
+    out.append(data)
+
+
+def control_command(sock, command):
+    sock.sendall(command + b'\n')
+    answer = b''
+    while not answer.endswith(b'\n'):
+        block = sock.recv(256)
+        if not block:
+            break
+        answer += block
+    return answer
+
+
+def slow_query(sock, out):
+    data = b''
+    while b'# ' not in data[-64:] or not data.endswith(b'\n'):
+        block = sock.recv(256)
+        if not block:
+            break
+        data += block
+        time.sleep(0.001)
+    out.append(data)
+
+
+def check_query(data):
+    # Every sample, in order, then the count line
+    lines = data.decode().splitlines()
+    expected = ['{},1,{}'.format(TS_LOG_FIRST_TIMESTAMP + i, -i) for i in range(TS_LOG_SAMPLES)]
+    return (lines[:-1] == expected) and (lines[-1] == '# {} samples'.format(TS_LOG_SAMPLES))
+
+
+def check_pcapng(data):
+    # Section header, interface description, then one packet per record: returns the packet count
+    blocks = []
+    pos = 0
+    while pos + 12 <= len(data):
+        block_type, length = struct.unpack_from('<II', data, pos)
+        if (length < 12) or (pos + length > len(data)) or (struct.unpack_from('<I', data, pos + length - 4)[0] != length):
+            return None
+        blocks.append(block_type)
+        pos += length
+    if (pos != len(data)) or (blocks[:2] != [PCAPNG_BLOCK_SHB, PCAPNG_BLOCK_IDB]) or \
+       any(block_type != PCAPNG_BLOCK_EPB for block_type in blocks[2:]):
+        return None
+    return len(blocks) - 2
+
+
+def ts_log_query_bench(server, codec_dir):
+    sys.path.insert(0, codec_dir)
+    import msg_codec_gen
+
+    # Fresh log file in a folder of its own
+    folder = tempfile.mkdtemp()
+    proc = subprocess.Popen([os.path.abspath(server)], stdout=subprocess.DEVNULL, cwd=folder)
+    ok = True
+
+    try:
+        wait_server(proc)
+        control = connect(CONTROL_PORT)
+        ok &= (control_command(control, b'capture arm') == b'capture: armed\n')
+        data = connect(DATA_PORT)
+        data.sendall(b''.join(msg_codec_gen.encode('sensor_sample', sensor_id=1, timestamp=TS_LOG_FIRST_TIMESTAMP + i, value=-i)
+                              for i in range(TS_LOG_SAMPLES)))
+        for _ in range(100):
+            if control_command(control, b'tslog stats').startswith('samples={} '.format(TS_LOG_SAMPLES).encode()):
+                break
+            time.sleep(0.05)
+        data.close()
+
+        query = connect(CONTROL_PORT, SLOW_RCVBUF)
+        query.sendall('tslog query 0 {}\n'.format(0xFFFFFFFF).encode())
+        out = []
+        reader = threading.Thread(target=slow_query, args=(query, out))
+        reader.start()
+        ok &= report('ping, slow tslog query', ping_latency(control, PINGS, reader))
+        reader.join()
+
+        # Commands behind the query are served once it's done
+        valid = check_query(out[0])
+        valid &= (control_command(query, b'ping') == b'pong\n')
+        print('{:<32} {} bytes, {}'.format('slow tslog query', len(out[0]), 'valid' if valid else 'INVALID'))
+        ok &= valid
+
+        # Capture of the binary protocol messages above, on the same slow connection. The file has no
+        # end marker: a ping sent behind it is answered once it's done
+        query.sendall(b'capture dump\nping\n')
+        out = []
+        reader = threading.Thread(target=slow_download, args=(query, out, b'pong\n'))
+        reader.start()
+        ok &= report('ping, slow capture download', ping_latency(control, PINGS, reader))
+        reader.join()
+        query.close()
+        control.close()
+        packets = check_pcapng(out[0][:-len(b'pong\n')]) if out[0].endswith(b'pong\n') else None
+        print('{:<32} {} bytes, {}'.format('slow capture download', len(out[0]),
+                                           '{} packets'.format(packets) if packets else 'INVALID'))
+        ok &= bool(packets)
+    finally:
+        proc.terminate()
+        proc.wait()
+        shutil.rmtree(folder)
+
+    return ok
+
+
+def main():
+    if len(sys.argv) not in (2, 4):
+        sys.exit('Usage: slow_reader_bench.py <host_server executable> [<host_server_ts_log executable> <msg_codec_gen.py folder>]')
+
+    proc = subprocess.Popen([sys.argv[1]], stdout=subprocess.DEVNULL)
+    ok = True
+
+    try:
+        wait_server(proc)
+        control = connect(CONTROL_PORT)
+        ok &= report('ping, idle', ping_latency(control, PINGS))
+
+        # Bulk upload
+        bulk = connect(BULK_PORT)
+        sent = [0]
+        uploader = threading.Thread(target=upload, args=(bulk, sent))
+        uploader.start()
+        ok &= report('ping, bulk upload', ping_latency(control, PINGS, uploader))
+        uploader.join()
+        bulk.close()
+        print('{:<32} {:.0f} MB/s'.format('bulk upload', sent[0] / BULK_UPLOAD_S / 1e6))
+
+        # Client flooding echo requests without reading
+        data = connect(DATA_PORT, SLOW_RCVBUF)
+        sent = [0]
+        flooder = threading.Thread(target=flood, args=(data, sent))
+        flooder.start()
+        ok &= report('ping, data client not reading', ping_latency(control, PINGS, flooder))
+        flooder.join()
+        time.sleep(SEND_TIMEOUT_S + 0.5)
+        dropped = is_dropped(data)
+        data.close()
+        print('{:<32} {} kB sent, {}'.format('data client not reading', sent[0] // 1000,
+                                             'dropped' if dropped else 'NOT dropped'))
+        ok &= dropped
+
+        # Trace download by a slow client (trace holds the events of the pings above)
+        dump = connect(CONTROL_PORT, SLOW_RCVBUF)
+        dump.sendall(b'trace dump\n')
+        out = []
+        reader = threading.Thread(target=slow_download, args=(dump, out))
+        reader.start()
+        ok &= report('ping, slow trace download', ping_latency(control, PINGS, reader))
+        reader.join()
+        dump.close()
+        try:
+            trace = json.loads(out[0].decode())
+            print('{:<32} {} bytes, {} events'.format('slow trace download', len(out[0]), len(trace['traceEvents'])))
+        except ValueError as e:
+            print('slow trace download: invalid JSON ({}, {} bytes)'.format(e, len(out[0])))
+            ok = False
+
+        control.close()
+    finally:
+        proc.terminate()
+        proc.wait()
+
+    if len(sys.argv) == 4:
+        ok &= ts_log_query_bench(sys.argv[2], sys.argv[3])
+
+    print('slow_reader_bench: {}'.format('OK' if ok else 'FAILED'))
+    return 0 if ok else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,2 @@
+/* Host stand-in: esp_event.h */
+#include "host_stubs.h"
@@ -0,0 +1,2 @@
+/* Host stand-in: esp_heap_caps.h */
+#include "host_stubs.h"
@@ -0,0 +1,2 @@
+/* Host stand-in: esp_log.h */
+#include "host_stubs.h"
@@ -0,0 +1,2 @@
+/* Host stand-in: esp_mac.h */
+#include "host_stubs.h"
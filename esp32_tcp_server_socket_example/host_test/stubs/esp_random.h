@@ -0,0 +1,2 @@
+/* Host stand-in: esp_random.h */
+#include "host_stubs.h"
@@ -0,0 +1,2 @@
+/* Host stand-in: esp_system.h */
+#include "host_stubs.h"
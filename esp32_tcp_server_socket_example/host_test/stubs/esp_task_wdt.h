@@ -0,0 +1,2 @@
+/* Host stand-in: esp_task_wdt.h */
+#include "host_stubs.h"
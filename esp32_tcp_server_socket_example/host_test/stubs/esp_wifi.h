@@ -0,0 +1,2 @@
+/* Host stand-in: esp_wifi.h */
+#include "host_stubs.h"
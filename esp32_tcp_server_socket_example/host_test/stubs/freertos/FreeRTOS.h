@@ -0,0 +1,2 @@
+/* Host stand-in: freertos/FreeRTOS.h */
+#include "../host_stubs.h"
@@ -0,0 +1,2 @@
+/* Host stand-in: freertos/event_groups.h */
+#include "../host_stubs.h"
@@ -0,0 +1,2 @@
+/* Host stand-in: freertos/task.h */
+#include "../host_stubs.h"
@@ -0,0 +1,2 @@
+/* Host stand-in: hal/cpu_hal.h */
+#include "../host_stubs.h"
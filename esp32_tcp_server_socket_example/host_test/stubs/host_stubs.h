@@ -0,0 +1,60 @@
+/* Header file: host stand-ins for the ESP-IDF, FreeRTOS and lwIP APIs used by the socket server
+ *
+ * Only what the host server (host_server.c) needs: tasks are threads, ticks and esp_timer come
+ * from the monotonic clock, lwIP sockets are the POSIX ones. Logs go to stdout.
+ */
+
+#ifndef HEADER_HOST_STUBS
+#define HEADER_HOST_STUBS
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/* FreeRTOS */
+#define portTICK_PERIOD_MS                  10
+#define pdTRUE                              1
+#define pdFALSE                             0
+#define pdPASS                              1
+
+typedef uint32_t TickType_t;
+typedef void *TaskHandle_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+
+/* ESP-IDF */
+#define ESP_OK                              0
+#define ESP_FAIL                            -1
+#define ESP_ERROR_CHECK(x)                  (void)(x)
+
+#define ESP_LOGE(tag, fmt, ...)             printf("E (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)             printf("W (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...)             printf("I (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...)             do { } while (0)
+
+typedef int esp_err_t;
+
+/* ESP-IDF heap capabilities (no PSRAM: every allocation comes from the C heap) */
+#define MALLOC_CAP_8BIT                     (1 << 2)
+#define MALLOC_CAP_SPIRAM                   (1 << 10)
+#define MALLOC_CAP_INTERNAL                 (1 << 11)
+#define heap_caps_malloc(size, caps)        malloc(size)
+
+#endif
+
+/* Prototypes */
+TickType_t xTaskGetTickCount(void);
+void vTaskDelay(TickType_t ticks);
+BaseType_t xTaskCreatePinnedToCore(void (*task)(void *), const char *pt_name, uint32_t stack_size, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *pt_handle, BaseType_t core);
+void vTaskDelete(TaskHandle_t handle);
+int64_t esp_timer_get_time(void);
+uint32_t esp_random(void);
+esp_err_t esp_task_wdt_add(TaskHandle_t handle);
+esp_err_t esp_task_wdt_reset(void);
+bool get_status_wifi(void);
+uint32_t cpu_hal_get_cycle_count(void);
@@ -0,0 +1,2 @@
+/* Host stand-in: lwip/err.h */
+#include "../host_stubs.h"
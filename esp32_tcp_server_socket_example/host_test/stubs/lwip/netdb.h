@@ -0,0 +1,2 @@
+/* Host stand-in: lwip/netdb.h */
+#include "../host_stubs.h"
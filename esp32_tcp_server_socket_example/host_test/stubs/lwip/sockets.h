@@ -0,0 +1,14 @@
+/* Host stand-in: lwip/sockets.h (POSIX sockets) */
+#include "../host_stubs.h"
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifndef HEADER_HOST_STUBS_SOCKETS
+#define HEADER_HOST_STUBS_SOCKETS
+char *inet_ntoa_r(struct in_addr addr, char *pt_buf, int size);
+#endif
@@ -0,0 +1,2 @@
+/* Host stand-in: lwip/sys.h */
+#include "../host_stubs.h"
@@ -0,0 +1 @@
+/* Host stand-in: sdkconfig.h (menuconfig options are compile definitions of the host targets) */
@@ -0,0 +1,292 @@
+/* Host test: generated message codec (main/msg_codec/messages.schema)
+ *
+ * Every schema message is encoded and decoded back, with fields at their limits. Malformed
+ * input must be rejected: truncated, over-long and overflowing varints, truncated payloads
+ * and fields bigger than their max length. The frames encoded here are written to
+ * msg_codec_frames.bin, which check_msg_codec.py decodes with the generated Python module.
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+#include "msg_codec.h"
+#include "msg_codec_gen.h"
+
+/* Defines */
+#define TEST_FRAMES_FILE               "msg_codec_frames.bin"
+
+/* Defines - checks */
+#define CHECK(cond)                                                                 \
+    do                                                                              \
+    {                                                                               \
+        if (!(cond))                                                                \
+        {                                                                           \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);         \
+            return false;                                                           \
+        }                                                                           \
+    } while (0)
+
+/* Static variables */
+static uint8_t frame[MSG_CODEC_MAX_FRAME_SIZE];
+static msg_echo_request_t request;
+static msg_echo_request_t request_decoded;
+static msg_echo_response_t response;
+static msg_echo_response_t response_decoded;
+static FILE *pt_frames_file = NULL;
+
+/* Function: parse an encoded frame and keep it for the Python check
+ * Params: frame size, expected message id, payload and payload length (outputs)
+ * Return: true: success
+ *         false: fail
+ */
+static bool parse_frame(size_t size, uint8_t id, const uint8_t **pt_payload, size_t *pt_payload_len)
+{
+    uint8_t parsed_id = 0;
+
+    CHECK(size > 0);
+    CHECK(msg_codec_frame_parse(frame, size, &parsed_id, pt_payload, pt_payload_len) == (int)size);
+    CHECK(parsed_id == id);
+
+    /* Any shorter part of it is incomplete */
+    CHECK(msg_codec_frame_parse(frame, size - 1, &parsed_id, pt_payload, pt_payload_len) == 0);
+    CHECK(msg_codec_frame_parse(frame, size, &parsed_id, pt_payload, pt_payload_len) == (int)size);
+
+    CHECK(fwrite(frame, 1, size, pt_frames_file) == size);
+    return true;
+}
+
+/* Function: echo_request round trip
+ * Params: seq and payload length (payload bytes: their index)
+ * Return: true: success
+ *         false: fail
+ */
+static bool round_trip_echo_request(uint32_t seq, uint16_t payload_len)
+{
+    const uint8_t *pt_payload = NULL;
+    size_t payload_size = 0;
+    uint16_t i;
+
+    request.seq = seq;
+    request.payload_len = payload_len;
+    for (i = 0; i < payload_len; i++)
+    {
+        request.payload[i] = (uint8_t)i;
+    }
+
+    CHECK(parse_frame(msg_echo_request_encode(&request, frame, sizeof(frame)), MSG_ID_ECHO_REQUEST, &pt_payload, &payload_size));
+    CHECK(msg_echo_request_decode(&request_decoded, pt_payload, payload_size) == true);
+    CHECK(request_decoded.seq == seq);
+    CHECK(request_decoded.payload_len == payload_len);
+    CHECK(memcmp(request_decoded.payload, request.payload, payload_len) == 0);
+
+    /* Truncated payload */
+    CHECK(msg_echo_request_decode(&request_decoded, pt_payload, payload_size - 1) == false);
+    return true;
+}
+
+/* Function: echo_response round trip
+ * Params: seq, uptime and payload (text)
+ * Return: true: success
+ *         false: fail
+ */
+static bool round_trip_echo_response(uint32_t seq, uint32_t uptime_ms, const char *pt_text)
+{
+    const uint8_t *pt_payload = NULL;
+    size_t payload_size = 0;
+
+    response.seq = seq;
+    response.uptime_ms = uptime_ms;
+    response.payload_len = (uint16_t)strlen(pt_text);
+    memcpy(response.payload, pt_text, response.payload_len);
+
+    CHECK(parse_frame(msg_echo_response_encode(&response, frame, sizeof(frame)), MSG_ID_ECHO_RESPONSE, &pt_payload, &payload_size));
+    CHECK(msg_echo_response_decode(&response_decoded, pt_payload, payload_size) == true);
+    CHECK(response_decoded.seq == seq);
+    CHECK(response_decoded.uptime_ms == uptime_ms);
+    CHECK(response_decoded.payload_len == response.payload_len);
+    CHECK(memcmp(response_decoded.payload, pt_text, response.payload_len) == 0);
+    CHECK(msg_echo_response_decode(&response_decoded, pt_payload, payload_size - 1) == false);
+    return true;
+}
+
+/* Function: error round trip
+ * Params: seq, code and text
+ * Return: true: success
+ *         false: fail
+ */
+static bool round_trip_error(uint32_t seq, uint32_t code, const char *pt_text)
+{
+    msg_error_t error = {0};
+    msg_error_t decoded;
+    const uint8_t *pt_payload = NULL;
+    size_t payload_size = 0;
+
+    error.seq = seq;
+    error.code = code;
+    strcpy(error.text, pt_text);
+    memset(&decoded, 0xAA, sizeof(decoded));
+
+    CHECK(parse_frame(msg_error_encode(&error, frame, sizeof(frame)), MSG_ID_ERROR, &pt_payload, &payload_size));
+    CHECK(msg_error_decode(&decoded, pt_payload, payload_size) == true);
+    CHECK(decoded.seq == seq);
+    CHECK(decoded.code == code);
+    CHECK(strcmp(decoded.text, pt_text) == 0);
+    CHECK(msg_error_decode(&decoded, pt_payload, payload_size - 1) == false);
+    return true;
+}
+
+/* Function: sensor_sample round trip
+ * Params: sensor id, timestamp and value
+ * Return: true: success
+ *         false: fail
+ */
+static bool round_trip_sensor_sample(uint8_t sensor_id, uint32_t timestamp, int32_t value)
+{
+    msg_sensor_sample_t sample = { .sensor_id = sensor_id, .timestamp = timestamp, .value = value };
+    msg_sensor_sample_t decoded = {0};
+    const uint8_t *pt_payload = NULL;
+    size_t payload_size = 0;
+
+    CHECK(parse_frame(msg_sensor_sample_encode(&sample, frame, sizeof(frame)), MSG_ID_SENSOR_SAMPLE, &pt_payload, &payload_size));
+    CHECK(msg_sensor_sample_decode(&decoded, pt_payload, payload_size) == true);
+    CHECK(decoded.sensor_id == sensor_id);
+    CHECK(decoded.timestamp == timestamp);
+    CHECK(decoded.value == value);
+    CHECK(msg_sensor_sample_decode(&decoded, pt_payload, payload_size - 1) == false);
+    return true;
+}
+
+/* Function: every schema message, fields at their limits (same order as check_msg_codec.py)
+ * Params: none
+ * Return: true: success
+ *         false: fail
+ */
+static bool test_round_trips(void)
+{
+    static const uint8_t payload_too_long[] = { 0x00, 0xE9, 0x07 };     /* seq 0, payload length 1001 */
+    char text[64 + 1];
+    size_t size;
+
+    memset(text, 't', 64);
+    text[64] = '\0';
+
+    CHECK(round_trip_echo_request(0, 0));
+    CHECK(round_trip_echo_request(UINT32_MAX, 1000));
+    CHECK(round_trip_echo_response(300, 0xDEADBEEF, "hello"));
+    CHECK(round_trip_echo_response(127, 0, ""));
+    CHECK(round_trip_error(1, 2, "unknown message"));
+    CHECK(round_trip_error(0, UINT32_MAX, text));
+    CHECK(round_trip_sensor_sample(255, UINT32_MAX, INT32_MIN));
+    CHECK(round_trip_sensor_sample(0, 0, INT32_MAX));
+    CHECK(round_trip_sensor_sample(1, 1000, -1));
+
+    /* Fields bigger than their max length aren't encoded nor decoded, buffers too small aren't written */
+    request.payload_len = 1001;
+    CHECK(msg_echo_request_encode(&request, frame, sizeof(frame)) == 0);
+    CHECK(msg_echo_request_decode(&request_decoded, payload_too_long, sizeof(payload_too_long)) == false);
+    request.payload_len = 1000;
+    size = msg_echo_request_encode(&request, frame, sizeof(frame));
+    CHECK((size > 0) && (size <= MSG_ECHO_REQUEST_MAX_SIZE));
+    CHECK(msg_echo_request_encode(&request, frame, size - 1) == 0);
+    return true;
+}
+
+/* Function: decode a varint
+ * Params: bytes, number of bytes and value (output)
+ * Return: true: valid varint, all bytes used
+ *         false: invalid
+ */
+static bool get_varint(const uint8_t *pt_bytes, size_t len, uint32_t *pt_value)
+{
+    msg_codec_reader_t rd = { .pt_buf = pt_bytes, .size = len, .pos = 0, .error = false };
+
+    *pt_value = msg_codec_get_varint(&rd);
+    return (rd.error == false) && (rd.pos == len);
+}
+
+/* Function: varints and zigzag at their limits, truncated, over-long and overflowing varints
+ * Params: none
+ * Return: true: success
+ *         false: fail
+ */
+static bool test_varints(void)
+{
+    static const uint32_t values[] = { 0, 1, 127, 128, 16383, 16384, 2097151, 2097152, 268435455, 268435456, UINT32_MAX };
+    static const uint8_t max[] = { 0xFF, 0xFF, 0xFF, 0xFF, 0x0F };
+    static const uint8_t truncated[] = { 0xFF, 0xFF, 0xFF, 0xFF };
+    static const uint8_t over_long[] = { 0x80, 0x80, 0x80, 0x80, 0x80, 0x00 };
+    static const uint8_t overflow_33_bits[] = { 0xFF, 0xFF, 0xFF, 0xFF, 0x1F };
+    static const uint8_t overflow_35_bits[] = { 0x80, 0x80, 0x80, 0x80, 0x70 };
+    static const uint8_t int32_min[] = { 0xFF, 0xFF, 0xFF, 0xFF, 0x0F };
+    static const uint8_t int32_max[] = { 0xFE, 0xFF, 0xFF, 0xFF, 0x0F };
+    static const uint8_t frame_overflow[] = { MSG_ID_ECHO_REQUEST, 0xFF, 0xFF, 0xFF, 0xFF, 0x10, 0x00 };
+    uint8_t buf[MSG_CODEC_VARINT_MAX_SIZE];
+    msg_codec_writer_t wr;
+    msg_codec_reader_t rd;
+    const uint8_t *pt_payload = NULL;
+    size_t payload_len = 0;
+    uint32_t value = 0;
+    uint8_t id = 0;
+    size_t i;
+
+    for (i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+    {
+        wr = (msg_codec_writer_t){ .pt_buf = buf, .size = sizeof(buf), .pos = 0, .error = false };
+        msg_codec_put_varint(&wr, values[i]);
+        CHECK((wr.error == false) && (wr.pos == msg_codec_varint_size(values[i])));
+        CHECK(get_varint(buf, wr.pos, &value) == true);
+        CHECK(value == values[i]);
+        CHECK(get_varint(buf, wr.pos - 1, &value) == false);
+    }
+
+    CHECK(get_varint(max, sizeof(max), &value) == true);
+    CHECK(value == UINT32_MAX);
+    CHECK(get_varint(truncated, sizeof(truncated), &value) == false);
+    CHECK(get_varint(over_long, sizeof(over_long), &value) == false);
+    CHECK(get_varint(overflow_33_bits, sizeof(overflow_33_bits), &value) == false);
+    CHECK(get_varint(overflow_35_bits, sizeof(overflow_35_bits), &value) == false);
+
+    /* Zigzag: INT32_MIN and INT32_MAX take the 5 bytes, -1 and 1 a single one */
+    wr = (msg_codec_writer_t){ .pt_buf = buf, .size = sizeof(buf), .pos = 0, .error = false };
+    msg_codec_put_svarint(&wr, INT32_MIN);
+    CHECK((wr.pos == sizeof(int32_min)) && (memcmp(buf, int32_min, sizeof(int32_min)) == 0));
+    wr = (msg_codec_writer_t){ .pt_buf = buf, .size = sizeof(buf), .pos = 0, .error = false };
+    msg_codec_put_svarint(&wr, INT32_MAX);
+    CHECK((wr.pos == sizeof(int32_max)) && (memcmp(buf, int32_max, sizeof(int32_max)) == 0));
+    wr = (msg_codec_writer_t){ .pt_buf = buf, .size = sizeof(buf), .pos = 0, .error = false };
+    msg_codec_put_svarint(&wr, -1);
+    msg_codec_put_svarint(&wr, 1);
+    CHECK((wr.pos == 2) && (buf[0] == 0x01) && (buf[1] == 0x02));
+
+    rd = (msg_codec_reader_t){ .pt_buf = int32_min, .size = sizeof(int32_min), .pos = 0, .error = false };
+    CHECK((msg_codec_get_svarint(&rd) == INT32_MIN) && (rd.error == false));
+    rd = (msg_codec_reader_t){ .pt_buf = int32_max, .size = sizeof(int32_max), .pos = 0, .error = false };
+    CHECK((msg_codec_get_svarint(&rd) == INT32_MAX) && (rd.error == false));
+
+    /* Frame header: incomplete until the payload length varint is complete, invalid once it's too long */
+    CHECK(msg_codec_frame_parse(frame_overflow, 1, &id, &pt_payload, &payload_len) == 0);
+    CHECK(msg_codec_frame_parse(frame_overflow, 5, &id, &pt_payload, &payload_len) == 0);
+    CHECK(msg_codec_frame_parse(frame_overflow, sizeof(frame_overflow), &id, &pt_payload, &payload_len) == -1);
+    return true;
+}
+
+int main(void)
+{
+    bool ok;
+
+    pt_frames_file = fopen(TEST_FRAMES_FILE, "wb");
+    if (pt_frames_file == NULL)
+    {
+        printf("can't create %s\n", TEST_FRAMES_FILE);
+        return 1;
+    }
+
+    ok = test_round_trips() && test_varints();
+    fclose(pt_frames_file);
+
+    printf("%s\n", (ok == true) ? "msg_codec: OK" : "msg_codec: FAILED");
+    return (ok == true) ? 0 : 1;
+}
@@ -0,0 +1,253 @@
+/* Host test: request trace (Chrome / Perfetto export of the host build)
+ *
+ * On host, a nanosecond clock stands in for the cycle counter, so its 32 bits wrap every
+ * ~4.3 s. The clock is simulated (clock_gettime is wrapped at link time), so the test
+ * can leave the trace idle for several counter periods. Event timestamps in the exported
+ * JSON must match the simulated time. The trace is also written to request_trace.json,
+ * which opens in Perfetto / chrome://tracing. A second export, through a write callback
+ * that keeps refusing data (a slow client), must resume to the same file.
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "request_trace/request_trace.h"
+
+/* Defines */
+#define TEST_JSON_FILE                 "request_trace.json"
+#define TEST_JSON_SIZE                 (64 * 1024)
+#define TEST_MAX_EVENTS                32
+#define TEST_RESUMED_EVENTS            200
+#define TEST_NS_PER_S                  1000000000ULL
+
+/* Defines - checks */
+#define CHECK(cond)                                                                 \
+    do                                                                              \
+    {                                                                               \
+        if (!(cond))                                                                \
+        {                                                                           \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);         \
+            return false;                                                           \
+        }                                                                           \
+    } while (0)
+
+/* Types - exported JSON (in memory) */
+typedef struct
+{
+    char text[TEST_JSON_SIZE];
+    size_t len;
+    FILE *pt_file;
+    uint32_t calls;
+    uint32_t refused;
+} test_json_t;
+
+/* Static variables */
+static uint64_t fake_clock_ns = 1 * TEST_NS_PER_S;
+static test_json_t json;
+static test_json_t json_resumed;
+
+/* Function: simulated clock (request_trace.c calls clock_gettime through the linker's --wrap)
+ * Params: clock id (unused) and time (output)
+ * Return: 0
+ */
+int __wrap_clock_gettime(clockid_t clock_id, struct timespec *pt_ts)
+{
+    pt_ts->tv_sec = (time_t)(fake_clock_ns / TEST_NS_PER_S);
+    pt_ts->tv_nsec = (long)(fake_clock_ns % TEST_NS_PER_S);
+    return 0;
+}
+
+/* Function: export callback (keeps the JSON in memory and writes it to TEST_JSON_FILE)
+ * Params: context, data and length
+ * Return: true: success
+ *         false: fail
+ */
+static bool json_write_cb(void *ctx, const uint8_t *pt_data, size_t len)
+{
+    test_json_t *pt_json = (test_json_t *)ctx;
+
+    if ((pt_json->len + len) >= sizeof(pt_json->text))
+    {
+        return false;
+    }
+
+    memcpy(&pt_json->text[pt_json->len], pt_data, len);
+    pt_json->len += len;
+    pt_json->text[pt_json->len] = '\0';
+    return (pt_json->pt_file == NULL) || (fwrite(pt_data, 1, len, pt_json->pt_file) == len);
+}
+
+/* Function: export callback of a slow client: refuses two calls out of three
+ * Params: context, data and length
+ * Return: true: success
+ *         false: refused (or fail)
+ */
+static bool json_slow_write_cb(void *ctx, const uint8_t *pt_data, size_t len)
+{
+    test_json_t *pt_json = (test_json_t *)ctx;
+
+    if ((pt_json->calls++ % 3) != 0)
+    {
+        pt_json->refused++;
+        return false;
+    }
+
+    return json_write_cb(ctx, pt_data, len);
+}
+
+/* Function: timestamps of the request events (pid 1) of the exported JSON, in file order
+ * Params: timestamps (output, ns) and their maximum number
+ * Return: number of timestamps
+ */
+static size_t parse_request_timestamps(uint64_t *pt_ts_ns, size_t max)
+{
+    const char *pt_line = json.text;
+    size_t count = 0;
+    unsigned long long us;
+    unsigned ns;
+
+    while ((pt_line = strstr(pt_line, "{\"name\":")) != NULL)
+    {
+        const char *pt_ts = strstr(pt_line, "\"ts\":");
+        const char *pt_pid = strstr(pt_line, "\"pid\":1,");
+        const char *pt_end = strchr(pt_line, '}');
+
+        if ((pt_ts != NULL) && (pt_ts < pt_end) && (pt_pid != NULL) && (pt_pid < pt_end) &&
+            (sscanf(pt_ts, "\"ts\":%llu.%3u", &us, &ns) == 2) && (count < max))
+        {
+            pt_ts_ns[count++] = (uint64_t)us * 1000 + ns;
+        }
+
+        pt_line++;
+    }
+
+    return count;
+}
+
+/* Function: test - events separated by idle periods longer than the counter period
+ * Params: none
+ * Return: true: success
+ *         false: fail
+ */
+static bool test_idle_wraps(void)
+{
+    /* Time before each event (even: idle then instant event, odd: complete event of that duration).
+       Idle periods cover up to 7 counter periods */
+    static const uint64_t steps_ns[] =
+    {
+        1000, 250, 4 * TEST_NS_PER_S, 500, 10 * TEST_NS_PER_S + 500, 3000, 13 * TEST_NS_PER_S, 20, 30 * TEST_NS_PER_S
+    };
+    uint64_t expected_ns[sizeof(steps_ns) / sizeof(steps_ns[0]) + 1];
+    uint64_t ts_ns[TEST_MAX_EVENTS];
+    request_trace_export_t export_pos = {0};
+    uint32_t start_cycles;
+    size_t count;
+    size_t i;
+
+    request_trace_init();
+    json.pt_file = fopen(TEST_JSON_FILE, "w");
+    CHECK(json.pt_file != NULL);
+
+    REQUEST_TRACE_BEGIN(REQUEST_TRACE_ACCEPT);
+    expected_ns[0] = fake_clock_ns;
+
+    for (i = 0; i < (sizeof(steps_ns) / sizeof(steps_ns[0])); i++)
+    {
+        start_cycles = request_trace_cycles();
+        fake_clock_ns += steps_ns[i];
+
+        if ((i % 2) == 0)
+        {
+            REQUEST_TRACE_INSTANT(REQUEST_TRACE_HANDLER);
+        }
+        else
+        {
+            /* Complete event: started before the step, ends now */
+            request_trace_complete(REQUEST_TRACE_RECV, start_cycles);
+        }
+
+        expected_ns[i + 1] = fake_clock_ns;
+    }
+
+    CHECK(request_trace_export_json(&export_pos, json_write_cb, &json));
+    fclose(json.pt_file);
+    json.pt_file = NULL;
+
+    /* First event (begin), then one event per step; complete events are exported at their start */
+    count = parse_request_timestamps(ts_ns, TEST_MAX_EVENTS);
+    CHECK(count == (sizeof(steps_ns) / sizeof(steps_ns[0])) + 1);
+
+    for (i = 0; i < count; i++)
+    {
+        uint64_t event_ns = ((i % 2) == 0) && (i > 0) ? expected_ns[i] - steps_ns[i - 1] : expected_ns[i];
+        int64_t error_ns = (int64_t)(ts_ns[i] - ts_ns[0]) - (int64_t)(event_ns - expected_ns[0]);
+
+        if ((error_ns > 1) || (error_ns < -1))
+        {
+            printf("event %zu: %llu ns after the first one, expected %llu ns\n", i,
+                   (unsigned long long)(ts_ns[i] - ts_ns[0]), (unsigned long long)(event_ns - expected_ns[0]));
+            return false;
+        }
+    }
+
+    printf("%zu events over %llu s of simulated time (%llu counter wraps), written to %s\n", count,
+           (unsigned long long)((expected_ns[count - 1] - expected_ns[0]) / TEST_NS_PER_S),
+           (unsigned long long)((expected_ns[count - 1] >> 32) - (expected_ns[0] >> 32)), TEST_JSON_FILE);
+    return true;
+}
+
+/* Function: test - export resumed after each refused write gives the same file
+ * Params: none
+ * Return: true: success
+ *         false: fail
+ */
+static bool test_resumed_export(void)
+{
+    request_trace_export_t export_pos = {0};
+    uint32_t calls = 0;
+    uint32_t i;
+
+    /* Enough events for several output chunks */
+    for (i = 0; i < TEST_RESUMED_EVENTS; i++)
+    {
+        fake_clock_ns += 1000;
+        REQUEST_TRACE_INSTANT(REQUEST_TRACE_SEND);
+    }
+
+    memset(&json, 0, sizeof(json));
+    CHECK(request_trace_export_json(&export_pos, json_write_cb, &json));
+    memset(&export_pos, 0, sizeof(export_pos));
+
+    while (request_trace_export_json(&export_pos, json_slow_write_cb, &json_resumed) == false)
+    {
+        /* Recording stays paused between calls */
+        REQUEST_TRACE_INSTANT(REQUEST_TRACE_HANDLER);
+        CHECK(++calls < 10000);
+    }
+
+    CHECK(json_resumed.refused > 0);
+    CHECK(json_resumed.len == json.len);
+    CHECK(memcmp(json_resumed.text, json.text, json.len) == 0);
+    printf("export resumed %" PRIu32 " times, same %zu bytes\n", json_resumed.refused, json_resumed.len);
+
+    /* Recording starts again once the export is done */
+    REQUEST_TRACE_INSTANT(REQUEST_TRACE_HANDLER);
+    memset(&export_pos, 0, sizeof(export_pos));
+    memset(&json_resumed, 0, sizeof(json_resumed));
+    CHECK(request_trace_export_json(&export_pos, json_write_cb, &json_resumed));
+    CHECK(json_resumed.len > json.len);
+    return true;
+}
+
+int main(void)
+{
+    bool ok = test_idle_wraps() && test_resumed_export();
+
+    printf("%s\n", (ok == true) ? "request_trace: OK" : "request_trace: FAILED");
+    return (ok == true) ? 0 : 1;
+}
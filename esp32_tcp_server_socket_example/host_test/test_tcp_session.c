@@ -0,0 +1,213 @@
+/* Host test: tcp session (resumable sessions with replay buffer)
+ *
+ * Module checks: frame parsing, replay ring wrap-around and overflow, session slots.
+ * The server side (handshake, replay after a connection reset, duplicates) is checked on the
+ * real server by check_tcp_session.py.
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "tcp_session/tcp_session.h"
+
+/* Defines - messages */
+#define TEST_PAYLOAD_MAX               200
+
+/* Defines - checks */
+#define CHECK(cond)                                                                 \
+    do                                                                              \
+    {                                                                               \
+        if (!(cond))                                                                \
+        {                                                                           \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);         \
+            return false;                                                           \
+        }                                                                           \
+    } while (0)
+
+/* Static variables */
+static uint32_t replay_last_seq = 0;
+static uint32_t rng_state = 0x12345678;
+
+/* Function: pseudo-random number (xorshift32, so runs are reproducible)
+ * Params: upper bound (exclusive)
+ * Return: number in [0, bound)
+ */
+static uint32_t rng(uint32_t bound)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state % bound;
+}
+
+/* Function: payload of a message (derived from direction and seq, so the receiver can check it)
+ * Params: direction salt, seq, output buffer
+ * Return: payload length
+ */
+static uint16_t make_payload(uint8_t salt, uint32_t seq, uint8_t *pt_buf)
+{
+    uint16_t len = (uint16_t)(1 + ((seq * 37u + salt) % TEST_PAYLOAD_MAX));
+    uint16_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        pt_buf[i] = (uint8_t)(seq + i + salt);
+    }
+
+    return len;
+}
+
+/* Function: test - frames split at every byte boundary
+ * Params: none
+ * Return: true: success
+ *         false: fail
+ */
+static bool test_frame_parse(void)
+{
+    uint8_t frame[TCP_SESSION_FRAME_HEADER_SIZE + 3];
+    tcp_session_frame_hdr_t hdr;
+    size_t size;
+    size_t i;
+
+    size = tcp_session_frame_build(frame, sizeof(frame), TCP_SESSION_FRAME_DATA, 0x01020304, (const uint8_t *)"abc", 3);
+    CHECK(size == sizeof(frame));
+    CHECK(tcp_session_frame_build(frame, sizeof(frame) - 1, TCP_SESSION_FRAME_DATA, 1, (const uint8_t *)"abc", 3) == 0);
+
+    for (i = 0; i < size; i++)
+    {
+        CHECK(tcp_session_frame_parse(frame, i, &hdr) == 0);
+    }
+
+    CHECK(tcp_session_frame_parse(frame, size, &hdr) == (int)size);
+    CHECK((hdr.type == TCP_SESSION_FRAME_DATA) && (hdr.seq == 0x01020304) && (hdr.len == 3));
+
+    frame[0] = TCP_SESSION_FRAME_DATA_SERVER;
+    CHECK(tcp_session_frame_parse(frame, size, &hdr) == -1);
+    return true;
+}
+
+/* Function: replay callback of test_replay_ring (messages must follow the last one received)
+ * Params: context, seq, payload and payload length
+ * Return: true: success
+ *         false: check failed
+ */
+static bool check_replay(void *ctx, uint32_t seq, const uint8_t *pt_payload, uint16_t len)
+{
+    uint8_t expected[TEST_PAYLOAD_MAX];
+
+    CHECK(seq == replay_last_seq + 1);
+    CHECK((len == make_payload(0xA5, seq, expected)) && (memcmp(pt_payload, expected, len) == 0));
+    replay_last_seq = seq;
+    return true;
+}
+
+/* Function: test - replay ring wrap-around with messages of every size, and overflow
+ * Params: none
+ * Return: true: success
+ *         false: fail
+ */
+static bool test_replay_ring(void)
+{
+    static uint8_t payload[TCP_SESSION_REPLAY_BUFFER_SIZE];
+    tcp_session_t *pt_session = tcp_session_open(0x1111);
+    uint32_t acked = 0;
+    uint32_t from_seq;
+    uint32_t seq;
+    uint32_t i;
+    uint16_t len;
+
+    /* Keep a random window of messages in the ring while it wraps many times */
+    for (i = 0; i < 20000; i++)
+    {
+        len = make_payload(0xA5, pt_session->next_tx_seq, payload);
+        CHECK(tcp_session_queue(pt_session, payload, len, &seq));
+        CHECK(tcp_session_replay_bytes_used(pt_session) <= TCP_SESSION_REPLAY_BUFFER_SIZE);
+
+        while (tcp_session_replay_bytes_used(pt_session) > (TCP_SESSION_REPLAY_BUFFER_SIZE / 2))
+        {
+            acked += 1 + rng(4);
+            acked = (acked < seq) ? acked : seq;
+            tcp_session_ack(pt_session, acked);
+            CHECK(pt_session->replay_count == seq - acked);
+        }
+
+        /* Resume from any acknowledged point: replay starts right after it */
+        if (rng(50) == 0)
+        {
+            replay_last_seq = acked;
+            CHECK(tcp_session_resume(0x1111, acked) == pt_session);
+            CHECK(tcp_session_replay(pt_session, acked + 1, check_replay, NULL) == pt_session->replay_count);
+            CHECK(replay_last_seq == seq);
+
+            /* Replay continued from the middle of the ring (client read part of it) */
+            from_seq = acked + 1 + rng(pt_session->replay_count + 1);
+            replay_last_seq = from_seq - 1;
+            CHECK(tcp_session_replay(pt_session, from_seq, check_replay, NULL) == (seq + 1 - from_seq));
+            CHECK(replay_last_seq == seq);
+        }
+    }
+
+    CHECK(pt_session->resumable == true);
+
+    /* Acknowledging more than was sent can't be resumed */
+    CHECK(tcp_session_resume(0x1111, seq + 1) == NULL);
+
+    /* Overflow: oldest messages are lost, so the session isn't resumable anymore */
+    CHECK(tcp_session_queue(pt_session, payload, TCP_SESSION_REPLAY_BUFFER_SIZE, &seq) == false);
+
+    for (i = 0; i < 64; i++)
+    {
+        CHECK(tcp_session_queue(pt_session, payload, 100, &seq));
+    }
+
+    CHECK(pt_session->resumable == false);
+    CHECK(tcp_session_resume(0x1111, acked) == NULL);
+
+    tcp_session_close(pt_session);
+    return true;
+}
+
+/* Function: test - a closed session releases its slot (a new session takes it instead of evicting another one)
+ * Params: none
+ * Return: true: success
+ *         false: fail
+ */
+static bool test_session_slots(void)
+{
+    tcp_session_stats_t stats;
+    tcp_session_t *pt_first = tcp_session_open(0xAAAA);
+    tcp_session_t *pt_second = tcp_session_open(0xBBBB);
+    uint8_t payload[4] = {1, 2, 3, 4};
+    uint32_t seq;
+
+    CHECK((pt_first != pt_second) && (TCP_SESSION_MAX_SESSIONS == 2));
+    CHECK(tcp_session_queue(pt_first, payload, sizeof(payload), &seq));
+
+    /* Second session closed: the new one takes the freed slot instead of evicting the first session */
+    tcp_session_close(pt_second);
+    tcp_session_get_stats(&stats);
+    CHECK(stats.replay_bytes_used == tcp_session_replay_bytes_used(pt_first));
+    CHECK(tcp_session_open(0xCCCC) == pt_second);
+    CHECK(tcp_session_resume(0xAAAA, 0) == pt_first);
+    CHECK(pt_first->replay_count == 1);
+    CHECK(tcp_session_resume(0xBBBB, 0) == NULL);
+
+    tcp_session_close(pt_first);
+    tcp_session_close(pt_second);
+    return true;
+}
+
+int main(void)
+{
+    bool ok = true;
+
+    ok &= test_frame_parse();
+    ok &= test_replay_ring();
+    ok &= test_session_slots();
+
+    printf("%s\n", (ok == true) ? "tcp_session: OK" : "tcp_session: FAILED");
+    return (ok == true) ? 0 : 1;
+}
@@ -0,0 +1,304 @@
+/* Host test: time-series log (file backend of the host build)
+ *
+ * Power lost while a block is written leaves a torn block: its header is in flash, part of
+ * its samples aren't. The log is written by a child process (a mount lasts for the whole
+ * process), the first block of the head sector is torn in the file, then the log is mounted
+ * again: the newest timestamp, the index and the queries must come from the blocks written
+ * before it. A query paused by its callback (a slow client) must then resume where it left
+ * off while samples are appended, and report lost samples once the ring reuses its sector.
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "ts_log/ts_log.h"
+
+/* Defines */
+#define TEST_FIRST_TIMESTAMP           1000
+#define TEST_SECTOR_MAGIC              0x474C5354
+#define TEST_MAX_SECTORS               (TS_LOG_HOST_FILE_SIZE / TS_LOG_SECTOR_SIZE)
+#define TEST_PAUSED_SAMPLES            2000
+
+/* Defines - checks */
+#define CHECK(cond)                                                                 \
+    do                                                                              \
+    {                                                                               \
+        if (!(cond))                                                                \
+        {                                                                           \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);         \
+            return false;                                                           \
+        }                                                                           \
+    } while (0)
+
+/* Types - query result */
+typedef struct
+{
+    uint32_t count;
+    uint32_t next_timestamp;
+    bool in_order;
+    uint32_t calls;
+    uint32_t refused;
+} test_query_t;
+
+/* Function: query callback (samples must be the ones appended, in order)
+ * Params: query result and sample
+ * Return: true
+ */
+static bool check_sample(void *ctx, const ts_log_sample_t *pt_sample)
+{
+    test_query_t *pt_query = (test_query_t *)ctx;
+
+    pt_query->in_order &= (pt_sample->timestamp == pt_query->next_timestamp) &&
+                          (pt_sample->value == -(int32_t)pt_sample->timestamp);
+    pt_query->next_timestamp++;
+    pt_query->count++;
+    return true;
+}
+
+/* Function: query callback of a slow client: refuses two calls out of three
+ * Params: query result and sample
+ * Return: true: sample taken
+ *         false: refused (query paused)
+ */
+static bool check_sample_slow(void *ctx, const ts_log_sample_t *pt_sample)
+{
+    test_query_t *pt_query = (test_query_t *)ctx;
+
+    if ((pt_query->calls++ % 3) != 0)
+    {
+        pt_query->refused++;
+        return false;
+    }
+
+    return check_sample(ctx, pt_sample);
+}
+
+/* Function: query callback that pauses after the first sample (samples must increase)
+ * Params: query result and sample
+ * Return: true: sample taken
+ *         false: refused (query paused)
+ */
+static bool check_sample_pause(void *ctx, const ts_log_sample_t *pt_sample)
+{
+    test_query_t *pt_query = (test_query_t *)ctx;
+
+    if (pt_query->calls++ == 1)
+    {
+        return false;
+    }
+
+    pt_query->in_order &= (pt_sample->timestamp >= pt_query->next_timestamp);
+    pt_query->next_timestamp = pt_sample->timestamp + 1;
+    pt_query->count++;
+    return true;
+}
+
+/* Function: write the log (child process): one block per flush, until a flush opens a new sector
+ * Params: none
+ * Return: true: success
+ *         false: fail
+ */
+static bool write_log(void)
+{
+    ts_log_stats_t stats;
+    uint32_t timestamp = TEST_FIRST_TIMESTAMP;
+    uint32_t erased;
+    uint32_t i;
+
+    CHECK(ts_log_init() == true);
+
+    /* Stops when the last flush opened the head sector (its first block is the last one written) */
+    do
+    {
+        ts_log_get_stats(&stats);
+        erased = stats.sectors_erased;
+
+        for (i = 0; i < TS_LOG_BATCH_SAMPLES; i++, timestamp++)
+        {
+            CHECK(ts_log_append(timestamp, 1, -(int32_t)timestamp) == true);
+        }
+
+        CHECK(ts_log_flush() == true);
+        ts_log_get_stats(&stats);
+    } while ((stats.sectors_erased == erased) || (stats.blocks_written < 20));
+
+    return true;
+}
+
+/* Function: tear the first block of the head sector (sector with the highest sequence number): header
+ *           is written, the end of its samples is still erased
+ * Params: first timestamp of the torn block (output)
+ * Return: true: success
+ *         false: fail
+ */
+static bool tear_head_block(uint32_t *pt_torn_timestamp)
+{
+    static uint8_t sector_data[TS_LOG_SECTOR_SIZE];
+    FILE *pt_file = fopen(TS_LOG_HOST_FILE, "r+b");
+    uint32_t header[2];
+    uint32_t head = 0;
+    uint32_t head_seq = 0;
+    uint32_t i;
+    uint16_t count;
+    size_t block_end;
+
+    CHECK(pt_file != NULL);
+
+    for (i = 0; i < TEST_MAX_SECTORS; i++)
+    {
+        CHECK(fseek(pt_file, (long)i * TS_LOG_SECTOR_SIZE, SEEK_SET) == 0);
+        CHECK(fread(header, sizeof(header), 1, pt_file) == 1);
+
+        if ((header[0] == TEST_SECTOR_MAGIC) && (header[1] >= head_seq))
+        {
+            head = i;
+            head_seq = header[1];
+        }
+    }
+
+    CHECK(fseek(pt_file, (long)head * TS_LOG_SECTOR_SIZE, SEEK_SET) == 0);
+    CHECK(fread(sector_data, sizeof(sector_data), 1, pt_file) == 1);
+
+    /* Block header (magic, count, first and last timestamps, CRC) right after the sector header */
+    memcpy(&count, &sector_data[TS_LOG_SECTOR_HEADER_SIZE + 2], sizeof(count));
+    memcpy(pt_torn_timestamp, &sector_data[TS_LOG_SECTOR_HEADER_SIZE + 4], sizeof(*pt_torn_timestamp));
+    CHECK((count > 0) && (count <= TS_LOG_BATCH_SAMPLES));
+    block_end = TS_LOG_SECTOR_HEADER_SIZE + TS_LOG_BLOCK_HEADER_SIZE + count * sizeof(ts_log_sample_t);
+    memset(&sector_data[block_end - 40], 0xFF, 40);
+
+    CHECK(fseek(pt_file, (long)head * TS_LOG_SECTOR_SIZE, SEEK_SET) == 0);
+    CHECK(fwrite(sector_data, sizeof(sector_data), 1, pt_file) == 1);
+    fclose(pt_file);
+
+    printf("first block of head sector %" PRIu32 " (seq %" PRIu32 ", %u samples from %" PRIu32 ") torn\n",
+           head, head_seq, count, *pt_torn_timestamp);
+    return true;
+}
+
+/* Function: test - mount after a torn first block in the head sector
+ * Params: none
+ * Return: true: success
+ *         false: fail
+ */
+static bool test_torn_head_block(void)
+{
+    test_query_t query = { .count = 0, .next_timestamp = TEST_FIRST_TIMESTAMP, .in_order = true };
+    ts_log_stats_t stats;
+    uint32_t torn_timestamp;
+    uint32_t newest;
+    pid_t child;
+    int status;
+
+    remove(TS_LOG_HOST_FILE);
+    child = fork();
+    CHECK(child >= 0);
+
+    if (child == 0)
+    {
+        exit((write_log() == true) ? 0 : 1);
+    }
+
+    CHECK((waitpid(child, &status, 0) == child) && WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+    CHECK(tear_head_block(&torn_timestamp) == true);
+
+    /* Newest timestamp: last sample of the block before the torn one */
+    CHECK(ts_log_init() == true);
+    ts_log_get_stats(&stats);
+    CHECK(stats.crc_errors == 1);
+    CHECK((stats.blocks_written == 0) && (stats.samples_appended == 0));
+    newest = stats.newest_timestamp;
+    printf("remounted: newest timestamp %" PRIu32 ", oldest %" PRIu32 "\n", newest, stats.oldest_timestamp);
+    CHECK(stats.oldest_timestamp == TEST_FIRST_TIMESTAMP);
+    CHECK(newest == torn_timestamp - 1);
+
+    /* Every sample before the torn block, in order */
+    CHECK(ts_log_query(0, UINT32_MAX, check_sample, &query) == true);
+    CHECK(query.in_order == true);
+    CHECK(query.count == newest + 1 - TEST_FIRST_TIMESTAMP);
+
+    /* Samples older than the newest one are still rejected; the next block goes to a new sector */
+    CHECK(ts_log_append(newest - 1, 1, 0) == false);
+    CHECK(ts_log_append(newest + 1, 1, -(int32_t)(newest + 1)) == true);
+    CHECK(ts_log_flush() == true);
+
+    query.count = 0;
+    query.next_timestamp = newest + 1;
+    query.in_order = true;
+    CHECK(ts_log_query(newest + 1, UINT32_MAX, check_sample, &query) == true);
+    CHECK((query.in_order == true) && (query.count == 1));
+    return true;
+}
+
+/* Function: test - query paused by its callback, resumed while samples are appended
+ * Params: none
+ * Return: true: success
+ *         false: fail
+ */
+static bool test_paused_query(void)
+{
+    test_query_t query = { .count = 0, .in_order = true, .calls = 0, .refused = 0 };
+    ts_log_query_t cursor;
+    ts_log_stats_t stats;
+    uint32_t first;
+    uint32_t last;
+    uint32_t timestamp;
+    uint32_t dropped;
+
+    ts_log_get_stats(&stats);
+    first = stats.newest_timestamp + 1;
+
+    for (timestamp = first; timestamp < first + TEST_PAUSED_SAMPLES; timestamp++)
+    {
+        CHECK(ts_log_append(timestamp, 1, -(int32_t)timestamp) == true);
+    }
+
+    /* Samples appended while the query is paused aren't part of it */
+    query.next_timestamp = first;
+    CHECK(ts_log_query_start(&cursor, first, UINT32_MAX) == true);
+
+    while (cursor.done == false)
+    {
+        CHECK(ts_log_query_next(&cursor, check_sample_slow, &query) == true);
+        CHECK(ts_log_append(timestamp, 1, -(int32_t)timestamp) == true);
+        timestamp++;
+    }
+
+    CHECK((query.in_order == true) && (query.count == TEST_PAUSED_SAMPLES) && (cursor.lost == false));
+    printf("query paused %" PRIu32 " times, %" PRIu32 " samples in order\n", query.refused, query.count);
+
+    /* The ring reuses the oldest sectors (the one the paused query is in) until the query resumes:
+       it goes on from the oldest sector left, up to the last sample appended before it started */
+    memset(&query, 0, sizeof(query));
+    query.in_order = true;
+    last = timestamp - 1;
+    CHECK(ts_log_query_start(&cursor, 0, UINT32_MAX) == true);
+    CHECK(ts_log_query_next(&cursor, check_sample_pause, &query) == true);
+    CHECK((cursor.done == false) && (query.count == 1));
+
+    ts_log_get_stats(&stats);
+    for (dropped = stats.sectors_dropped; stats.sectors_dropped < dropped + 2; timestamp++)
+    {
+        CHECK(ts_log_append(timestamp, 1, -(int32_t)timestamp) == true);
+        ts_log_get_stats(&stats);
+    }
+
+    CHECK(ts_log_query_next(&cursor, check_sample_pause, &query) == true);
+    CHECK((cursor.done == true) && (cursor.lost == true) && (query.in_order == true));
+    CHECK((query.count > 1) && (query.next_timestamp == last + 1));
+    printf("2 sectors reused during a paused query: lost samples reported, %" PRIu32 " samples in order\n", query.count);
+    return true;
+}
+
+int main(void)
+{
+    bool ok = test_torn_head_block() && test_paused_query();
+
+    printf("%s\n", (ok == true) ? "ts_log: OK" : "ts_log: FAILED");
+    return (ok == true) ? 0 : 1;
+}
@@ -0,0 +1,145 @@
+/* Host benchmark: time-series log (append rate, query throughput, seek time, erase counts)
+ *
+ * Runs against the file that stands in for the partition (TS_LOG_HOST_FILE, in the working
+ * folder), never against a device: the benchmark appends TS_LOG_BENCH_SAMPLES synthetic samples,
+ * which would take their place in the ring of a real log. Numbers are the ones of the host
+ * file backend; the flash format, the index and the query path are the firmware's.
+ * The file is removed first, so every run starts from an empty log.
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <time.h>
+#include "ts_log/ts_log.h"
+
+/* Defines - benchmark params (samples are appended to the log with sensor id TS_LOG_BENCH_SENSOR_ID) */
+#define TS_LOG_BENCH_SAMPLES               20000
+#define TS_LOG_BENCH_SENSOR_ID             0xFF
+#define TS_LOG_BENCH_SEEKS                 100
+#define TS_LOG_BENCH_SEEK_RANGE            10
+
+/* Defines - debug */
+#define TS_LOG_BENCH_TAG                   "TS_LOG_BENCH"
+#define BENCH_LOG(fmt, ...)                printf(TS_LOG_BENCH_TAG ": " fmt "\n", ##__VA_ARGS__)
+
+/* Static variables */
+static uint32_t bench_count = 0;
+
+/* Function: monotonic time
+ * Params: none
+ * Return: us
+ */
+static int64_t bench_time_us(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* Function: elapsed time, never 0 (used as divisor)
+ * Params: elapsed time
+ * Return: elapsed time (at least 1 us)
+ */
+static int64_t elapsed_min(int64_t elapsed_us)
+{
+    return (elapsed_us > 0) ? elapsed_us : 1;
+}
+
+/* Function: query callback (counts samples)
+ * Params: context (unused) and sample
+ * Return: true
+ */
+static bool count_sample(void *ctx, const ts_log_sample_t *pt_sample)
+{
+    bench_count++;
+    return true;
+}
+
+/* Function: run benchmark and log the results (appends TS_LOG_BENCH_SAMPLES samples to the log)
+ * Params: none
+ * Return: true: success (every sample appended and returned by the query, no CRC error)
+ *         false: fail
+ */
+static bool ts_log_run_benchmark(void)
+{
+    ts_log_stats_t before;
+    ts_log_stats_t after;
+    uint32_t first_timestamp;
+    uint32_t timestamp;
+    uint32_t i;
+    int64_t start_us;
+    int64_t elapsed_us;
+
+    ts_log_get_stats(&before);
+    first_timestamp = before.newest_timestamp + 1;
+
+    /* Append rate (includes block writes and sector erases) */
+    start_us = bench_time_us();
+    for (i = 0; i < TS_LOG_BENCH_SAMPLES; i++)
+    {
+        if (ts_log_append(first_timestamp + i, TS_LOG_BENCH_SENSOR_ID, (int32_t)i) == false)
+        {
+            BENCH_LOG("Error: append failed (sample %" PRIu32 ")", i);
+            return false;
+        }
+    }
+    (void)ts_log_flush();
+    elapsed_us = elapsed_min(bench_time_us() - start_us);
+
+    ts_log_get_stats(&after);
+    BENCH_LOG("append: %d samples in %" PRId64 " us (%" PRId64 " samples/s), %" PRIu32 " blocks, %" PRIu32 " bytes, %" PRIu32 " sectors erased",
+              TS_LOG_BENCH_SAMPLES, elapsed_us, ((int64_t)TS_LOG_BENCH_SAMPLES * 1000000) / elapsed_us,
+              after.blocks_written - before.blocks_written, after.bytes_written - before.bytes_written,
+              after.sectors_erased - before.sectors_erased);
+
+    /* Query throughput (whole benchmark range, streamed from mapped flash) */
+    bench_count = 0;
+    start_us = bench_time_us();
+    (void)ts_log_query(first_timestamp, first_timestamp + TS_LOG_BENCH_SAMPLES - 1, count_sample, NULL);
+    elapsed_us = elapsed_min(bench_time_us() - start_us);
+
+    BENCH_LOG("query: %" PRIu32 " samples in %" PRId64 " us (%" PRId64 " samples/s, %" PRId64 " kB/s)",
+              bench_count, elapsed_us, ((int64_t)bench_count * 1000000) / elapsed_us,
+              ((int64_t)bench_count * sizeof(ts_log_sample_t) * 1000000) / (elapsed_us * 1024));
+
+    if (bench_count != TS_LOG_BENCH_SAMPLES)
+    {
+        BENCH_LOG("Error: query returned %" PRIu32 " samples", bench_count);
+        return false;
+    }
+
+    /* Seek time (short ranges spread over the log: index search plus a few blocks) */
+    bench_count = 0;
+    start_us = bench_time_us();
+    for (i = 0; i < TS_LOG_BENCH_SEEKS; i++)
+    {
+        timestamp = first_timestamp + (i * (TS_LOG_BENCH_SAMPLES - TS_LOG_BENCH_SEEK_RANGE)) / TS_LOG_BENCH_SEEKS;
+        (void)ts_log_query(timestamp, timestamp + TS_LOG_BENCH_SEEK_RANGE - 1, count_sample, NULL);
+    }
+    elapsed_us = bench_time_us() - start_us;
+
+    BENCH_LOG("seek: %d queries of %d samples, %" PRId64 " us/query (%" PRIu32 " samples)",
+              TS_LOG_BENCH_SEEKS, TS_LOG_BENCH_SEEK_RANGE, elapsed_us / TS_LOG_BENCH_SEEKS, bench_count);
+
+    ts_log_get_stats(&after);
+    BENCH_LOG("sectors: %" PRIu32 "/%" PRIu32 " used, erase count min %" PRIu32 " max %" PRIu32 ", %" PRIu32 " CRC errors",
+              after.sectors_used, after.sectors_total, after.erase_count_min, after.erase_count_max, after.crc_errors);
+
+    return (bench_count == TS_LOG_BENCH_SEEKS * TS_LOG_BENCH_SEEK_RANGE) && (after.crc_errors == 0);
+}
+
+int main(void)
+{
+    bool ok;
+
+    /* Empty log: a file left by a previous run would be measured full (and could hold samples of another build) */
+    (void)remove(TS_LOG_HOST_FILE);
+    ok = (ts_log_init() == true) && (ts_log_run_benchmark() == true);
+
+    printf("%s\n", (ok == true) ? "ts_log_bench: OK" : "ts_log_bench: FAILED");
+    return (ok == true) ? 0 : 1;
+}
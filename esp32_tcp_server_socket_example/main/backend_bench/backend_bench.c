@@ -0,0 +1,187 @@
+/* Module: TCP server backend benchmark (sockets vs netconn, over the loopback interface)
+ *
+ * With the benchmark enabled both backends run: sockets on the data port and netconn on
+ * NETCONN_TCP_SERVER_PORT. Once wi-fi is up, this task echoes the same messages through
+ * each of them (connecting to the station's own address, so lwIP loops them back without
+ * the radio) and logs throughput next to the bytes each server copied per message.
+ * Logs are lowered to warnings during the runs, so UART output doesn't dominate the times.
+ */
+
+/* Includes */
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+
+/* Includes - modules */
+#include "../wifi_st/wifi_st.h"
+#include "../socket_tcp_server/socket_tcp_server.h"
+#include "../netconn_tcp_server/netconn_tcp_server.h"
+#include "backend_bench.h"
+
+/* Tasks parametrization */
+#include "../prio_tasks.h"
+#include "../stacks_sizes.h"
+
+/* Defines - task aguments and CPU */
+#define PARAMS_BACKEND_BENCH               NULL
+#define CPU_BACKEND_BENCH                  0
+
+/* Defines - debug */
+#define BACKEND_BENCH_TAG                  "BACKEND_BENCH"
+
+/* Types - backend under test */
+typedef struct
+{
+    const char *pt_name;
+    uint16_t port;
+    void (*get_copy_stats)(tcp_server_copy_stats_t *pt_stats);
+} bench_backend_t;
+
+/* Static variables (kept out of the task stack) */
+static uint8_t bench_msg[BACKEND_BENCH_MSG_SIZE];
+static uint8_t bench_answer[BACKEND_BENCH_ECHO_PREFIX_SIZE + BACKEND_BENCH_MSG_SIZE];
+
+static const bench_backend_t bench_backends[] =
+{
+    { "sockets", WIFI_PORT_SOCKET_TCP_SERVER, socket_tcp_server_get_copy_stats },
+    { "netconn", NETCONN_TCP_SERVER_PORT, netconn_tcp_server_get_copy_stats },
+};
+
+/* Tasks */
+static void backend_bench_task(void *arg);
+
+/* Local functions */
+static bool run_backend(const bench_backend_t *pt_backend);
+
+/* Function: start backend benchmark task
+ * Params: none
+ * Return: none
+ */
+void backend_bench_init(void)
+{
+    xTaskCreatePinnedToCore(backend_bench_task, "backend_bench_task",
+                            BACKEND_BENCH_TAM_TASK_STACK,
+                            PARAMS_BACKEND_BENCH,
+                            PRIO_TASK_BACKEND_BENCH,
+                            NULL,
+                            CPU_BACKEND_BENCH);
+}
+
+/* Function: backend benchmark task (runs once)
+ * Params: task arguments
+ * Return: none
+ */
+static void backend_bench_task(void *arg)
+{
+    size_t i;
+
+    /* Wait for wi-fi connection and for both servers to listen */
+    while (get_status_wifi() == false)
+    {
+        vTaskDelay(100 / portTICK_PERIOD_MS);
+    }
+    vTaskDelay(BACKEND_BENCH_START_DELAY_MS / portTICK_PERIOD_MS);
+
+    memset(bench_msg, 'a', sizeof(bench_msg));
+    ESP_LOGI(BACKEND_BENCH_TAG, "Echoing %d msgs of %d bytes through each backend...", BACKEND_BENCH_MSGS, BACKEND_BENCH_MSG_SIZE);
+
+    for (i = 0; i < sizeof(bench_backends) / sizeof(bench_backends[0]); i++)
+    {
+        if (run_backend(&bench_backends[i]) == false)
+        {
+            ESP_LOGE(BACKEND_BENCH_TAG, "Error: %s benchmark failed", bench_backends[i].pt_name);
+        }
+    }
+
+    vTaskDelete(NULL);
+}
+
+/* Function: echo BACKEND_BENCH_MSGS messages through a backend and log the results
+ * Params: backend
+ * Return: true: success
+ *         false: fail
+ */
+static bool run_backend(const bench_backend_t *pt_backend)
+{
+    struct sockaddr_in dest_addr = {0};
+    struct timeval timeout;
+    tcp_server_copy_stats_t before;
+    tcp_server_copy_stats_t after;
+    int64_t start_us;
+    int64_t elapsed_us;
+    size_t received;
+    int nodelay = 1;
+    int sock;
+    int len;
+    int i;
+    bool ret = true;
+
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_port = htons(pt_backend->port);
+    dest_addr.sin_addr.s_addr = inet_addr(WIFI_ST_STATIC_IP);
+
+    sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (sock < 0)
+    {
+        return false;
+    }
+
+    timeout.tv_sec = BACKEND_BENCH_RECV_TIMEOUT_MS / 1000;
+    timeout.tv_usec = (BACKEND_BENCH_RECV_TIMEOUT_MS % 1000) * 1000;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(int));
+
+    if (connect(sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) != 0)
+    {
+        close(sock);
+        return false;
+    }
+
+    /* Let the server accept the connection before taking the counters */
+    vTaskDelay(200 / portTICK_PERIOD_MS);
+    esp_log_level_set("*", ESP_LOG_WARN);
+    pt_backend->get_copy_stats(&before);
+    start_us = esp_timer_get_time();
+
+    for (i = 0; (i < BACKEND_BENCH_MSGS) && (ret == true); i++)
+    {
+        if (send(sock, bench_msg, sizeof(bench_msg), 0) != (int)sizeof(bench_msg))
+        {
+            ret = false;
+            break;
+        }
+
+        for (received = 0; received < sizeof(bench_answer); received += len)
+        {
+            len = recv(sock, &bench_answer[received], sizeof(bench_answer) - received, 0);
+            if (len <= 0)
+            {
+                ret = false;
+                break;
+            }
+        }
+    }
+
+    elapsed_us = esp_timer_get_time() - start_us;
+    pt_backend->get_copy_stats(&after);
+    esp_log_level_set("*", ESP_LOG_INFO);
+    close(sock);
+
+    if ((ret == false) || (after.msgs == before.msgs) || (elapsed_us <= 0))
+    {
+        return false;
+    }
+
+    /* Copies per echoed message. The server counts a message per receive (one per message here, as the next one waits for the answer) */
+    ESP_LOGI(BACKEND_BENCH_TAG, "%s: %d msgs in %" PRId64 " us, %" PRId64 " msgs/s, %" PRId64 " KB/s echoed, %" PRIu32 " bytes copied per msg (%" PRIu32 " msgs counted by the server)",
+             pt_backend->pt_name, BACKEND_BENCH_MSGS, elapsed_us, ((int64_t)BACKEND_BENCH_MSGS * 1000000) / elapsed_us,
+             ((int64_t)BACKEND_BENCH_MSGS * sizeof(bench_answer) * 1000000) / (elapsed_us * 1024),
+             (after.copied_bytes - before.copied_bytes) / BACKEND_BENCH_MSGS, after.msgs - before.msgs);
+
+    return true;
+}
@@ -0,0 +1,16 @@
+/* Header file: TCP server backend benchmark (sockets vs netconn, over the loopback interface) */
+
+#ifndef HEADER_MOD_BACKEND_BENCH
+#define HEADER_MOD_BACKEND_BENCH
+
+/* Defines: benchmark params (each message is echoed back with the "\n\rReceived: " prefix) */
+#define BACKEND_BENCH_MSGS                 2000
+#define BACKEND_BENCH_MSG_SIZE             256
+#define BACKEND_BENCH_ECHO_PREFIX_SIZE     12
+#define BACKEND_BENCH_START_DELAY_MS       3000
+#define BACKEND_BENCH_RECV_TIMEOUT_MS      2000
+
+#endif
+
+/* Prototypes */
+void backend_bench_init(void);
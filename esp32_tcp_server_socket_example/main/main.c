@@ -12,6 +12,7 @@
 #include "nvs_rw/nvs_rw.h"
 #include "wifi_st/wifi_st.h"
 #include "breathing_light/breathing_light.h"
+#include "request_trace/request_trace.h"
 
 /* Define - debug */
 #define APP_MAIN_DEBUG_TAG      "APP_MAIN"
@@ -22,6 +23,9 @@
 void app_main(void)
 {
     esp_task_wdt_init(WDT_TIME_PROJECT, true);
+
+    /* Request trace first, so NVS and wi-fi startup are traced too */
+    request_trace_init();
     
     /* Init all modules (NVS, breathng light and wi-fi station) */
     init_nvs();
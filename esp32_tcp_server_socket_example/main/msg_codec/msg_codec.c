@@ -0,0 +1,190 @@
+/* Module: message codec runtime (used by code generated from messages.schema)
+ *
+ * Field encodings: u8/u16/u32 fixed-width little endian, varint (LEB128),
+ * svarint (zigzag + LEB128), bytes/string (varint length + data).
+ * No heap; every access is bounds checked against the cursor size.
+ * This module doesn't depend on ESP-IDF, so it also builds on a host.
+ */
+
+/* Includes */
+#include <string.h>
+#include "msg_codec.h"
+
+/* Function: number of bytes of a varint
+ * Params: value
+ * Return: encoded size
+ */
+size_t msg_codec_varint_size(uint32_t value)
+{
+    size_t size = 1;
+
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        size++;
+    }
+
+    return size;
+}
+
+/* Function: writers (encode fields)
+ * Params: writer and value
+ * Return: none (writer error flag is set if buffer is too small)
+ */
+void msg_codec_put_bytes(msg_codec_writer_t *pt_wr, const void *pt_data, size_t len)
+{
+    if ((pt_wr->error == true) || (len > (pt_wr->size - pt_wr->pos)))
+    {
+        pt_wr->error = true;
+        return;
+    }
+
+    memcpy(&pt_wr->pt_buf[pt_wr->pos], pt_data, len);
+    pt_wr->pos += len;
+}
+
+void msg_codec_put_u8(msg_codec_writer_t *pt_wr, uint8_t value)
+{
+    if ((pt_wr->error == true) || (pt_wr->pos >= pt_wr->size))
+    {
+        pt_wr->error = true;
+        return;
+    }
+
+    pt_wr->pt_buf[pt_wr->pos++] = value;
+}
+
+void msg_codec_put_u16(msg_codec_writer_t *pt_wr, uint16_t value)
+{
+    msg_codec_put_u8(pt_wr, (uint8_t)value);
+    msg_codec_put_u8(pt_wr, (uint8_t)(value >> 8));
+}
+
+void msg_codec_put_u32(msg_codec_writer_t *pt_wr, uint32_t value)
+{
+    msg_codec_put_u16(pt_wr, (uint16_t)value);
+    msg_codec_put_u16(pt_wr, (uint16_t)(value >> 16));
+}
+
+void msg_codec_put_varint(msg_codec_writer_t *pt_wr, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        msg_codec_put_u8(pt_wr, (uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+
+    msg_codec_put_u8(pt_wr, (uint8_t)value);
+}
+
+void msg_codec_put_svarint(msg_codec_writer_t *pt_wr, int32_t value)
+{
+    msg_codec_put_varint(pt_wr, ((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+}
+
+/* Function: readers (decode fields)
+ * Params: reader
+ * Return: value (0 and reader error flag set if data is missing)
+ */
+void msg_codec_get_bytes(msg_codec_reader_t *pt_rd, void *pt_data, size_t len)
+{
+    if ((pt_rd->error == true) || (len > (pt_rd->size - pt_rd->pos)))
+    {
+        pt_rd->error = true;
+        return;
+    }
+
+    memcpy(pt_data, &pt_rd->pt_buf[pt_rd->pos], len);
+    pt_rd->pos += len;
+}
+
+uint8_t msg_codec_get_u8(msg_codec_reader_t *pt_rd)
+{
+    if ((pt_rd->error == true) || (pt_rd->pos >= pt_rd->size))
+    {
+        pt_rd->error = true;
+        return 0;
+    }
+
+    return pt_rd->pt_buf[pt_rd->pos++];
+}
+
+uint16_t msg_codec_get_u16(msg_codec_reader_t *pt_rd)
+{
+    uint16_t value = msg_codec_get_u8(pt_rd);
+
+    return value | (uint16_t)((uint16_t)msg_codec_get_u8(pt_rd) << 8);
+}
+
+uint32_t msg_codec_get_u32(msg_codec_reader_t *pt_rd)
+{
+    uint32_t value = msg_codec_get_u16(pt_rd);
+
+    return value | ((uint32_t)msg_codec_get_u16(pt_rd) << 16);
+}
+
+uint32_t msg_codec_get_varint(msg_codec_reader_t *pt_rd)
+{
+    uint32_t value = 0;
+    uint8_t byte;
+    int shift;
+
+    for (shift = 0; shift < (7 * MSG_CODEC_VARINT_MAX_SIZE); shift += 7)
+    {
+        byte = msg_codec_get_u8(pt_rd);
+
+        /* Last byte: only its 4 low bits fit in 32 bits */
+        if ((shift == 28) && ((byte & 0x70) != 0))
+        {
+            break;
+        }
+
+        value |= (uint32_t)(byte & 0x7F) << shift;
+
+        if ((byte & 0x80) == 0)
+        {
+            return value;
+        }
+    }
+
+    /* Varint longer than 32 bits */
+    pt_rd->error = true;
+    return 0;
+}
+
+int32_t msg_codec_get_svarint(msg_codec_reader_t *pt_rd)
+{
+    uint32_t value = msg_codec_get_varint(pt_rd);
+
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+/* Function: parse a frame header
+ * Params: buffer, number of bytes in buffer, message id, payload and payload length (outputs)
+ * Return: >0: size of the complete frame at the beginning of buffer
+ *         0: frame is incomplete
+ *         -1: invalid frame
+ */
+int msg_codec_frame_parse(const uint8_t *pt_buf, size_t len, uint8_t *pt_id, const uint8_t **pt_payload, size_t *pt_payload_len)
+{
+    msg_codec_reader_t rd = { .pt_buf = pt_buf, .size = len, .pos = 0, .error = false };
+    uint32_t payload_len;
+
+    *pt_id = msg_codec_get_u8(&rd);
+    payload_len = msg_codec_get_varint(&rd);
+
+    if (rd.error == true)
+    {
+        /* Header incomplete, unless the varint is already too long */
+        return (len >= MSG_CODEC_FRAME_HEADER_MAX_SIZE) ? -1 : 0;
+    }
+
+    if (payload_len > (len - rd.pos))
+    {
+        return 0;
+    }
+
+    *pt_payload = &pt_buf[rd.pos];
+    *pt_payload_len = payload_len;
+    return (int)(rd.pos + payload_len);
+}
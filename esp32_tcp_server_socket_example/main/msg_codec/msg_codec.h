@@ -0,0 +1,47 @@
+/* Header file: message codec runtime (used by code generated from messages.schema) */
+
+#ifndef HEADER_MOD_MSG_CODEC
+#define HEADER_MOD_MSG_CODEC
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Defines: frame format = id (1 byte) | payload length (varint) | payload (fields in schema order) */
+#define MSG_CODEC_VARINT_MAX_SIZE          5
+#define MSG_CODEC_FRAME_HEADER_MAX_SIZE    (1 + MSG_CODEC_VARINT_MAX_SIZE)
+
+/* Encoder / decoder cursor. Any out of bounds access sets error and stops writing / reading */
+typedef struct
+{
+    uint8_t *pt_buf;
+    size_t size;
+    size_t pos;
+    bool error;
+} msg_codec_writer_t;
+
+typedef struct
+{
+    const uint8_t *pt_buf;
+    size_t size;
+    size_t pos;
+    bool error;
+} msg_codec_reader_t;
+
+#endif
+
+/* Prototypes */
+size_t msg_codec_varint_size(uint32_t value);
+void msg_codec_put_u8(msg_codec_writer_t *pt_wr, uint8_t value);
+void msg_codec_put_u16(msg_codec_writer_t *pt_wr, uint16_t value);
+void msg_codec_put_u32(msg_codec_writer_t *pt_wr, uint32_t value);
+void msg_codec_put_varint(msg_codec_writer_t *pt_wr, uint32_t value);
+void msg_codec_put_svarint(msg_codec_writer_t *pt_wr, int32_t value);
+void msg_codec_put_bytes(msg_codec_writer_t *pt_wr, const void *pt_data, size_t len);
+uint8_t msg_codec_get_u8(msg_codec_reader_t *pt_rd);
+uint16_t msg_codec_get_u16(msg_codec_reader_t *pt_rd);
+uint32_t msg_codec_get_u32(msg_codec_reader_t *pt_rd);
+uint32_t msg_codec_get_varint(msg_codec_reader_t *pt_rd);
+int32_t msg_codec_get_svarint(msg_codec_reader_t *pt_rd);
+void msg_codec_get_bytes(msg_codec_reader_t *pt_rd, void *pt_data, size_t len);
+int msg_codec_frame_parse(const uint8_t *pt_buf, size_t len, uint8_t *pt_id, const uint8_t **pt_payload, size_t *pt_payload_len);
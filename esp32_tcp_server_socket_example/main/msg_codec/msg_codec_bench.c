@@ -0,0 +1,114 @@
+/* Module: message codec benchmark (generated codec vs sprintf text formatting) */
+
+/* Includes */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <esp_task_wdt.h>
+#include "msg_codec_gen.h"
+#include "msg_codec_bench.h"
+
+/* Defines - debug */
+#define MSG_CODEC_BENCH_TAG                "MSG_CODEC_BENCH"
+
+/* Static variables (kept out of the task stack) */
+static msg_echo_request_t bench_request;
+static msg_echo_response_t bench_response;
+static char bench_text[MSG_CODEC_BENCH_PAYLOAD_SIZE + 64];
+static uint8_t bench_frame[MSG_CODEC_MAX_FRAME_SIZE];
+static volatile uint32_t bench_sink = 0;
+
+/* Local functions */
+static void log_result(const char *pt_name, int64_t elapsed_us);
+
+/* Function: run benchmark and log ns per message for each path
+ * Params: none
+ * Return: none
+ */
+void msg_codec_run_benchmark(void)
+{
+    char payload[MSG_CODEC_BENCH_PAYLOAD_SIZE + 1] = {0};
+    const uint8_t *pt_payload = NULL;
+    size_t payload_len = 0;
+    uint32_t seq = 0;
+    uint32_t uptime_ms = 0;
+    uint8_t id = 0;
+    size_t frame_size = 0;
+    int64_t start_us;
+    int i;
+
+    memset(payload, 'a', MSG_CODEC_BENCH_PAYLOAD_SIZE);
+    bench_response.payload_len = MSG_CODEC_BENCH_PAYLOAD_SIZE;
+    memcpy(bench_response.payload, payload, MSG_CODEC_BENCH_PAYLOAD_SIZE);
+
+    /* Current path: text formatting of the echo answer */
+    start_us = esp_timer_get_time();
+    for (i = 0; i < MSG_CODEC_BENCH_ITERATIONS; i++)
+    {
+        bench_sink += snprintf(bench_text, sizeof(bench_text), "\n\rReceived: %s", payload);
+    }
+    log_result("sprintf echo encode", esp_timer_get_time() - start_us);
+
+    /* Text path with the same fields the codec carries (seq and uptime) */
+    start_us = esp_timer_get_time();
+    for (i = 0; i < MSG_CODEC_BENCH_ITERATIONS; i++)
+    {
+        bench_sink += snprintf(bench_text, sizeof(bench_text), "%" PRIu32 ";%" PRIu32 ";%s", (uint32_t)i, (uint32_t)i * 10, payload);
+    }
+    log_result("sprintf fields encode", esp_timer_get_time() - start_us);
+
+    start_us = esp_timer_get_time();
+    for (i = 0; i < MSG_CODEC_BENCH_ITERATIONS; i++)
+    {
+        char *pt_end = NULL;
+        seq = strtoul(bench_text, &pt_end, 10);
+        uptime_ms = strtoul(pt_end + 1, &pt_end, 10);
+        bench_sink += seq + uptime_ms + strlen(pt_end + 1);
+    }
+    log_result("text fields decode", esp_timer_get_time() - start_us);
+
+    /* Generated codec */
+    start_us = esp_timer_get_time();
+    for (i = 0; i < MSG_CODEC_BENCH_ITERATIONS; i++)
+    {
+        bench_response.seq = i;
+        bench_response.uptime_ms = i * 10;
+        frame_size = msg_echo_response_encode(&bench_response, bench_frame, sizeof(bench_frame));
+        bench_sink += frame_size;
+    }
+    log_result("codec encode", esp_timer_get_time() - start_us);
+
+    bench_request.seq = 1;
+    bench_request.payload_len = MSG_CODEC_BENCH_PAYLOAD_SIZE;
+    memcpy(bench_request.payload, payload, MSG_CODEC_BENCH_PAYLOAD_SIZE);
+    frame_size = msg_echo_request_encode(&bench_request, bench_frame, sizeof(bench_frame));
+
+    start_us = esp_timer_get_time();
+    for (i = 0; i < MSG_CODEC_BENCH_ITERATIONS; i++)
+    {
+        if ((msg_codec_frame_parse(bench_frame, frame_size, &id, &pt_payload, &payload_len) > 0) &&
+            (msg_echo_request_decode(&bench_request, pt_payload, payload_len) == true))
+        {
+            bench_sink += bench_request.seq;
+        }
+    }
+    log_result("codec decode", esp_timer_get_time() - start_us);
+
+    ESP_LOGI(MSG_CODEC_BENCH_TAG, "(%d iterations, %d bytes payload)", MSG_CODEC_BENCH_ITERATIONS, MSG_CODEC_BENCH_PAYLOAD_SIZE);
+}
+
+/* Function: log one benchmark result
+ * Params: path name and total elapsed time
+ * Return: none
+ */
+static void log_result(const char *pt_name, int64_t elapsed_us)
+{
+    ESP_LOGI(MSG_CODEC_BENCH_TAG, "%-22s %" PRId64 " ns/msg", pt_name, (elapsed_us * 1000) / MSG_CODEC_BENCH_ITERATIONS);
+    esp_task_wdt_reset();
+}
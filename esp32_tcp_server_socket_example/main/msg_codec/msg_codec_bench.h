@@ -0,0 +1,13 @@
+/* Header file: message codec benchmark (generated codec vs sprintf text formatting) */
+
+#ifndef HEADER_MOD_MSG_CODEC_BENCH
+#define HEADER_MOD_MSG_CODEC_BENCH
+
+/* Defines: benchmark params */
+#define MSG_CODEC_BENCH_ITERATIONS         2000
+#define MSG_CODEC_BENCH_PAYLOAD_SIZE       32
+
+#endif
+
+/* Prototypes */
+void msg_codec_run_benchmark(void);
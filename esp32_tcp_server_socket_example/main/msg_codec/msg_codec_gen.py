@@ -0,0 +1,373 @@
+#!/usr/bin/env python
+#
+# Message codec generator: reads messages.schema and generates
+#   msg_codec_gen.h / msg_codec_gen.c: C encode/decode functions (fixed-size structs, no heap)
+#   msg_codec_gen.py: matching host-side (python) encoder/decoder
+#
+# Usage: msg_codec_gen.py <schema file> <output directory>
+
+from __future__ import print_function
+
+import os
+import sys
+
+FIXED_TYPES = {
+    'u8': ('uint8_t', 1),
+    'u16': ('uint16_t', 2),
+    'u32': ('uint32_t', 4),
+}
+VARINT_TYPES = {
+    'varint': 'uint32_t',
+    'svarint': 'int32_t',
+}
+ARRAY_TYPES = ('bytes', 'string')
+VARINT_MAX_SIZE = 5
+
+
+def fail(path, line_no, msg):
+    sys.exit('{}:{}: error: {}'.format(path, line_no, msg))
+
+
+def parse_schema(path):
+    messages = []
+    ids = set()
+
+    with open(path) as f:
+        for line_no, raw in enumerate(f, 1):
+            line = raw.split('#', 1)[0].rstrip()
+            if not line.strip():
+                continue
+
+            tokens = line.split()
+
+            if not raw[0].isspace():
+                if len(tokens) != 3 or tokens[0] != 'message':
+                    fail(path, line_no, 'expected "message <name> <id>"')
+                msg_id = int(tokens[2], 0)
+                if not 1 <= msg_id <= 255 or msg_id in ids:
+                    fail(path, line_no, 'message id must be unique and in 1..255')
+                ids.add(msg_id)
+                messages.append({'name': tokens[1], 'id': msg_id, 'fields': []})
+                continue
+
+            if not messages:
+                fail(path, line_no, 'field outside of a message')
+
+            name, ftype = tokens[0], tokens[1]
+            if ftype in ARRAY_TYPES:
+                if len(tokens) != 3 or not 1 <= int(tokens[2], 0) <= 65535:
+                    fail(path, line_no, '{} needs a max length (1..65535)'.format(ftype))
+                max_len = int(tokens[2], 0)
+            elif ftype in FIXED_TYPES or ftype in VARINT_TYPES:
+                if len(tokens) != 2:
+                    fail(path, line_no, 'unexpected tokens after type')
+                max_len = None
+            else:
+                fail(path, line_no, 'unknown type "{}"'.format(ftype))
+
+            messages[-1]['fields'].append({'name': name, 'type': ftype, 'max': max_len})
+
+    return messages
+
+
+def max_payload_size(msg):
+    size = 0
+    for fld in msg['fields']:
+        if fld['type'] in FIXED_TYPES:
+            size += FIXED_TYPES[fld['type']][1]
+        elif fld['type'] in VARINT_TYPES:
+            size += VARINT_MAX_SIZE
+        else:
+            size += VARINT_MAX_SIZE + fld['max']
+    return size
+
+
+def gen_header(messages, schema_name):
+    out = []
+    out.append('/* Header file: message codec (generated from {} by msg_codec_gen.py - do not edit) */'.format(schema_name))
+    out.append('')
+    out.append('#ifndef HEADER_MOD_MSG_CODEC_GEN')
+    out.append('#define HEADER_MOD_MSG_CODEC_GEN')
+    out.append('')
+    out.append('#include <stdint.h>')
+    out.append('#include <stddef.h>')
+    out.append('#include <stdbool.h>')
+    out.append('#include "msg_codec.h"')
+    out.append('')
+    out.append('/* Defines: message ids */')
+    for msg in messages:
+        out.append('#define MSG_ID_{:<28}{}'.format(msg['name'].upper(), msg['id']))
+    out.append('')
+    out.append('/* Defines: maximum encoded frame sizes */')
+    biggest = 0
+    for msg in messages:
+        size = max_payload_size(msg)
+        biggest = max(biggest, size)
+        out.append('#define MSG_{:<32}(MSG_CODEC_FRAME_HEADER_MAX_SIZE + {})'.format(msg['name'].upper() + '_MAX_SIZE', size))
+    out.append('#define {:<36}(MSG_CODEC_FRAME_HEADER_MAX_SIZE + {})'.format('MSG_CODEC_MAX_FRAME_SIZE', biggest))
+    out.append('')
+
+    for msg in messages:
+        out.append('/* Message: {} */'.format(msg['name']))
+        out.append('typedef struct')
+        out.append('{')
+        for fld in msg['fields']:
+            if fld['type'] in FIXED_TYPES:
+                out.append('    {} {};'.format(FIXED_TYPES[fld['type']][0], fld['name']))
+            elif fld['type'] in VARINT_TYPES:
+                out.append('    {} {};'.format(VARINT_TYPES[fld['type']], fld['name']))
+            elif fld['type'] == 'bytes':
+                out.append('    uint16_t {}_len;'.format(fld['name']))
+                out.append('    uint8_t {}[{}];'.format(fld['name'], fld['max']))
+            else:
+                out.append('    char {}[{} + 1];'.format(fld['name'], fld['max']))
+        out.append('}} msg_{}_t;'.format(msg['name']))
+        out.append('')
+
+    out.append('#endif')
+    out.append('')
+    out.append('/* Prototypes */')
+    out.append('const char * msg_codec_name(uint8_t id);')
+    for msg in messages:
+        n = msg['name']
+        out.append('size_t msg_{0}_encode(const msg_{0}_t *pt_msg, uint8_t *pt_buf, size_t size);'.format(n))
+        out.append('bool msg_{0}_decode(msg_{0}_t *pt_msg, const uint8_t *pt_payload, size_t len);'.format(n))
+    out.append('')
+    return '\n'.join(out)
+
+
+def gen_source(messages, schema_name):
+    out = []
+    out.append('/* Module: message codec (generated from {} by msg_codec_gen.py - do not edit) */'.format(schema_name))
+    out.append('')
+    out.append('/* Includes */')
+    out.append('#include <string.h>')
+    out.append('#include "msg_codec_gen.h"')
+    out.append('')
+    out.append('/* Function: message name')
+    out.append(' * Params: message id')
+    out.append(' * Return: name (NULL if id is unknown)')
+    out.append(' */')
+    out.append('const char * msg_codec_name(uint8_t id)')
+    out.append('{')
+    out.append('    switch (id)')
+    out.append('    {')
+    for msg in messages:
+        out.append('        case MSG_ID_{}:'.format(msg['name'].upper()))
+        out.append('            return "{}";'.format(msg['name']))
+    out.append('        default:')
+    out.append('            return NULL;')
+    out.append('    }')
+    out.append('}')
+
+    for msg in messages:
+        n = msg['name']
+        out.append('')
+        out.append('/* Function: encode {} frame'.format(n))
+        out.append(' * Params: message, output buffer and its size')
+        out.append(' * Return: frame size (0: buffer too small or field bigger than its max length)')
+        out.append(' */')
+        out.append('size_t msg_{0}_encode(const msg_{0}_t *pt_msg, uint8_t *pt_buf, size_t size)'.format(n))
+        out.append('{')
+        out.append('    msg_codec_writer_t wr = { .pt_buf = pt_buf, .size = size, .pos = 0, .error = false };')
+        out.append('    size_t payload_len = 0;')
+        for fld in msg['fields']:
+            if fld['type'] == 'string':
+                out.append('    size_t {0}_len = strnlen(pt_msg->{0}, {1});'.format(fld['name'], fld['max']))
+        out.append('')
+        for fld in msg['fields']:
+            if fld['type'] == 'bytes':
+                out.append('    if (pt_msg->{}_len > {})'.format(fld['name'], fld['max']))
+                out.append('    {')
+                out.append('        return 0;')
+                out.append('    }')
+                out.append('')
+        for fld in msg['fields']:
+            f, t = fld['name'], fld['type']
+            if t in FIXED_TYPES:
+                out.append('    payload_len += {};'.format(FIXED_TYPES[t][1]))
+            elif t == 'varint':
+                out.append('    payload_len += msg_codec_varint_size(pt_msg->{});'.format(f))
+            elif t == 'svarint':
+                out.append('    payload_len += msg_codec_varint_size(((uint32_t)pt_msg->{0} << 1) ^ (uint32_t)(pt_msg->{0} >> 31));'.format(f))
+            elif t == 'bytes':
+                out.append('    payload_len += msg_codec_varint_size(pt_msg->{0}_len) + pt_msg->{0}_len;'.format(f))
+            else:
+                out.append('    payload_len += msg_codec_varint_size({0}_len) + {0}_len;'.format(f))
+        out.append('')
+        out.append('    msg_codec_put_u8(&wr, MSG_ID_{});'.format(n.upper()))
+        out.append('    msg_codec_put_varint(&wr, payload_len);')
+        for fld in msg['fields']:
+            f, t = fld['name'], fld['type']
+            if t in FIXED_TYPES or t in VARINT_TYPES:
+                out.append('    msg_codec_put_{}(&wr, pt_msg->{});'.format(t, f))
+            elif t == 'bytes':
+                out.append('    msg_codec_put_varint(&wr, pt_msg->{}_len);'.format(f))
+                out.append('    msg_codec_put_bytes(&wr, pt_msg->{0}, pt_msg->{0}_len);'.format(f))
+            else:
+                out.append('    msg_codec_put_varint(&wr, {}_len);'.format(f))
+                out.append('    msg_codec_put_bytes(&wr, pt_msg->{0}, {0}_len);'.format(f))
+        out.append('')
+        out.append('    return (wr.error == true) ? 0 : wr.pos;')
+        out.append('}')
+        out.append('')
+        out.append('/* Function: decode {} payload (trailing fields unknown to this schema are ignored)'.format(n))
+        out.append(' * Params: message (output), payload and payload length')
+        out.append(' * Return: true: success')
+        out.append(' *         false: payload truncated or field bigger than its max length')
+        out.append(' */')
+        out.append('bool msg_{0}_decode(msg_{0}_t *pt_msg, const uint8_t *pt_payload, size_t len)'.format(n))
+        out.append('{')
+        out.append('    msg_codec_reader_t rd = { .pt_buf = pt_payload, .size = len, .pos = 0, .error = false };')
+        if any(fld['type'] in ARRAY_TYPES for fld in msg['fields']):
+            out.append('    uint32_t field_len = 0;')
+        out.append('')
+        for fld in msg['fields']:
+            f, t = fld['name'], fld['type']
+            if t in FIXED_TYPES or t in VARINT_TYPES:
+                out.append('    pt_msg->{} = msg_codec_get_{}(&rd);'.format(f, t))
+            else:
+                out.append('    field_len = msg_codec_get_varint(&rd);')
+                out.append('    if (field_len > {})'.format(fld['max']))
+                out.append('    {')
+                out.append('        return false;')
+                out.append('    }')
+                if t == 'bytes':
+                    out.append('    pt_msg->{}_len = (uint16_t)field_len;'.format(f))
+                    out.append('    msg_codec_get_bytes(&rd, pt_msg->{}, field_len);'.format(f))
+                else:
+                    out.append('    msg_codec_get_bytes(&rd, pt_msg->{}, field_len);'.format(f))
+                    out.append('    pt_msg->{}[(rd.error == true) ? 0 : field_len] = 0;'.format(f))
+        out.append('')
+        out.append('    return (rd.error == false);')
+        out.append('}')
+
+    out.append('')
+    return '\n'.join(out)
+
+
+PY_RUNTIME = '''
+import struct
+
+
+def _put_varint(value):
+    out = bytearray()
+    while value >= 0x80:
+        out.append((value & 0x7F) | 0x80)
+        value >>= 7
+    out.append(value)
+    return bytes(out)
+
+
+def _get_varint(buf, pos):
+    value = 0
+    for shift in range(0, 35, 7):
+        if pos >= len(buf):
+            raise ValueError('truncated varint')
+        byte = buf[pos]
+        pos += 1
+        if shift == 28 and byte & 0x70:
+            break
+        value |= (byte & 0x7F) << shift
+        if not byte & 0x80:
+            return value, pos
+    raise ValueError('varint too long')
+
+
+_FIXED = {'u8': '<B', 'u16': '<H', 'u32': '<I'}
+
+
+def encode(name, **fields):
+    """Encode a frame. bytes fields take bytes, string fields take str."""
+    msg_id, spec = BY_NAME[name]
+    payload = bytearray()
+    for fname, ftype, fmax in spec:
+        value = fields.get(fname, b'' if ftype in ('bytes', 'string') else 0)
+        if ftype in _FIXED:
+            payload += struct.pack(_FIXED[ftype], value)
+        elif ftype == 'varint':
+            payload += _put_varint(value)
+        elif ftype == 'svarint':
+            payload += _put_varint(((value << 1) ^ (value >> 31)) & 0xFFFFFFFF)
+        else:
+            data = value.encode() if ftype == 'string' else bytes(value)
+            if len(data) > fmax:
+                raise ValueError('{}.{} longer than {}'.format(name, fname, fmax))
+            payload += _put_varint(len(data)) + data
+    return bytes(bytearray([msg_id])) + _put_varint(len(payload)) + bytes(payload)
+
+
+def decode_frame(buf):
+    """Decode the frame at the beginning of buf.
+    Returns (name, fields, frame size), or None if the frame is incomplete."""
+    buf = bytearray(buf)
+    if len(buf) < 2:
+        return None
+    try:
+        payload_len, pos = _get_varint(buf, 1)
+    except ValueError:
+        if len(buf) >= 6:
+            raise
+        return None
+    if len(buf) < pos + payload_len:
+        return None
+    name, spec = MESSAGES[buf[0]]
+    end = pos + payload_len
+    fields = {}
+    for fname, ftype, fmax in spec:
+        if ftype in _FIXED:
+            size = struct.calcsize(_FIXED[ftype])
+            if pos + size > end:
+                raise ValueError('truncated field {}.{}'.format(name, fname))
+            fields[fname] = struct.unpack_from(_FIXED[ftype], bytes(buf), pos)[0]
+            pos += size
+        elif ftype in ('varint', 'svarint'):
+            value, pos = _get_varint(buf[:end], pos)
+            fields[fname] = value if ftype == 'varint' else (value >> 1) ^ -(value & 1)
+        else:
+            size, pos = _get_varint(buf[:end], pos)
+            if size > fmax or pos + size > end:
+                raise ValueError('invalid length for {}.{}'.format(name, fname))
+            data = bytes(buf[pos:pos + size])
+            fields[fname] = data.decode(errors='replace') if ftype == 'string' else data
+            pos += size
+    return name, fields, end
+'''
+
+
+def gen_python(messages, schema_name):
+    out = []
+    out.append('# Message codec - host side (generated from {} by msg_codec_gen.py - do not edit)'.format(schema_name))
+    out.append('')
+    out.append('MESSAGES = {')
+    for msg in messages:
+        spec = ', '.join("('{}', '{}', {})".format(f['name'], f['type'], f['max']) for f in msg['fields'])
+        out.append("    {}: ('{}', [{}]),".format(msg['id'], msg['name'], spec))
+    out.append('}')
+    out.append('BY_NAME = dict((name, (msg_id, spec)) for msg_id, (name, spec) in MESSAGES.items())')
+    return '\n'.join(out) + '\n' + PY_RUNTIME
+
+
+def write_file(path, content):
+    with open(path, 'w') as f:
+        f.write(content)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('usage: msg_codec_gen.py <schema file> <output directory>')
+
+    schema_path, out_dir = sys.argv[1], sys.argv[2]
+    messages = parse_schema(schema_path)
+    schema_name = os.path.basename(schema_path)
+
+    if not os.path.isdir(out_dir):
+        os.makedirs(out_dir)
+
+    write_file(os.path.join(out_dir, 'msg_codec_gen.h'), gen_header(messages, schema_name))
+    write_file(os.path.join(out_dir, 'msg_codec_gen.c'), gen_source(messages, schema_name))
+    write_file(os.path.join(out_dir, 'msg_codec_gen.py'), gen_python(messages, schema_name))
+
+
+if __name__ == '__main__':
+    main()
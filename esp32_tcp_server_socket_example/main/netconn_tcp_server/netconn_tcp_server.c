@@ -0,0 +1,595 @@
+/* Module: netconn tcp server (zero-copy lwIP backend) */
+
+/* Includes */
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "lwip/err.h"
+#include "lwip/api.h"
+#include "lwip/tcp.h"
+#include "lwip/pbuf.h"
+#include "lwip/ip_addr.h"
+#include "lwip/priv/tcpip_priv.h"
+#include <esp_task_wdt.h>
+
+/* Includes - modules */
+#include "../wifi_st/wifi_st.h"
+#include "../socket_tcp_server/socket_tcp_server.h"
+#include "netconn_tcp_server.h"
+
+/* Tasks parametrization */
+#include "../prio_tasks.h"
+#include "../stacks_sizes.h"
+
+/* Defines - task aguments and CPU */
+#define PARAMS_NETCONN_TCP_SERVER          NULL
+#define CPU_NETCONN_TCP_SERVER             1
+
+/* Defines - debug */
+#define NETCONN_TCP_SERVER_TAG             "NETCONN_TCP_SERVER"
+
+/* Defines - TCP sequence number comparison (wrap-around safe) */
+#define NETCONN_SEQ_GEQ(a, b)              ((int32_t)((uint32_t)(a) - (uint32_t)(b)) >= 0)
+
+/* Types - zero-copy TX slot. While in flight, lwIP references its data (NETCONN_NOCOPY),
+ * so it can only be reused once the client has acknowledged end_seq */
+typedef enum
+{
+    TX_SLOT_FREE = 0,
+    TX_SLOT_RESERVED,
+    TX_SLOT_IN_FLIGHT
+} netconn_tx_slot_state_t;
+
+typedef struct
+{
+    netconn_tx_slot_state_t state;
+    struct netbuf *rx_buf;
+    uint16_t rx_pbufs;
+    uint32_t end_seq;
+    uint8_t data[NETCONN_TCP_SERVER_TX_SLOT_SIZE];
+} netconn_tx_slot_t;
+
+/* Types - request executed in lwIP (tcpip) thread context */
+typedef enum
+{
+    NETCONN_PCB_OP_READ_SEQ = 0,
+    NETCONN_PCB_OP_OPTIONS,
+    NETCONN_PCB_OP_ABORT
+} netconn_pcb_op_t;
+
+typedef struct
+{
+    struct tcpip_api_call_data call;
+    struct netconn *conn;
+    netconn_pcb_op_t op;
+    uint32_t lastack;
+    uint32_t snd_lbb;
+} netconn_pcb_request_t;
+
+/* Static variables */
+static struct netconn *listen_conn = NULL;
+static char addr_str[IPADDR_STRLEN_MAX] = {0};
+static netconn_tx_slot_t tx_pool[NETCONN_TCP_SERVER_TX_POOL_SIZE];
+static netconn_tcp_server_handler_t rx_handler = NULL;
+static uint32_t held_pbufs = 0;
+
+/* Constant payloads - flash-resident, sent without copy */
+static const char netconn_echo_prefix[] = "\n\rReceived: ";
+
+/* Static variables - statistics */
+static tcp_server_copy_stats_t copy_stats = {0};
+static tcp_server_copy_stats_t copy_stats_last_report = {0};
+static TickType_t stats_last_report = 0;
+
+/* netconn task handler */
+TaskHandle_t netconn_task_handler;
+
+/* Tasks */
+static void netconn_tcp_server_task(void *arg);
+
+/* Local functions */
+static err_t netconn_pcb_request_fn(struct tcpip_api_call_data *call);
+static err_t netconn_pcb_request(struct netconn *conn, netconn_pcb_op_t op, netconn_pcb_request_t *pt_req);
+static void reclaim_tx_slots(struct netconn *conn);
+static void release_tx_slot(netconn_tx_slot_t *pt_slot);
+static void release_all_tx_slots(void);
+static netconn_tx_slot_t * acquire_tx_slot(struct netconn *conn, uint32_t wait_ms);
+static void commit_tx_slot(struct netconn *conn, netconn_tx_slot_t *pt_slot);
+static void close_client_netconn(struct netconn *conn);
+static void echo_handler_netconn_tcp_server(struct netconn *conn, struct netbuf *rx_buf);
+static void report_stats_netconn_tcp_server(void);
+
+/* Function: init netconn TCP server
+ * Params: none
+ * Return: none
+ */
+void netconn_tcp_server_init(void)
+{
+    if (rx_handler == NULL)
+    {
+        rx_handler = echo_handler_netconn_tcp_server;
+    }
+
+    xTaskCreatePinnedToCore(netconn_tcp_server_task, "netconn_tcp_server_task",
+                            SOCKET_TCP_TAM_TASK_STACK,
+                            PARAMS_NETCONN_TCP_SERVER,
+                            PRIO_TASK_SOCKET_TCP,
+                            &netconn_task_handler,
+                            CPU_NETCONN_TCP_SERVER);
+}
+
+/* Function: set the handler that receives incoming netbufs
+ * Params: handler (NULL restores the default echo handler)
+ * Return: none
+ */
+void netconn_tcp_server_set_handler(netconn_tcp_server_handler_t handler)
+{
+    rx_handler = (handler != NULL) ? handler : echo_handler_netconn_tcp_server;
+}
+
+/* Function: netconn TCP server task
+ * Params: task arguments
+ * Return: none
+ */
+static void netconn_tcp_server_task(void *arg)
+{
+    struct netconn *client_conn = NULL;
+    struct netbuf *rx_buf = NULL;
+    netconn_pcb_request_t req;
+    ip_addr_t client_addr;
+    u16_t client_port = 0;
+    err_t err;
+
+    esp_task_wdt_add(NULL);
+
+    /* Wait for wi-fi connection */
+    while (get_status_wifi() == false)
+    {
+        vTaskDelay(100 / portTICK_PERIOD_MS);
+    }
+
+    /* Create TCP netconn server */
+    listen_conn = netconn_new(NETCONN_TCP);
+    if (listen_conn == NULL)
+    {
+        ESP_LOGE(NETCONN_TCP_SERVER_TAG, "Error: impossible to create TCP netconn server");
+        vTaskDelete(netconn_task_handler);
+        return;
+    }
+
+    err = netconn_bind(listen_conn, IP_ADDR_ANY, NETCONN_TCP_SERVER_PORT);
+    if (err != ERR_OK)
+    {
+        ESP_LOGE(NETCONN_TCP_SERVER_TAG, "Error: impossible to bind TCP netconn server. Error code: %d", err);
+        terminate_netconn_tcp_server();
+    }
+
+    err = netconn_listen_with_backlog(listen_conn, 1);
+    if (err != ERR_OK)
+    {
+        ESP_LOGE(NETCONN_TCP_SERVER_TAG, "Error: impossible to enter in the listen state. Error code: %d", err);
+        terminate_netconn_tcp_server();
+    }
+
+    /* accept() and recv() block at most NETCONN_TCP_SERVER_TIMEOUT_MS, so WDT keeps being fed */
+    netconn_set_recvtimeout(listen_conn, NETCONN_TCP_SERVER_TIMEOUT_MS);
+
+    while (1)
+    {
+        esp_task_wdt_reset();
+        report_stats_netconn_tcp_server();
+
+        /* Proceed if a TCP client connects */
+        if (client_conn == NULL)
+        {
+            if (netconn_accept(listen_conn, &client_conn) != ERR_OK)
+            {
+                client_conn = NULL;
+                continue;
+            }
+
+            netconn_set_recvtimeout(client_conn, NETCONN_TCP_SERVER_TIMEOUT_MS);
+            netconn_pcb_request(client_conn, NETCONN_PCB_OP_OPTIONS, &req);
+
+            if (netconn_peer(client_conn, &client_addr, &client_port) == ERR_OK)
+            {
+                ipaddr_ntoa_r(&client_addr, addr_str, sizeof(addr_str));
+            }
+
+            ESP_LOGI(NETCONN_TCP_SERVER_TAG, "TCP netconn client IP: %s", addr_str);
+        }
+
+        /* Hand received pbuf chains straight to the handler */
+        err = netconn_recv(client_conn, &rx_buf);
+
+        if (err == ERR_OK)
+        {
+            copy_stats.msgs++;
+            copy_stats.rx_bytes += netbuf_len(rx_buf);
+            ESP_LOGI(NETCONN_TCP_SERVER_TAG, "%d bytes received from TCP netconn client", netbuf_len(rx_buf));
+            rx_handler(client_conn, rx_buf);
+        }
+        else if (err == ERR_TIMEOUT)
+        {
+            reclaim_tx_slots(client_conn);
+        }
+        else
+        {
+            ESP_LOGI(NETCONN_TCP_SERVER_TAG, "TCP netconn client disconnected (%d)", err);
+            close_client_netconn(client_conn);
+            client_conn = NULL;
+        }
+    }
+}
+
+/* Function: default handler. Echoes received data back, prefix from flash and payload from the received pbufs (no copies)
+ * Params: client netconn and received netbuf
+ * Return: none
+ */
+static void echo_handler_netconn_tcp_server(struct netconn *conn, struct netbuf *rx_buf)
+{
+    netconn_tcp_server_send_const(conn, netconn_echo_prefix, sizeof(netconn_echo_prefix) - 1);
+    netconn_tcp_server_send_netbuf(conn, rx_buf);
+}
+
+/* Function: send constant data (flash-resident or otherwise never modified) without copying it
+ * Params: client netconn, data pointer and length
+ * Return: ERR_OK: success
+ *         !ERR_OK: fail
+ */
+err_t netconn_tcp_server_send_const(struct netconn *conn, const void *pt_data, size_t len)
+{
+    return netconn_write(conn, pt_data, len, NETCONN_NOCOPY);
+}
+
+/* Function: send a received netbuf without copying it. The netbuf is held in a TX slot
+ *           until the client acknowledges it, which keeps its wi-fi RX buffers in use. If
+ *           NETCONN_TCP_SERVER_MAX_HELD_PBUFS are already held or no slot is free, data is
+ *           copied instead (no wait), so a slow client can't starve wi-fi RX
+ * Params: client netconn and netbuf (ownership is transferred)
+ * Return: ERR_OK: success
+ *         !ERR_OK: fail
+ */
+err_t netconn_tcp_server_send_netbuf(struct netconn *conn, struct netbuf *rx_buf)
+{
+    uint16_t rx_pbufs = pbuf_clen(rx_buf->p);
+    netconn_tx_slot_t *pt_slot = NULL;
+    u8_t write_flags;
+    err_t err = ERR_OK;
+    void *pt_data;
+    u16_t len;
+
+    if ((held_pbufs + rx_pbufs) <= NETCONN_TCP_SERVER_MAX_HELD_PBUFS)
+    {
+        reclaim_tx_slots(conn);
+        pt_slot = acquire_tx_slot(conn, 0);
+    }
+
+    write_flags = (pt_slot != NULL) ? NETCONN_NOCOPY : NETCONN_COPY;
+
+    netbuf_first(rx_buf);
+    do
+    {
+        netbuf_data(rx_buf, &pt_data, &len);
+        err = netconn_write(conn, pt_data, len, write_flags);
+
+        if (pt_slot == NULL)
+        {
+            copy_stats.copied_bytes += len;
+        }
+    } while ((err == ERR_OK) && (netbuf_next(rx_buf) >= 0));
+
+    if (pt_slot == NULL)
+    {
+        netbuf_delete(rx_buf);
+        return err;
+    }
+
+    pt_slot->rx_buf = rx_buf;
+    pt_slot->rx_pbufs = rx_pbufs;
+    held_pbufs += rx_pbufs;
+    commit_tx_slot(conn, pt_slot);
+    return err;
+}
+
+/* Function: get a pool-owned TX buffer (NETCONN_TCP_SERVER_TX_SLOT_SIZE bytes) to build a response in
+ * Params: client netconn
+ * Return: buffer pointer, or NULL if every slot is still waiting for the client to acknowledge it
+ */
+uint8_t * netconn_tcp_server_tx_alloc(struct netconn *conn)
+{
+    netconn_tx_slot_t *pt_slot = acquire_tx_slot(conn, NETCONN_TCP_SERVER_TX_WAIT_MS);
+
+    return (pt_slot != NULL) ? pt_slot->data : NULL;
+}
+
+/* Function: send a buffer got from netconn_tcp_server_tx_alloc() without copying it
+ * Params: client netconn, buffer and length
+ * Return: ERR_OK: success
+ *         !ERR_OK: fail
+ */
+err_t netconn_tcp_server_tx_send(struct netconn *conn, uint8_t *pt_buf, size_t len)
+{
+    err_t err = ERR_ARG;
+    int i;
+
+    for (i = 0; i < NETCONN_TCP_SERVER_TX_POOL_SIZE; i++)
+    {
+        if ((tx_pool[i].data == pt_buf) && (tx_pool[i].state == TX_SLOT_RESERVED))
+        {
+            err = netconn_write(conn, pt_buf, len, NETCONN_NOCOPY);
+
+            /* Write failed: lwIP doesn't reference the buffer (nothing queued, or connection gone
+             * and its segments freed), so the slot is free again instead of waiting for an ACK */
+            if (err == ERR_OK)
+            {
+                commit_tx_slot(conn, &tx_pool[i]);
+            }
+            else
+            {
+                release_tx_slot(&tx_pool[i]);
+            }
+            break;
+        }
+    }
+
+    return err;
+}
+
+/* Function: lwIP thread side of netconn_pcb_request() (the pcb must only be touched from there)
+ * Params: request
+ * Return: ERR_OK: success
+ *         !ERR_OK: fail
+ */
+static err_t netconn_pcb_request_fn(struct tcpip_api_call_data *call)
+{
+    netconn_pcb_request_t *pt_req = (netconn_pcb_request_t *)call;
+    struct tcp_pcb *pcb = pt_req->conn->pcb.tcp;
+
+    if (pcb == NULL)
+    {
+        return ERR_CONN;
+    }
+
+    switch (pt_req->op)
+    {
+        case NETCONN_PCB_OP_READ_SEQ:
+            pt_req->lastack = pcb->lastack;
+            pt_req->snd_lbb = pcb->snd_lbb;
+            break;
+
+        case NETCONN_PCB_OP_OPTIONS:
+            /* Answers are written in parts (e.g. prefix from flash + payload), don't hold the last one back */
+            tcp_nagle_disable(pcb);
+            ip_set_option(pcb, SOF_KEEPALIVE);
+            pcb->keep_idle = WIFI_SOCKET_TCP_SERVER_KEEPALIVE_IDLE * 1000;
+            pcb->keep_intvl = WIFI_SOCKET_TCP_SERVER_KEEPALIVE_INTERVAL * 1000;
+            pcb->keep_cnt = WIFI_SOCKET_TCP_SERVER_KEEPALIVE_COUNT;
+            break;
+
+        case NETCONN_PCB_OP_ABORT:
+            tcp_abort(pcb);
+            break;
+    }
+
+    return ERR_OK;
+}
+
+/* Function: run an operation on the client tcp pcb, in lwIP thread context
+ * Params: client netconn, operation and request (also holds results)
+ * Return: ERR_OK: success
+ *         !ERR_OK: fail (ERR_CONN: connection is gone)
+ */
+static err_t netconn_pcb_request(struct netconn *conn, netconn_pcb_op_t op, netconn_pcb_request_t *pt_req)
+{
+    pt_req->conn = conn;
+    pt_req->op = op;
+    return tcpip_api_call(netconn_pcb_request_fn, &pt_req->call);
+}
+
+/* Function: free TX slots already acknowledged by the client
+ * Params: client netconn
+ * Return: none
+ */
+static void reclaim_tx_slots(struct netconn *conn)
+{
+    netconn_pcb_request_t req;
+    int i;
+
+    if (netconn_pcb_request(conn, NETCONN_PCB_OP_READ_SEQ, &req) != ERR_OK)
+    {
+        /* pcb is gone, so lwIP doesn't reference any slot anymore */
+        release_all_tx_slots();
+        return;
+    }
+
+    for (i = 0; i < NETCONN_TCP_SERVER_TX_POOL_SIZE; i++)
+    {
+        if ((tx_pool[i].state == TX_SLOT_IN_FLIGHT) && NETCONN_SEQ_GEQ(req.lastack, tx_pool[i].end_seq))
+        {
+            release_tx_slot(&tx_pool[i]);
+        }
+    }
+}
+
+/* Function: free a TX slot (and the netbuf it holds). Only safe when lwIP doesn't reference it anymore
+ * Params: slot
+ * Return: none
+ */
+static void release_tx_slot(netconn_tx_slot_t *pt_slot)
+{
+    if (pt_slot->rx_buf != NULL)
+    {
+        netbuf_delete(pt_slot->rx_buf);
+        pt_slot->rx_buf = NULL;
+        held_pbufs -= pt_slot->rx_pbufs;
+        pt_slot->rx_pbufs = 0;
+    }
+
+    pt_slot->state = TX_SLOT_FREE;
+}
+
+/* Function: free all TX slots. Only safe when lwIP doesn't reference them anymore
+ * Params: none
+ * Return: none
+ */
+static void release_all_tx_slots(void)
+{
+    int i;
+
+    for (i = 0; i < NETCONN_TCP_SERVER_TX_POOL_SIZE; i++)
+    {
+        release_tx_slot(&tx_pool[i]);
+    }
+}
+
+/* Function: get a free TX slot, waiting for acknowledgements if needed
+ * Params: client netconn and max wait (ms, 0: don't wait)
+ * Return: slot pointer, or NULL if none got free
+ */
+static netconn_tx_slot_t * acquire_tx_slot(struct netconn *conn, uint32_t wait_ms)
+{
+    TickType_t start = xTaskGetTickCount();
+    int i;
+
+    while (1)
+    {
+        for (i = 0; i < NETCONN_TCP_SERVER_TX_POOL_SIZE; i++)
+        {
+            if (tx_pool[i].state == TX_SLOT_FREE)
+            {
+                tx_pool[i].state = TX_SLOT_RESERVED;
+                tx_pool[i].rx_buf = NULL;
+                tx_pool[i].rx_pbufs = 0;
+                return &tx_pool[i];
+            }
+        }
+
+        if (((xTaskGetTickCount() - start) * portTICK_PERIOD_MS) >= wait_ms)
+        {
+            if (wait_ms > 0)
+            {
+                ESP_LOGW(NETCONN_TCP_SERVER_TAG, "No zero-copy TX slot available");
+            }
+            return NULL;
+        }
+
+        vTaskDelay(NETCONN_TCP_SERVER_TIMEOUT_MS / portTICK_PERIOD_MS);
+        reclaim_tx_slots(conn);
+    }
+}
+
+/* Function: mark a TX slot as in flight, up to the last byte queued so far
+ * Params: client netconn and slot
+ * Return: none
+ */
+static void commit_tx_slot(struct netconn *conn, netconn_tx_slot_t *pt_slot)
+{
+    netconn_pcb_request_t req;
+
+    if (netconn_pcb_request(conn, NETCONN_PCB_OP_READ_SEQ, &req) != ERR_OK)
+    {
+        release_all_tx_slots();
+        return;
+    }
+
+    pt_slot->end_seq = req.snd_lbb;
+    pt_slot->state = TX_SLOT_IN_FLIGHT;
+}
+
+/* Function: close client connection. In-flight slots are drained first; if the client
+ *           doesn't acknowledge them in time, the connection is aborted so lwIP drops its references
+ * Params: client netconn
+ * Return: none
+ */
+static void close_client_netconn(struct netconn *conn)
+{
+    TickType_t start = xTaskGetTickCount();
+    netconn_pcb_request_t req;
+    bool in_flight = true;
+    int i;
+
+    while (in_flight == true)
+    {
+        reclaim_tx_slots(conn);
+        in_flight = false;
+
+        for (i = 0; i < NETCONN_TCP_SERVER_TX_POOL_SIZE; i++)
+        {
+            if (tx_pool[i].state != TX_SLOT_FREE)
+            {
+                in_flight = true;
+            }
+        }
+
+        if ((in_flight == true) &&
+            (((xTaskGetTickCount() - start) * portTICK_PERIOD_MS) >= NETCONN_TCP_SERVER_DRAIN_TIMEOUT_MS))
+        {
+            ESP_LOGW(NETCONN_TCP_SERVER_TAG, "TX slots not acknowledged. Aborting connection...");
+            netconn_pcb_request(conn, NETCONN_PCB_OP_ABORT, &req);
+            break;
+        }
+
+        if (in_flight == true)
+        {
+            esp_task_wdt_reset();
+            vTaskDelay(NETCONN_TCP_SERVER_TIMEOUT_MS / portTICK_PERIOD_MS);
+        }
+    }
+
+    release_all_tx_slots();
+    netconn_close(conn);
+    netconn_delete(conn);
+}
+
+/* Function: log netconn TCP server statistics (bytes copied per message and throughput)
+ * Params: none
+ * Return: none
+ */
+static void report_stats_netconn_tcp_server(void)
+{
+    TickType_t now = xTaskGetTickCount();
+    uint32_t elapsed_ms = (now - stats_last_report) * portTICK_PERIOD_MS;
+    uint32_t msgs = copy_stats.msgs - copy_stats_last_report.msgs;
+
+    if (elapsed_ms < WIFI_SOCKET_TCP_SERVER_STATS_PERIOD_MS)
+    {
+        return;
+    }
+
+    if (msgs > 0)
+    {
+        ESP_LOGI(NETCONN_TCP_SERVER_TAG, "Stats (netconn): %" PRIu32 " msgs, %" PRIu32 " bytes received, %" PRIu32 " bytes copied per msg, %" PRIu32 " bytes/s, %" PRIu32 " pbufs held",
+                 msgs, copy_stats.rx_bytes - copy_stats_last_report.rx_bytes,
+                 (copy_stats.copied_bytes - copy_stats_last_report.copied_bytes) / msgs,
+                 (uint32_t)(((uint64_t)(copy_stats.rx_bytes - copy_stats_last_report.rx_bytes) * 1000) / elapsed_ms), held_pbufs);
+    }
+
+    copy_stats_last_report = copy_stats;
+    stats_last_report = now;
+}
+
+/* Function: get copy statistics since boot
+ * Params: statistics (output)
+ * Return: none
+ */
+void netconn_tcp_server_get_copy_stats(tcp_server_copy_stats_t *pt_stats)
+{
+    *pt_stats = copy_stats;
+}
+
+/* Function: terminate netconn TCP server
+ * Params: none
+ * Return: none
+ */
+void terminate_netconn_tcp_server(void)
+{
+    netconn_close(listen_conn);
+    netconn_delete(listen_conn);
+    vTaskDelete(netconn_task_handler);
+}
@@ -0,0 +1,54 @@
+/* Header file: netconn tcp server (zero-copy lwIP backend) */
+
+#ifndef HEADER_MOD_NETCONN_TCP_SERVER
+#define HEADER_MOD_NETCONN_TCP_SERVER
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+#include "lwip/api.h"
+#include "../socket_tcp_server/socket_tcp_server.h"
+
+/* Defines: netconn TCP server params (port and keep-alive are shared with the sockets backend) */
+#define NETCONN_TCP_SERVER_TIMEOUT_MS               10
+#define NETCONN_TCP_SERVER_TX_SLOT_SIZE             1024
+#define NETCONN_TCP_SERVER_TX_WAIT_MS               200
+#define NETCONN_TCP_SERVER_DRAIN_TIMEOUT_MS         2000
+
+/* Defines: port (with the backend benchmark, both backends run and netconn gets its own port) */
+#if CONFIG_TCP_SERVER_BACKEND_BENCHMARK
+#define NETCONN_TCP_SERVER_PORT                     5010
+#else
+#define NETCONN_TCP_SERVER_PORT                     WIFI_PORT_SOCKET_TCP_SERVER
+#endif
+
+#ifdef CONFIG_TCP_SERVER_NETCONN_TX_POOL_SIZE
+#define NETCONN_TCP_SERVER_TX_POOL_SIZE             CONFIG_TCP_SERVER_NETCONN_TX_POOL_SIZE
+#else
+#define NETCONN_TCP_SERVER_TX_POOL_SIZE             4
+#endif
+
+/* Defines: received pbufs (wi-fi RX buffers) that may be held at once for zero-copy echo.
+ * Past the limit, received data is copied and its netbuf freed right away */
+#ifdef CONFIG_TCP_SERVER_NETCONN_MAX_HELD_PBUFS
+#define NETCONN_TCP_SERVER_MAX_HELD_PBUFS           CONFIG_TCP_SERVER_NETCONN_MAX_HELD_PBUFS
+#else
+#define NETCONN_TCP_SERVER_MAX_HELD_PBUFS           4
+#endif
+
+/* Handler: called for every received netbuf. The pbuf chain is not copied;
+ * the handler owns rx_buf and must either pass it to netconn_tcp_server_send_netbuf()
+ * or release it with netbuf_delete() */
+typedef void (*netconn_tcp_server_handler_t)(struct netconn *conn, struct netbuf *rx_buf);
+
+#endif
+
+/* Prototypes */
+void netconn_tcp_server_init(void);
+void netconn_tcp_server_set_handler(netconn_tcp_server_handler_t handler);
+err_t netconn_tcp_server_send_const(struct netconn *conn, const void *pt_data, size_t len);
+err_t netconn_tcp_server_send_netbuf(struct netconn *conn, struct netbuf *rx_buf);
+uint8_t * netconn_tcp_server_tx_alloc(struct netconn *conn);
+err_t netconn_tcp_server_tx_send(struct netconn *conn, uint8_t *pt_buf, size_t len);
+void netconn_tcp_server_get_copy_stats(tcp_server_copy_stats_t *pt_stats);
+void terminate_netconn_tcp_server(void);
@@ -13,6 +13,7 @@
 #include "freertos/semphr.h"
 #include "esp_log.h"
 #include "esp_err.h"
+#include "../request_trace/request_trace.h"
 
 /* Uncomment the line below to force NVS clean in case of error to inti NVS */
 #define FORCE_NVS_CLEAN_IN_CASE_OF_ERROR
@@ -54,6 +55,8 @@ esp_err_t store_string_nvs(char * pt_key, char * pt_string)
     esp_err_t ret = ESP_FAIL;
     nvs_handle handler_part_nvs;
 
+    REQUEST_TRACE_BEGIN(REQUEST_TRACE_NVS_WRITE);
+
     if (pt_key == NULL)
     {
         ESP_LOGE(NVS_TAG, "Error: key pointer is null");
@@ -93,6 +96,7 @@ esp_err_t store_string_nvs(char * pt_key, char * pt_string)
     }
 
 END_NVS_STORE:
+    REQUEST_TRACE_END(REQUEST_TRACE_NVS_WRITE);
     return ret;
 }
 
@@ -106,6 +110,8 @@ esp_err_t read_string_nvs(char * pt_key, char * pt_string, size_t tam_str)
     esp_err_t ret = ESP_FAIL;
     nvs_handle handler_part_nvs;
 
+    REQUEST_TRACE_BEGIN(REQUEST_TRACE_NVS_READ);
+
     if (pt_key == NULL)
     {
         ESP_LOGE(NVS_TAG, "Error: key pointer is null");
@@ -137,6 +143,7 @@ esp_err_t read_string_nvs(char * pt_key, char * pt_string, size_t tam_str)
     }
 
 END_READ_NVS_STRING:
+    REQUEST_TRACE_END(REQUEST_TRACE_NVS_READ);
     return ret;
 }
 
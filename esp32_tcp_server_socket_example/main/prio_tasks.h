@@ -5,5 +5,6 @@
 
 #define PRIO_TASK_BREATHING_LIGHT                              6
 #define PRIO_TASK_SOCKET_TCP                                   7
+#define PRIO_TASK_BACKEND_BENCH                                5
 
 #endif
\ No newline at end of file
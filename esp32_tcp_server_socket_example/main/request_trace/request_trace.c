@@ -0,0 +1,641 @@
+/* Module: request trace (cycle-accurate trace points with Chrome / Perfetto export)
+ *
+ * Each core appends events to its own ring: the append masks interrupts on that core
+ * only (the task switch hook runs from the scheduler), so cores never wait on each
+ * other. Events are timestamped with the CPU cycle counter (32 bits, extended with a
+ * per-core wrap count); at init, each core's counter is paired with esp_timer, which
+ * puts both cores on the same timeline in the export. Every record also checks the
+ * counter against esp_timer, so wraps are counted even after a core was idle (no
+ * events) for longer than a counter period (~17.9 s at 240 MHz).
+ *
+ * The export is a Chrome trace-event JSON file (opens in Perfetto / chrome://tracing):
+ * pid 0 shows which task ran on each core, pid 1 shows the traced stages of each task.
+ * The export is resumable (the caller keeps the position), so a slow client can download
+ * the file over several loop iterations; recording is paused until it's done.
+ *
+ * Without ESP_PLATFORM (host builds), a nanosecond clock stands in for the cycle
+ * counter and there is a single core, so benchmarks run on a host produce the same
+ * timeline format.
+ */
+
+/* Includes */
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include "request_trace.h"
+
+#if CONFIG_REQUEST_TRACE
+
+#ifdef ESP_PLATFORM
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_ipc.h"
+#include "esp_rom_sys.h"
+#include "hal/cpu_hal.h"
+#else
+#include <time.h>
+#endif
+
+/* Defines - debug */
+#define REQUEST_TRACE_TAG                  "REQUEST_TRACE"
+
+/* Defines - platform */
+#ifdef ESP_PLATFORM
+#define TRACE_CORES                        portNUM_PROCESSORS
+#define TRACE_CYCLES()                     cpu_hal_get_cycle_count()
+#define TRACE_CORE_ID()                    ((uint32_t)xPortGetCoreID())
+#define TRACE_CYCLES_PER_US()              esp_rom_get_cpu_ticks_per_us()
+#define TRACE_TIME_US()                    esp_timer_get_time()
+#define TRACE_IRQ_MASK()                   portSET_INTERRUPT_MASK_FROM_ISR()
+#define TRACE_IRQ_RESTORE(state)           portCLEAR_INTERRUPT_MASK_FROM_ISR(state)
+#define TRACE_LOG(fmt, ...)                ESP_LOGI(REQUEST_TRACE_TAG, fmt, ##__VA_ARGS__)
+typedef UBaseType_t trace_irq_state_t;
+#else
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define TRACE_CORES                        1
+#define TRACE_CYCLES()                     ((uint32_t)host_clock_ns())
+#define TRACE_CORE_ID()                    0u
+#define TRACE_CYCLES_PER_US()              1000u
+#define TRACE_TIME_US()                    ((int64_t)(host_clock_ns() / 1000))
+#define TRACE_IRQ_MASK()                   0
+#define TRACE_IRQ_RESTORE(state)           (void)(state)
+#define TRACE_LOG(fmt, ...)                printf(REQUEST_TRACE_TAG ": " fmt "\n", ##__VA_ARGS__)
+typedef int trace_irq_state_t;
+#endif
+
+/* Defines - export */
+#define TRACE_PID_CPU                      0
+#define TRACE_PID_REQUESTS                 1
+#define TRACE_TASK_UNKNOWN                 0
+#define TRACE_JSON_CHUNK_SIZE              512
+#define TRACE_JSON_LINE_SIZE               160
+#define TRACE_OVERHEAD_SAMPLES             256
+
+/* Defines - export stages */
+#define EXPORT_STAGE_METADATA              0
+#define EXPORT_STAGE_EVENTS                1
+#define EXPORT_STAGE_FOOTER                2
+#define EXPORT_STAGE_FLUSH                 3
+#define EXPORT_STAGE_DONE                  4
+
+/* Types - trace event (end timestamp; duration is only used by complete events) */
+typedef struct
+{
+    uint32_t cycles;
+    uint32_t duration;
+    uint32_t wraps;
+    uint8_t point;
+    uint8_t phase;
+    uint8_t task;
+} trace_event_t;
+
+/* Types - per-core ring */
+typedef struct
+{
+    trace_event_t events[REQUEST_TRACE_EVENTS_PER_CORE];
+    uint32_t head;
+    uint64_t last_cycles;
+    int64_t last_time_us;
+    uint8_t current_task;
+    uint32_t calib_cycles;
+    int64_t calib_time_us;
+} trace_ring_t;
+
+/* Types - task names (index 0 is "unknown") */
+typedef struct
+{
+    const void *pt_handle;
+    char name[REQUEST_TRACE_TASK_NAME_SIZE];
+} trace_task_t;
+
+/* Static variables */
+static DRAM_ATTR trace_ring_t rings[TRACE_CORES];
+static DRAM_ATTR trace_task_t tasks[REQUEST_TRACE_MAX_TASKS];
+static DRAM_ATTR uint32_t tasks_count = 1;
+static DRAM_ATTR volatile bool trace_enabled = false;
+static char json_chunk[TRACE_JSON_CHUNK_SIZE];
+static size_t json_chunk_fill = 0;
+static bool export_active = false;
+
+#ifdef ESP_PLATFORM
+static portMUX_TYPE tasks_lock = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+static const char *const point_names[REQUEST_TRACE_POINTS] =
+{
+    "accept", "recv", "handler", "send", "wifi_event", "nvs_read", "nvs_write", "task"
+};
+
+/* Local functions */
+static void record_event(uint8_t point, uint8_t phase, uint32_t duration);
+static void calibrate_core(void *arg);
+static uint64_t event_time_ns(const trace_ring_t *pt_ring, const trace_event_t *pt_event);
+static bool export_step(request_trace_export_t *pt_export, request_trace_write_cb_t cb, void *ctx);
+static bool export_event(request_trace_export_t *pt_export, request_trace_write_cb_t cb, void *ctx, const trace_event_t *pt_event, uint64_t ts_ns);
+static int metadata_line(uint32_t step, char *pt_line, size_t size);
+static bool json_write(request_trace_write_cb_t cb, void *ctx, const char *pt_text, size_t len);
+static bool json_flush(request_trace_write_cb_t cb, void *ctx);
+static bool json_slice(request_trace_write_cb_t cb, void *ctx, int pid, uint32_t tid, const char *pt_name, char phase,
+                       uint64_t ts_ns, uint64_t dur_ns);
+#ifndef ESP_PLATFORM
+static uint64_t host_clock_ns(void);
+#endif
+
+/* Function: init request trace (pairs every core's cycle counter with esp_timer and starts recording)
+ * Params: none
+ * Return: none
+ */
+void request_trace_init(void)
+{
+    uint32_t samples_cycles;
+    uint32_t core;
+    int i;
+
+    memset(rings, 0x00, sizeof(rings));
+    snprintf(tasks[TRACE_TASK_UNKNOWN].name, sizeof(tasks[TRACE_TASK_UNKNOWN].name), "%s", "unknown");
+
+    for (core = 0; core < TRACE_CORES; core++)
+    {
+#if defined(ESP_PLATFORM) && (portNUM_PROCESSORS > 1)
+        esp_ipc_call_blocking(core, calibrate_core, &rings[core]);
+#else
+        calibrate_core(&rings[core]);
+#endif
+    }
+
+    trace_enabled = true;
+
+    /* Overhead of a trace point (shown in the log to compare builds with and without request trace) */
+    samples_cycles = TRACE_CYCLES();
+    for (i = 0; i < TRACE_OVERHEAD_SAMPLES; i++)
+    {
+        record_event(REQUEST_TRACE_HANDLER, REQUEST_TRACE_PHASE_INSTANT, 0);
+    }
+    samples_cycles = TRACE_CYCLES() - samples_cycles;
+    request_trace_clear();
+
+    TRACE_LOG("Request trace: %d events per core, %" PRIu32 " cycles per trace point",
+              REQUEST_TRACE_EVENTS_PER_CORE, samples_cycles / TRACE_OVERHEAD_SAMPLES);
+}
+
+/* Function: record a trace point
+ * Params: trace point and phase (begin, end or instant)
+ * Return: none
+ */
+void IRAM_ATTR request_trace_event(request_trace_point_t point, char phase)
+{
+    record_event((uint8_t)point, (uint8_t)phase, 0);
+}
+
+/* Function: current value of the cycle counter (start of a complete event)
+ * Params: none
+ * Return: cycles
+ */
+uint32_t IRAM_ATTR request_trace_cycles(void)
+{
+    return TRACE_CYCLES();
+}
+
+/* Function: record a stage that started at start_cycles and ends now
+ * Params: trace point and start cycles (from request_trace_cycles)
+ * Return: none
+ */
+void IRAM_ATTR request_trace_complete(request_trace_point_t point, uint32_t start_cycles)
+{
+    record_event((uint8_t)point, REQUEST_TRACE_PHASE_COMPLETE, TRACE_CYCLES() - start_cycles);
+}
+
+/* Function: FreeRTOS task switch hook (traceTASK_SWITCHED_IN, see request_trace_hooks.h)
+ * Params: none
+ * Return: none
+ */
+void IRAM_ATTR request_trace_task_switched_in(void)
+{
+#ifdef ESP_PLATFORM
+    uint32_t core = TRACE_CORE_ID();
+    TaskHandle_t handle = xTaskGetCurrentTaskHandleForCPU(core);
+    uint32_t index;
+
+    if (trace_enabled == false)
+    {
+        return;
+    }
+
+    for (index = 1; index < tasks_count; index++)
+    {
+        if (tasks[index].pt_handle == handle)
+        {
+            break;
+        }
+    }
+
+    /* First time this task runs: copy its name (lookups above don't take the lock, so the handle is published last) */
+    if (index == tasks_count)
+    {
+        portENTER_CRITICAL_ISR(&tasks_lock);
+        index = TRACE_TASK_UNKNOWN;
+
+        if (tasks_count < REQUEST_TRACE_MAX_TASKS)
+        {
+            const char *pt_name = pcTaskGetName(handle);
+            size_t i;
+
+            index = tasks_count;
+            for (i = 0; (i < (REQUEST_TRACE_TASK_NAME_SIZE - 1)) && (pt_name[i] != '\0'); i++)
+            {
+                tasks[index].name[i] = ((pt_name[i] == '"') || (pt_name[i] == '\\')) ? '_' : pt_name[i];
+            }
+            tasks[index].name[i] = '\0';
+            tasks[index].pt_handle = handle;
+            tasks_count++;
+        }
+
+        portEXIT_CRITICAL_ISR(&tasks_lock);
+    }
+
+    rings[core].current_task = (uint8_t)index;
+    record_event(REQUEST_TRACE_TASK_SWITCH, REQUEST_TRACE_PHASE_BEGIN, 0);
+#endif
+}
+
+/* Function: discard recorded events
+ * Params: none
+ * Return: none
+ */
+void request_trace_clear(void)
+{
+    uint32_t core;
+
+    trace_enabled = false;
+
+    for (core = 0; core < TRACE_CORES; core++)
+    {
+        rings[core].head = 0;
+    }
+
+    trace_enabled = true;
+}
+
+/* Function: export recorded events as a Chrome trace-event JSON file. Recording is paused until the
+ *           export is done (or cancelled), so the file can be written over several calls
+ * Params: export position (zeroed to start an export), write callback and its context
+ * Return: true: file complete
+ *         false: write callback stopped the export (call again with the same position to continue it,
+ *                or request_trace_export_cancel)
+ */
+bool request_trace_export_json(request_trace_export_t *pt_export, request_trace_write_cb_t cb, void *ctx)
+{
+    if (export_active == false)
+    {
+        trace_enabled = false;
+        json_chunk_fill = 0;
+        export_active = true;
+    }
+
+    while (pt_export->stage != EXPORT_STAGE_DONE)
+    {
+        if (export_step(pt_export, cb, ctx) == false)
+        {
+            return false;
+        }
+    }
+
+    export_active = false;
+    trace_enabled = true;
+    return true;
+}
+
+/* Function: cancel an unfinished export (recording starts again)
+ * Params: none
+ * Return: none
+ */
+void request_trace_export_cancel(void)
+{
+    if (export_active == true)
+    {
+        json_chunk_fill = 0;
+        export_active = false;
+        trace_enabled = true;
+    }
+}
+
+/* Function: append an event to the ring of the current core
+ * Params: trace point, phase and duration (complete events)
+ * Return: none
+ */
+static void IRAM_ATTR record_event(uint8_t point, uint8_t phase, uint32_t duration)
+{
+    trace_irq_state_t irq_state;
+    trace_ring_t *pt_ring;
+    trace_event_t *pt_event;
+    uint64_t expected_cycles;
+    uint32_t cycles;
+    int64_t time_us;
+
+    if (trace_enabled == false)
+    {
+        return;
+    }
+
+    /* Core id, timestamp and slot must be taken without being preempted (or migrated) */
+    irq_state = TRACE_IRQ_MASK();
+    pt_ring = &rings[TRACE_CORE_ID()];
+    cycles = TRACE_CYCLES();
+    time_us = TRACE_TIME_US();
+
+    /* Counter wraps every 2^32 cycles, maybe several times between two events of an idle core.
+       esp_timer gives the expected 64-bit count; the counter corrects it (the estimate is off by
+       far less than half a counter period), so the upper bits count the wraps */
+    expected_cycles = pt_ring->last_cycles + ((uint64_t)(time_us - pt_ring->last_time_us) * TRACE_CYCLES_PER_US());
+    pt_ring->last_cycles = expected_cycles + (int32_t)(cycles - (uint32_t)expected_cycles);
+    pt_ring->last_time_us = time_us;
+
+    pt_event = &pt_ring->events[pt_ring->head % REQUEST_TRACE_EVENTS_PER_CORE];
+    pt_event->cycles = cycles;
+    pt_event->duration = duration;
+    pt_event->wraps = (uint32_t)(pt_ring->last_cycles >> 32);
+    pt_event->point = point;
+    pt_event->phase = phase;
+    pt_event->task = pt_ring->current_task;
+    pt_ring->head++;
+    TRACE_IRQ_RESTORE(irq_state);
+}
+
+/* Function: pair the cycle counter of the current core with esp_timer
+ * Params: ring of the current core
+ * Return: none
+ */
+static void calibrate_core(void *arg)
+{
+    trace_ring_t *pt_ring = (trace_ring_t *)arg;
+
+    pt_ring->calib_time_us = TRACE_TIME_US();
+    pt_ring->calib_cycles = TRACE_CYCLES();
+    pt_ring->last_cycles = pt_ring->calib_cycles;
+    pt_ring->last_time_us = pt_ring->calib_time_us;
+}
+
+/* Function: event timestamp on the common (esp_timer) timeline
+ * Params: ring and event
+ * Return: timestamp (ns)
+ */
+static uint64_t event_time_ns(const trace_ring_t *pt_ring, const trace_event_t *pt_event)
+{
+    uint64_t cycles = ((uint64_t)pt_event->wraps << 32) + pt_event->cycles - pt_ring->calib_cycles;
+
+    return ((uint64_t)pt_ring->calib_time_us * 1000) + ((cycles * 1000) / TRACE_CYCLES_PER_US());
+}
+
+/* Function: write the next part of the export (a metadata line or an event). Position only moves if it was written
+ * Params: export position, write callback and context
+ * Return: true: written
+ *         false: write callback stopped the export
+ */
+static bool export_step(request_trace_export_t *pt_export, request_trace_write_cb_t cb, void *ctx)
+{
+    const trace_ring_t *pt_ring;
+    const trace_event_t *pt_event;
+    char line[TRACE_JSON_LINE_SIZE];
+    uint32_t count;
+    uint64_t ts_ns;
+    int len;
+
+    switch (pt_export->stage)
+    {
+        case EXPORT_STAGE_METADATA:
+            len = metadata_line(pt_export->step, line, sizeof(line));
+
+            if (len == 0)
+            {
+                pt_export->stage = EXPORT_STAGE_EVENTS;
+                pt_export->core = 0;
+                pt_export->step = 0;
+                pt_export->pending = false;
+                return true;
+            }
+
+            if (json_write(cb, ctx, line, len) == false)
+            {
+                return false;
+            }
+
+            pt_export->step++;
+            return true;
+
+        case EXPORT_STAGE_EVENTS:
+            if (pt_export->core >= TRACE_CORES)
+            {
+                pt_export->stage = EXPORT_STAGE_FOOTER;
+                return true;
+            }
+
+            /* Events, oldest first on each core (viewers sort them by timestamp) */
+            pt_ring = &rings[pt_export->core];
+            count = (pt_ring->head < REQUEST_TRACE_EVENTS_PER_CORE) ? pt_ring->head : REQUEST_TRACE_EVENTS_PER_CORE;
+
+            if (pt_export->step == count)
+            {
+                /* Task still running at the last event of this core */
+                if ((pt_export->pending == true) &&
+                    (json_slice(cb, ctx, TRACE_PID_CPU, pt_export->core, tasks[pt_export->task].name, REQUEST_TRACE_PHASE_COMPLETE,
+                                pt_export->start_ns, pt_export->last_ts_ns - pt_export->start_ns) == false))
+                {
+                    return false;
+                }
+
+                pt_export->core++;
+                pt_export->step = 0;
+                pt_export->pending = false;
+                return true;
+            }
+
+            pt_event = &pt_ring->events[(pt_ring->head - count + pt_export->step) % REQUEST_TRACE_EVENTS_PER_CORE];
+            ts_ns = event_time_ns(pt_ring, pt_event);
+
+            if (export_event(pt_export, cb, ctx, pt_event, ts_ns) == false)
+            {
+                return false;
+            }
+
+            pt_export->last_ts_ns = ts_ns;
+            pt_export->step++;
+            return true;
+
+        case EXPORT_STAGE_FOOTER:
+            if (json_write(cb, ctx, "\n]}\n", 4) == false)
+            {
+                return false;
+            }
+
+            pt_export->stage = EXPORT_STAGE_FLUSH;
+            return true;
+
+        case EXPORT_STAGE_FLUSH:
+            if (json_flush(cb, ctx) == false)
+            {
+                return false;
+            }
+
+            pt_export->stage = EXPORT_STAGE_DONE;
+            return true;
+
+        default:
+            return true;
+    }
+}
+
+/* Function: write one recorded event
+ * Params: export position, write callback and context, event and its timestamp
+ * Return: true: written
+ *         false: write callback stopped the export
+ */
+static bool export_event(request_trace_export_t *pt_export, request_trace_write_cb_t cb, void *ctx, const trace_event_t *pt_event, uint64_t ts_ns)
+{
+    uint64_t dur_ns;
+
+    if (pt_event->point == REQUEST_TRACE_TASK_SWITCH)
+    {
+        /* A task runs on this core until the next switch */
+        if ((pt_export->pending == true) &&
+            (json_slice(cb, ctx, TRACE_PID_CPU, pt_export->core, tasks[pt_export->task].name, REQUEST_TRACE_PHASE_COMPLETE,
+                        pt_export->start_ns, ts_ns - pt_export->start_ns) == false))
+        {
+            return false;
+        }
+
+        pt_export->pending = true;
+        pt_export->start_ns = ts_ns;
+        pt_export->task = pt_event->task;
+        return true;
+    }
+
+    if (pt_event->phase == REQUEST_TRACE_PHASE_COMPLETE)
+    {
+        dur_ns = ((uint64_t)pt_event->duration * 1000) / TRACE_CYCLES_PER_US();
+        return json_slice(cb, ctx, TRACE_PID_REQUESTS, pt_event->task, point_names[pt_event->point],
+                          REQUEST_TRACE_PHASE_COMPLETE, ts_ns - dur_ns, dur_ns);
+    }
+
+    return json_slice(cb, ctx, TRACE_PID_REQUESTS, pt_event->task, point_names[pt_event->point], (char)pt_event->phase, ts_ns, 0);
+}
+
+/* Function: metadata line: process and thread names (one CPU track per core, one request track per task)
+ * Params: line number, output buffer and its size
+ * Return: line length (0: no more metadata)
+ */
+static int metadata_line(uint32_t step, char *pt_line, size_t size)
+{
+    if (step == 0)
+    {
+        return snprintf(pt_line, size, "{\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"CPU\"}}",
+                        TRACE_PID_CPU);
+    }
+
+    if (step == 1)
+    {
+        return snprintf(pt_line, size, ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"Requests\"}}",
+                        TRACE_PID_REQUESTS);
+    }
+
+    step -= 2;
+
+    if (step < TRACE_CORES)
+    {
+        return snprintf(pt_line, size, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%" PRIu32 ",\"args\":{\"name\":\"core %" PRIu32 "\"}}",
+                        TRACE_PID_CPU, step, step);
+    }
+
+    step -= TRACE_CORES;
+
+    if (step < tasks_count)
+    {
+        return snprintf(pt_line, size, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%" PRIu32 ",\"args\":{\"name\":\"%s\"}}",
+                        TRACE_PID_REQUESTS, step, tasks[step].name);
+    }
+
+    return 0;
+}
+
+/* Function: write one event
+ * Params: write callback and context, pid, tid, name, phase, timestamp and duration (complete events)
+ * Return: true: success
+ *         false: fail
+ */
+static bool json_slice(request_trace_write_cb_t cb, void *ctx, int pid, uint32_t tid, const char *pt_name, char phase,
+                       uint64_t ts_ns, uint64_t dur_ns)
+{
+    char line[TRACE_JSON_LINE_SIZE];
+    int len;
+
+    /* Timestamps are in us; 3 decimals keep the ns resolution of the cycle counter */
+    len = snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%" PRIu64 ".%03u,\"pid\":%d,\"tid\":%" PRIu32,
+                   pt_name, phase, ts_ns / 1000, (unsigned)(ts_ns % 1000), pid, tid);
+
+    if (phase == REQUEST_TRACE_PHASE_COMPLETE)
+    {
+        len += snprintf(&line[len], sizeof(line) - len, ",\"dur\":%" PRIu64 ".%03u", dur_ns / 1000, (unsigned)(dur_ns % 1000));
+    }
+    else if (phase == REQUEST_TRACE_PHASE_INSTANT)
+    {
+        len += snprintf(&line[len], sizeof(line) - len, ",\"s\":\"t\"");
+    }
+
+    len += snprintf(&line[len], sizeof(line) - len, "}");
+    return json_write(cb, ctx, line, len);
+}
+
+/* Function: append text to the output chunk (chunk is written when full)
+ * Params: write callback and context, text and length
+ * Return: true: success
+ *         false: write callback stopped the export (text isn't appended)
+ */
+static bool json_write(request_trace_write_cb_t cb, void *ctx, const char *pt_text, size_t len)
+{
+    if ((json_chunk_fill + len) > sizeof(json_chunk))
+    {
+        if (json_flush(cb, ctx) == false)
+        {
+            return false;
+        }
+    }
+
+    memcpy(&json_chunk[json_chunk_fill], pt_text, len);
+    json_chunk_fill += len;
+    return true;
+}
+
+/* Function: write the output chunk
+ * Params: write callback and context
+ * Return: true: success
+ *         false: write callback stopped the export (chunk is kept, to be written again)
+ */
+static bool json_flush(request_trace_write_cb_t cb, void *ctx)
+{
+    if ((json_chunk_fill > 0) && (cb(ctx, (const uint8_t *)json_chunk, json_chunk_fill) == false))
+    {
+        return false;
+    }
+
+    json_chunk_fill = 0;
+    return true;
+}
+
+#ifndef ESP_PLATFORM
+/* Function: host clock (stands in for the cycle counter)
+ * Params: none
+ * Return: monotonic time (ns)
+ */
+static uint64_t host_clock_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+#endif
@@ -0,0 +1,95 @@
+/* Header file: request trace (cycle-accurate trace points with Chrome / Perfetto export) */
+
+#ifndef HEADER_MOD_REQUEST_TRACE
+#define HEADER_MOD_REQUEST_TRACE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+
+/* Defines: events per core */
+#ifdef CONFIG_REQUEST_TRACE_EVENTS_PER_CORE
+#define REQUEST_TRACE_EVENTS_PER_CORE       CONFIG_REQUEST_TRACE_EVENTS_PER_CORE
+#else
+#define REQUEST_TRACE_EVENTS_PER_CORE       512
+#endif
+#define REQUEST_TRACE_CORES                 2
+#define REQUEST_TRACE_MAX_TASKS             16
+#define REQUEST_TRACE_TASK_NAME_SIZE        16
+
+/* Defines: commands received through the control port */
+#define REQUEST_TRACE_CMD_PREFIX            "trace"
+#define REQUEST_TRACE_CMD_DUMP              "trace dump"
+#define REQUEST_TRACE_CMD_CLEAR             "trace clear"
+
+/* Trace points */
+typedef enum
+{
+    REQUEST_TRACE_ACCEPT = 0,
+    REQUEST_TRACE_RECV,
+    REQUEST_TRACE_HANDLER,
+    REQUEST_TRACE_SEND,
+    REQUEST_TRACE_WIFI_EVENT,
+    REQUEST_TRACE_NVS_READ,
+    REQUEST_TRACE_NVS_WRITE,
+    REQUEST_TRACE_TASK_SWITCH,
+    REQUEST_TRACE_POINTS
+} request_trace_point_t;
+
+/* Event phases (Chrome trace-event "ph") */
+#define REQUEST_TRACE_PHASE_BEGIN           'B'
+#define REQUEST_TRACE_PHASE_END             'E'
+#define REQUEST_TRACE_PHASE_INSTANT         'i'
+#define REQUEST_TRACE_PHASE_COMPLETE        'X'
+
+/* Export callback: writes a chunk of the JSON trace. Returning false stops the export (it can be continued) */
+typedef bool (*request_trace_write_cb_t)(void *ctx, const uint8_t *pt_data, size_t len);
+
+/* Export position (zeroed to start an export) */
+typedef struct
+{
+    uint8_t stage;
+    uint8_t core;
+    uint32_t step;
+    bool pending;                   /* task switch slice waiting for the next switch */
+    uint8_t task;
+    uint64_t start_ns;
+    uint64_t last_ts_ns;
+} request_trace_export_t;
+
+#endif
+
+/* Prototypes and trace point macros. With request trace disabled in menuconfig, trace points compile to nothing */
+#if CONFIG_REQUEST_TRACE
+void request_trace_init(void);
+void request_trace_event(request_trace_point_t point, char phase);
+uint32_t request_trace_cycles(void);
+void request_trace_complete(request_trace_point_t point, uint32_t start_cycles);
+void request_trace_task_switched_in(void);
+void request_trace_clear(void);
+bool request_trace_export_json(request_trace_export_t *pt_export, request_trace_write_cb_t cb, void *ctx);
+void request_trace_export_cancel(void);
+
+#define REQUEST_TRACE_BEGIN(point)          request_trace_event((point), REQUEST_TRACE_PHASE_BEGIN)
+#define REQUEST_TRACE_END(point)            request_trace_event((point), REQUEST_TRACE_PHASE_END)
+#define REQUEST_TRACE_INSTANT(point)        request_trace_event((point), REQUEST_TRACE_PHASE_INSTANT)
+
+/* Polled stages (e.g. non-blocking recv) are only recorded when they did something:
+   REQUEST_TRACE_START declares the start timestamp, REQUEST_TRACE_COMPLETE records the slice */
+#define REQUEST_TRACE_START(start)          uint32_t start = request_trace_cycles()
+#define REQUEST_TRACE_COMPLETE(point, start) request_trace_complete((point), (start))
+#else
+#define request_trace_init()                do { } while (0)
+#define request_trace_clear()               do { } while (0)
+#define request_trace_export_json(pt_export, cb, ctx)   ((void)(pt_export), (void)(cb), (void)(ctx), false)
+#define request_trace_export_cancel()       do { } while (0)
+
+#define REQUEST_TRACE_BEGIN(point)          do { } while (0)
+#define REQUEST_TRACE_END(point)            do { } while (0)
+#define REQUEST_TRACE_INSTANT(point)        do { } while (0)
+#define REQUEST_TRACE_START(start)          do { } while (0)
+#define REQUEST_TRACE_COMPLETE(point, start) do { } while (0)
+#endif
@@ -0,0 +1,15 @@
+/* Header file: request trace FreeRTOS hooks
+ *
+ * Force-included (-include) into the freertos component by the project CMakeLists.txt
+ * when request trace is enabled, so the scheduler calls the trace module on every
+ * context switch. It's included before FreeRTOSConfig.h, so it can't include anything.
+ */
+
+#ifndef HEADER_MOD_REQUEST_TRACE_HOOKS
+#define HEADER_MOD_REQUEST_TRACE_HOOKS
+
+void request_trace_task_switched_in(void);
+
+#define traceTASK_SWITCHED_IN()             request_trace_task_switched_in()
+
+#endif
@@ -0,0 +1,690 @@
+/* Module: socket tcp server listeners
+ *
+ * Every listener of the TCP socket server is declared in the table below (port, connection
+ * limit, RX buffer class, socket options, priority and handler set). All of them are served
+ * by the same task and event loop (socket_tcp_server.c).
+ *
+ * - data: echo / resumable sessions / binary protocol (socket_tcp_server.c)
+ * - control: line commands ("ping", "metrics", "tslog ...", "capture ...", "trace ..."); small buffers, TCP_NODELAY, served first
+ * - bulk: discards everything it receives (upload throughput); large buffers, served last
+ */
+
+/* Includes */
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "socket_tcp_listeners.h"
+#include "../ts_log/ts_log.h"
+#include "../traffic_capture/traffic_capture.h"
+#include "../request_trace/request_trace.h"
+
+/* Defines - debug */
+#define SOCKET_TCP_LISTENERS_TAG           "SOCKET_TCP_LISTENERS"
+
+/* Defines - control port */
+#define CONTROL_MAX_CLIENTS                2
+#define CONTROL_ANSWER_SIZE                160
+#define CONTROL_QUERY_CHUNK_SIZE           512
+#define CONTROL_QUERY_LINE_SIZE            32          /* "timestamp,sensor_id,value\n" */
+
+/* Defines - answers streamed over several loop iterations */
+#if CONFIG_TS_LOG || CONFIG_TRAFFIC_CAPTURE || CONFIG_REQUEST_TRACE
+#define CONTROL_STREAMS                    1
+#endif
+
+#if CONTROL_STREAMS
+/* Types - answer being streamed to a control client (the connection isn't read until it's done) */
+typedef enum
+{
+    CONTROL_STREAM_TS_LOG = 0,                  /* "tslog query" CSV lines */
+    CONTROL_STREAM_CAPTURE,                     /* pcapng file */
+    CONTROL_STREAM_TRACE                        /* JSON trace */
+} control_stream_kind_t;
+
+typedef struct
+{
+    socket_tcp_conn_t *pt_conn;                 /* NULL: free */
+    control_stream_kind_t kind;
+    bool paused;
+    bool error;
+#if CONFIG_TS_LOG
+    ts_log_query_t cursor;
+    bool result;
+    size_t fill;
+    uint32_t count;
+#endif
+#if CONFIG_TRAFFIC_CAPTURE
+    uint32_t capture_block;
+#endif
+#if CONFIG_REQUEST_TRACE
+    request_trace_export_t trace_pos;
+#endif
+} control_stream_t;
+#endif
+
+/* Static variables */
+static char control_answer[CONTROL_ANSWER_SIZE] = {0};
+#if CONFIG_TS_LOG
+static char control_query_chunk[CONTROL_QUERY_CHUNK_SIZE] = {0};
+#endif
+#if CONTROL_STREAMS
+static control_stream_t control_streams[CONTROL_MAX_CLIENTS] = {0};
+#endif
+
+/* Local functions */
+static void log_accept(socket_tcp_conn_t *pt_conn);
+static void log_close(socket_tcp_conn_t *pt_conn, bool is_error);
+static bool control_on_data(socket_tcp_conn_t *pt_conn, size_t len);
+static bool control_command(socket_tcp_conn_t *pt_conn, const char *pt_line);
+static bool bulk_on_data(socket_tcp_conn_t *pt_conn, size_t len);
+#if CONTROL_STREAMS
+static bool control_on_writable(socket_tcp_conn_t *pt_conn);
+static void control_on_close(socket_tcp_conn_t *pt_conn, bool is_error);
+static control_stream_t * control_stream_find(const socket_tcp_conn_t *pt_conn);
+static control_stream_t * control_stream_start(socket_tcp_conn_t *pt_conn, control_stream_kind_t kind);
+static bool control_stream_continue(control_stream_t *pt_stream);
+#endif
+#if CONFIG_TS_LOG
+static bool control_ts_log(socket_tcp_conn_t *pt_conn, const char *pt_line);
+static bool control_query_continue(control_stream_t *pt_stream);
+static bool control_query_sample(void *ctx, const ts_log_sample_t *pt_sample);
+#endif
+#if CONFIG_TRAFFIC_CAPTURE
+static bool control_capture(socket_tcp_conn_t *pt_conn, const char *pt_line);
+#endif
+#if CONFIG_REQUEST_TRACE
+static bool control_trace(socket_tcp_conn_t *pt_conn, const char *pt_line);
+#endif
+#if CONFIG_TRAFFIC_CAPTURE || CONFIG_REQUEST_TRACE
+static bool control_stream_active(control_stream_kind_t kind);
+static bool control_export_write(void *ctx, const uint8_t *pt_data, size_t len);
+#endif
+
+/* Handler sets */
+static const socket_tcp_handlers_t control_handlers =
+{
+    .on_accept = log_accept,
+    .on_data = control_on_data,
+#if CONTROL_STREAMS
+    .on_writable = control_on_writable,
+    .on_close = control_on_close,
+#else
+    .on_close = log_close,
+#endif
+};
+
+static const socket_tcp_handlers_t bulk_handlers =
+{
+    .on_accept = log_accept,
+    .on_data = bulk_on_data,
+    .on_close = log_close,
+};
+
+/* Listeners */
+const socket_tcp_listener_t socket_tcp_listeners[] =
+{
+    {
+        .pt_name = "data",
+        .port = WIFI_PORT_SOCKET_TCP_SERVER,
+        .max_clients = 1,
+        .replace_oldest = true,             /* after a wi-fi drop the old connection may be dead without ever being closed */
+        .buffer_class = SOCKET_TCP_BUFFER_MEDIUM,
+        .priority = 1,
+        .no_delay = false,
+        .tos = SOCKET_TCP_LISTENER_TOS_DEFAULT,
+        .keepalive_idle = WIFI_SOCKET_TCP_SERVER_KEEPALIVE_IDLE,
+        .pt_handlers = &socket_tcp_data_handlers,
+    },
+#if CONFIG_TCP_SERVER_CONTROL_LISTENER
+    {
+        .pt_name = "control",
+        .port = CONFIG_TCP_SERVER_CONTROL_PORT,
+        .max_clients = CONTROL_MAX_CLIENTS,
+        .replace_oldest = false,
+        .buffer_class = SOCKET_TCP_BUFFER_SMALL,
+        .priority = 2,
+        .no_delay = true,
+        .tos = SOCKET_TCP_LISTENER_TOS_LOWDELAY,
+        .keepalive_idle = WIFI_SOCKET_TCP_SERVER_KEEPALIVE_IDLE,
+        .pt_handlers = &control_handlers,
+    },
+#endif
+#if CONFIG_TCP_SERVER_BULK_LISTENER
+    {
+        .pt_name = "bulk",
+        .port = CONFIG_TCP_SERVER_BULK_PORT,
+        .max_clients = CONFIG_TCP_SERVER_BULK_MAX_CLIENTS,
+        .replace_oldest = false,
+        .buffer_class = SOCKET_TCP_BUFFER_LARGE,
+        .priority = 0,
+        .no_delay = false,
+        .tos = SOCKET_TCP_LISTENER_TOS_THROUGHPUT,
+        .keepalive_idle = 0,
+        .pt_handlers = &bulk_handlers,
+    },
+#endif
+};
+
+const size_t socket_tcp_listeners_count = sizeof(socket_tcp_listeners) / sizeof(socket_tcp_listeners[0]);
+
+/* Function: log a new client (control and bulk listeners)
+ * Params: connection
+ * Return: none
+ */
+static void log_accept(socket_tcp_conn_t *pt_conn)
+{
+    ESP_LOGI(SOCKET_TCP_LISTENERS_TAG, "%s: client connected (port %" PRIu16 ")",
+             socket_tcp_listeners[pt_conn->listener_index].pt_name, pt_conn->peer_port);
+}
+
+/* Function: log a closed connection (control and bulk listeners)
+ * Params: connection and whether it was closed due to an error
+ * Return: none
+ */
+static void log_close(socket_tcp_conn_t *pt_conn, bool is_error)
+{
+    ESP_LOGI(SOCKET_TCP_LISTENERS_TAG, "%s: client disconnected%s",
+             socket_tcp_listeners[pt_conn->listener_index].pt_name, (is_error == true) ? " (error)" : "");
+}
+
+/* Function: control port data (commands are separated by new lines; the ones behind a streaming
+ *           answer are kept until it's done)
+ * Params: connection and number of bytes just received (0: handle commands kept in the buffer)
+ * Return: true: success
+ *         false: fail (connection must be closed)
+ */
+static bool control_on_data(socket_tcp_conn_t *pt_conn, size_t len)
+{
+    char *pt_rx = (char *)pt_conn->pt_rx_buffer;
+    char *pt_line = pt_rx;
+    char *pt_end = NULL;
+
+    pt_conn->rx_fill += len;
+    pt_rx[pt_conn->rx_fill] = '\0';
+
+    while ((pt_conn->tx_more == false) && ((pt_end = strchr(pt_line, '\n')) != NULL))
+    {
+        *pt_end = '\0';
+
+        if ((pt_end > pt_line) && (pt_end[-1] == '\r'))
+        {
+            pt_end[-1] = '\0';
+        }
+
+        if (control_command(pt_conn, pt_line) == false)
+        {
+            return false;
+        }
+
+        pt_line = pt_end + 1;
+    }
+
+    /* Keep the incomplete line. A line longer than the buffer closes the connection */
+    pt_conn->rx_fill -= (size_t)(pt_line - pt_rx);
+    memmove(pt_rx, pt_line, pt_conn->rx_fill);
+
+    return (pt_conn->tx_more == true) || (pt_conn->rx_fill < pt_conn->rx_buffer_size);
+}
+
+/* Function: handle a control port command
+ * Params: connection and command line
+ * Return: true: success
+ *         false: fail
+ */
+static bool control_command(socket_tcp_conn_t *pt_conn, const char *pt_line)
+{
+    socket_tcp_listener_stats_t stats;
+    int len;
+    size_t i;
+
+    if (strcmp(pt_line, SOCKET_TCP_CONTROL_CMD_PING) == 0)
+    {
+        return socket_tcp_server_send(pt_conn, (const uint8_t *)"pong\n", strlen("pong\n"));
+    }
+
+    if (strcmp(pt_line, SOCKET_TCP_CONTROL_CMD_METRICS) == 0)
+    {
+        for (i = 0; i < socket_tcp_listeners_count; i++)
+        {
+            socket_tcp_server_get_listener_stats(i, &stats);
+            len = snprintf(control_answer, sizeof(control_answer),
+                           "%s:%" PRIu16 " active=%" PRIu32 " accepted=%" PRIu32 " rejected=%" PRIu32 " msgs=%" PRIu32 " rx=%" PRIu32 " tx=%" PRIu32 " latency_avg_us=%" PRId64 " latency_max_us=%" PRId64 "\n",
+                           socket_tcp_listeners[i].pt_name, socket_tcp_listeners[i].port, stats.active, stats.accepted, stats.rejected,
+                           stats.msgs, stats.rx_bytes, stats.tx_bytes,
+                           (stats.msgs > 0) ? (stats.latency_total_us / stats.msgs) : 0, stats.latency_max_us);
+            len = (len < (int)sizeof(control_answer)) ? len : (int)sizeof(control_answer) - 1;
+
+            if (socket_tcp_server_send(pt_conn, (const uint8_t *)control_answer, len) == false)
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+#if CONFIG_TS_LOG
+    if (strncmp(pt_line, TS_LOG_CMD_PREFIX, strlen(TS_LOG_CMD_PREFIX)) == 0)
+    {
+        return control_ts_log(pt_conn, pt_line);
+    }
+#endif
+
+#if CONFIG_TRAFFIC_CAPTURE
+    if (strncmp(pt_line, TRAFFIC_CAPTURE_CMD_PREFIX, strlen(TRAFFIC_CAPTURE_CMD_PREFIX)) == 0)
+    {
+        return control_capture(pt_conn, pt_line);
+    }
+#endif
+
+#if CONFIG_REQUEST_TRACE
+    if (strncmp(pt_line, REQUEST_TRACE_CMD_PREFIX, strlen(REQUEST_TRACE_CMD_PREFIX)) == 0)
+    {
+        return control_trace(pt_conn, pt_line);
+    }
+#endif
+
+    if (pt_line[0] == '\0')
+    {
+        return true;
+    }
+
+    return socket_tcp_server_send(pt_conn, (const uint8_t *)"unknown command\n", strlen("unknown command\n"));
+}
+
+#if CONTROL_STREAMS
+/* Function: control port writable: stream the next chunk of the answer in progress. Once it's done,
+ *           commands received behind it are handled
+ * Params: connection
+ * Return: true: success
+ *         false: fail (connection must be closed)
+ */
+static bool control_on_writable(socket_tcp_conn_t *pt_conn)
+{
+    control_stream_t *pt_stream = control_stream_find(pt_conn);
+
+    if ((pt_stream != NULL) && (control_stream_continue(pt_stream) == false))
+    {
+        return false;
+    }
+
+    pt_conn->tx_more = (control_stream_find(pt_conn) != NULL);
+
+    return (pt_conn->tx_more == true) || control_on_data(pt_conn, 0);
+}
+
+/* Function: control connection closed (an answer in progress is dropped; an unfinished export is cancelled)
+ * Params: connection and whether it was closed due to an error
+ * Return: none
+ */
+static void control_on_close(socket_tcp_conn_t *pt_conn, bool is_error)
+{
+    control_stream_t *pt_stream = control_stream_find(pt_conn);
+
+    if (pt_stream != NULL)
+    {
+        if (pt_stream->kind == CONTROL_STREAM_CAPTURE)
+        {
+            traffic_capture_export_cancel();
+        }
+        else if (pt_stream->kind == CONTROL_STREAM_TRACE)
+        {
+            request_trace_export_cancel();
+        }
+
+        pt_stream->pt_conn = NULL;
+    }
+
+    log_close(pt_conn, is_error);
+}
+
+/* Function: find the answer being streamed to a control connection
+ * Params: connection (NULL: find a free one)
+ * Return: stream (NULL: none)
+ */
+static control_stream_t * control_stream_find(const socket_tcp_conn_t *pt_conn)
+{
+    size_t i;
+
+    for (i = 0; i < CONTROL_MAX_CLIENTS; i++)
+    {
+        if (control_streams[i].pt_conn == pt_conn)
+        {
+            return &control_streams[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Function: take a stream for the answer of a control connection (its position must be set by the caller)
+ * Params: connection and kind of answer
+ * Return: stream (NULL: none free)
+ */
+static control_stream_t * control_stream_start(socket_tcp_conn_t *pt_conn, control_stream_kind_t kind)
+{
+    /* A connection isn't read while its answer streams, so it has at most one */
+    control_stream_t *pt_stream = control_stream_find(NULL);
+
+    if (pt_stream != NULL)
+    {
+        pt_stream->pt_conn = pt_conn;
+        pt_stream->kind = kind;
+    }
+
+    return pt_stream;
+}
+
+/* Function: stream the next part of an answer, until the TX queue can't take more (the server calls
+ *           on_writable for the rest). The stream is released once the answer is complete
+ * Params: stream
+ * Return: true: success
+ *         false: fail (connection must be closed)
+ */
+static bool control_stream_continue(control_stream_t *pt_stream)
+{
+    socket_tcp_conn_t *pt_conn = pt_stream->pt_conn;
+
+    pt_stream->paused = false;
+    pt_stream->error = false;
+
+    switch (pt_stream->kind)
+    {
+#if CONFIG_TS_LOG
+        case CONTROL_STREAM_TS_LOG:
+            return control_query_continue(pt_stream);
+#endif
+
+#if CONFIG_TRAFFIC_CAPTURE
+        case CONTROL_STREAM_CAPTURE:
+            (void)traffic_capture_export_pcapng(&pt_stream->capture_block, control_export_write, pt_stream);
+            break;
+#endif
+
+#if CONFIG_REQUEST_TRACE
+        case CONTROL_STREAM_TRACE:
+            (void)request_trace_export_json(&pt_stream->trace_pos, control_export_write, pt_stream);
+            break;
+#endif
+
+        default:
+            break;
+    }
+
+    if (pt_stream->error == true)
+    {
+        return false;
+    }
+
+    /* Client is behind: the export continues when its TX queue is empty */
+    pt_conn->tx_more = pt_stream->paused;
+
+    if (pt_stream->paused == false)
+    {
+        pt_stream->pt_conn = NULL;
+    }
+
+    return true;
+}
+#endif
+
+#if CONFIG_TS_LOG
+/* Function: time-series log commands ("tslog query <from> <to>" streams CSV lines, "tslog stats")
+ * Params: connection and command line
+ * Return: true: success
+ *         false: fail
+ */
+static bool control_ts_log(socket_tcp_conn_t *pt_conn, const char *pt_line)
+{
+    control_stream_t *pt_stream;
+    ts_log_stats_t stats;
+    uint32_t from_timestamp;
+    uint32_t to_timestamp;
+    int len;
+
+    if (strcmp(pt_line, TS_LOG_CMD_STATS) == 0)
+    {
+        ts_log_get_stats(&stats);
+        len = snprintf(control_answer, sizeof(control_answer),
+                       "samples=%" PRIu32 " rejected=%" PRIu32 " blocks=%" PRIu32 " bytes=%" PRIu32 " sectors=%" PRIu32 "/%" PRIu32 " erased=%" PRIu32 " erase_count=%" PRIu32 "..%" PRIu32 " crc_errors=%" PRIu32 " range=%" PRIu32 "..%" PRIu32 "\n",
+                       stats.samples_appended, stats.samples_rejected, stats.blocks_written, stats.bytes_written,
+                       stats.sectors_used, stats.sectors_total, stats.sectors_erased, stats.erase_count_min, stats.erase_count_max,
+                       stats.crc_errors, stats.oldest_timestamp, stats.newest_timestamp);
+        len = (len < (int)sizeof(control_answer)) ? len : (int)sizeof(control_answer) - 1;
+
+        return socket_tcp_server_send(pt_conn, (const uint8_t *)control_answer, len);
+    }
+
+    if ((strncmp(pt_line, TS_LOG_CMD_QUERY, strlen(TS_LOG_CMD_QUERY)) != 0) ||
+        (sscanf(pt_line + strlen(TS_LOG_CMD_QUERY), "%" SCNu32 " %" SCNu32, &from_timestamp, &to_timestamp) != 2))
+    {
+        return socket_tcp_server_send(pt_conn, (const uint8_t *)"usage: tslog query <from> <to> | tslog stats\n",
+                                      strlen("usage: tslog query <from> <to> | tslog stats\n"));
+    }
+
+    pt_stream = control_stream_start(pt_conn, CONTROL_STREAM_TS_LOG);
+    if (pt_stream == NULL)
+    {
+        return false;
+    }
+
+    pt_stream->count = 0;
+    pt_stream->cursor.from_timestamp = from_timestamp;
+    pt_stream->cursor.to_timestamp = to_timestamp;
+    pt_stream->result = ts_log_query_start(&pt_stream->cursor, from_timestamp, to_timestamp);
+    pt_stream->cursor.done = (pt_stream->result == false);
+
+    return control_stream_continue(pt_stream);
+}
+
+/* Function: stream the next chunk of a query (one per loop iteration, the server calls on_writable
+ *           for the next one), then the last line with the sample count
+ * Params: query
+ * Return: true: success
+ *         false: fail (connection must be closed)
+ */
+static bool control_query_continue(control_stream_t *pt_query)
+{
+    socket_tcp_conn_t *pt_conn = pt_query->pt_conn;
+    int len;
+
+    pt_query->fill = 0;
+
+    if ((pt_query->cursor.done == false) &&
+        (ts_log_query_next(&pt_query->cursor, control_query_sample, pt_query) == false))
+    {
+        pt_query->result = false;
+        pt_query->cursor.done = true;
+    }
+
+    if ((pt_query->fill > 0) && (socket_tcp_server_send(pt_conn, (const uint8_t *)control_query_chunk, pt_query->fill) == false))
+    {
+        return false;
+    }
+
+    pt_conn->tx_more = !pt_query->cursor.done;
+
+    if (pt_query->cursor.done == false)
+    {
+        return true;
+    }
+
+    /* Samples missing: flash error, or sectors reused while the client was slow to read */
+    pt_query->pt_conn = NULL;
+    len = snprintf(control_answer, sizeof(control_answer), "# %" PRIu32 " samples%s\n", pt_query->count,
+                   ((pt_query->result == true) && (pt_query->cursor.lost == false)) ? "" : " (incomplete)");
+
+    ESP_LOGI(SOCKET_TCP_LISTENERS_TAG, "tslog query %" PRIu32 "-%" PRIu32 ": %" PRIu32 " samples",
+             pt_query->cursor.from_timestamp, pt_query->cursor.to_timestamp, pt_query->count);
+
+    return socket_tcp_server_send(pt_conn, (const uint8_t *)control_answer, len);
+}
+
+/* Function: time-series log query callback (adds a CSV line to the chunk)
+ * Params: query and sample
+ * Return: true: success
+ *         false: chunk full (query paused at this sample until the chunk is sent)
+ */
+static bool control_query_sample(void *ctx, const ts_log_sample_t *pt_sample)
+{
+    control_stream_t *pt_query = (control_stream_t *)ctx;
+
+    if (pt_query->fill + CONTROL_QUERY_LINE_SIZE > sizeof(control_query_chunk))
+    {
+        return false;
+    }
+
+    pt_query->fill += snprintf(&control_query_chunk[pt_query->fill], sizeof(control_query_chunk) - pt_query->fill,
+                               "%" PRIu32 ",%u,%" PRId32 "\n", pt_sample->timestamp, pt_sample->sensor_id, pt_sample->value);
+    pt_query->count++;
+
+    return true;
+}
+#endif
+
+#if CONFIG_TRAFFIC_CAPTURE
+/* Function: traffic capture commands ("capture dump" streams the pcapng file, "capture arm", "capture off").
+ *           Recording is paused while the file streams, so there's one download at a time and the ring
+ *           can't be armed meanwhile
+ * Params: connection and command line
+ * Return: true: success
+ *         false: fail
+ */
+static bool control_capture(socket_tcp_conn_t *pt_conn, const char *pt_line)
+{
+    control_stream_t *pt_stream;
+    const char *pt_answer = "usage: capture arm | capture off | capture dump\n";
+
+    if (control_stream_active(CONTROL_STREAM_CAPTURE) == true)
+    {
+        return socket_tcp_server_send(pt_conn, (const uint8_t *)"capture: busy\n", strlen("capture: busy\n"));
+    }
+
+    if (strcmp(pt_line, TRAFFIC_CAPTURE_CMD_DUMP) == 0)
+    {
+        /* Answer is the pcapng file itself */
+        pt_stream = control_stream_start(pt_conn, CONTROL_STREAM_CAPTURE);
+        if (pt_stream == NULL)
+        {
+            return false;
+        }
+
+        pt_stream->capture_block = 0;
+        return control_stream_continue(pt_stream);
+    }
+
+    if (strcmp(pt_line, TRAFFIC_CAPTURE_CMD_ARM) == 0)
+    {
+        traffic_capture_arm();
+        pt_answer = "capture: armed\n";
+    }
+    else if (strcmp(pt_line, TRAFFIC_CAPTURE_CMD_OFF) == 0)
+    {
+        traffic_capture_off();
+        pt_answer = "capture: off\n";
+    }
+
+    return socket_tcp_server_send(pt_conn, (const uint8_t *)pt_answer, strlen(pt_answer));
+}
+#endif
+
+#if CONFIG_REQUEST_TRACE
+/* Function: request trace commands ("trace dump" streams the JSON trace, "trace clear"). Trace points
+ *           aren't recorded while the JSON streams, so there's one download at a time
+ * Params: connection and command line
+ * Return: true: success
+ *         false: fail
+ */
+static bool control_trace(socket_tcp_conn_t *pt_conn, const char *pt_line)
+{
+    control_stream_t *pt_stream;
+    const char *pt_answer = "usage: trace dump | trace clear\n";
+
+    if (control_stream_active(CONTROL_STREAM_TRACE) == true)
+    {
+        return socket_tcp_server_send(pt_conn, (const uint8_t *)"trace: busy\n", strlen("trace: busy\n"));
+    }
+
+    if (strcmp(pt_line, REQUEST_TRACE_CMD_DUMP) == 0)
+    {
+        /* Answer is the JSON trace itself */
+        pt_stream = control_stream_start(pt_conn, CONTROL_STREAM_TRACE);
+        if (pt_stream == NULL)
+        {
+            return false;
+        }
+
+        memset(&pt_stream->trace_pos, 0x00, sizeof(pt_stream->trace_pos));
+        return control_stream_continue(pt_stream);
+    }
+
+    if (strcmp(pt_line, REQUEST_TRACE_CMD_CLEAR) == 0)
+    {
+        request_trace_clear();
+        pt_answer = "trace: cleared\n";
+    }
+
+    return socket_tcp_server_send(pt_conn, (const uint8_t *)pt_answer, strlen(pt_answer));
+}
+#endif
+
+#if CONFIG_TRAFFIC_CAPTURE || CONFIG_REQUEST_TRACE
+/* Function: check whether an answer of a kind is being streamed (exports are one at a time)
+ * Params: kind of answer
+ * Return: true: yes
+ *         false: no
+ */
+static bool control_stream_active(control_stream_kind_t kind)
+{
+    size_t i;
+
+    for (i = 0; i < CONTROL_MAX_CLIENTS; i++)
+    {
+        if ((control_streams[i].pt_conn != NULL) && (control_streams[i].kind == kind))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Function: export callback (streams a file to the control client; a chunk that doesn't fit the TX queue
+ *           waits for the next on_writable)
+ * Params: stream, data and length
+ * Return: true: success
+ *         false: stream paused (client is behind) or fail (stream error)
+ */
+static bool control_export_write(void *ctx, const uint8_t *pt_data, size_t len)
+{
+    control_stream_t *pt_stream = (control_stream_t *)ctx;
+
+    if ((pt_stream->pt_conn->tx_fill > 0) && (socket_tcp_server_tx_space(pt_stream->pt_conn) < len))
+    {
+        pt_stream->paused = true;
+        return false;
+    }
+
+    if (socket_tcp_server_send(pt_stream->pt_conn, pt_data, len) == false)
+    {
+        pt_stream->error = true;
+        return false;
+    }
+
+    return true;
+}
+#endif
+
+/* Function: bulk port data (discarded; listener statistics show the throughput)
+ * Params: connection and number of bytes just received
+ * Return: true
+ */
+static bool bulk_on_data(socket_tcp_conn_t *pt_conn, size_t len)
+{
+    pt_conn->rx_fill = 0;
+    return true;
+}
@@ -0,0 +1,22 @@
+/* Header file: socket tcp server listeners (compile-time table, control and bulk handlers) */
+
+#ifndef HEADER_MOD_SOCKET_TCP_LISTENERS
+#define HEADER_MOD_SOCKET_TCP_LISTENERS
+
+#include "sdkconfig.h"
+#include "socket_tcp_server.h"
+
+/* Defines: IP_TOS values (RFC 1349) */
+#define SOCKET_TCP_LISTENER_TOS_DEFAULT              0x00
+#define SOCKET_TCP_LISTENER_TOS_LOWDELAY             0x10
+#define SOCKET_TCP_LISTENER_TOS_THROUGHPUT           0x08
+
+/* Defines: control port commands (one per line) */
+#define SOCKET_TCP_CONTROL_CMD_PING                  "ping"
+#define SOCKET_TCP_CONTROL_CMD_METRICS               "metrics"
+
+/* Listeners (served by the TCP socket server task, in priority order) */
+extern const socket_tcp_listener_t socket_tcp_listeners[];
+extern const size_t socket_tcp_listeners_count;
+
+#endif
@@ -1,6 +1,21 @@
-/* Module: socket tcp server */
+/* Module: socket tcp server
+ *
+ * One task serves every listener declared in socket_tcp_listeners.c: a single select()
+ * waits on all listening and client sockets, then listeners are served in priority order.
+ * Each readable connection gets one recv() per loop iteration (bounded by its buffer
+ * class), so a bulk transfer on one port can't starve the other ports.
+ *
+ * Sends never wait: what the socket doesn't take goes to the connection TX queue, which is
+ * flushed when select() reports the socket writable. A connection with queued output isn't
+ * read (its client has to read first), and one whose queue doesn't move for
+ * WIFI_SOCKET_TCP_SERVER_SEND_TIMEOUT_MS is dropped, so a slow reader only slows itself down.
+ *
+ * The data port handlers (echo, resumable sessions, binary protocol) are in this file.
+ */
 
 /* Includes */
+#include <inttypes.h>
+#include <stdlib.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
@@ -15,10 +30,20 @@
 #include "lwip/sockets.h"
 #include <lwip/netdb.h>
 #include <esp_task_wdt.h>
+#include "esp_timer.h"
+#include "esp_random.h"
 
 /* Includes - modules */
 #include "../wifi_st/wifi_st.h"
 #include "../socket_tcp_server/socket_tcp_server.h"
+#include "../socket_tcp_server/socket_tcp_listeners.h"
+#include "../tcp_session/tcp_session.h"
+#include "../traffic_capture/traffic_capture.h"
+#include "../traffic_capture/traffic_capture_bench.h"
+#include "../request_trace/request_trace.h"
+#include "msg_codec_gen.h"
+#include "../msg_codec/msg_codec_bench.h"
+#include "../ts_log/ts_log.h"
 
 /* Tasks parametrization */
 #include "../prio_tasks.h"
@@ -31,20 +56,114 @@
 /* Defines - debug */
 #define SOCKET_TCP_SERVER_TAG "SOCKET_TCP_SERVER"
 
-/* Static variables */
-static int listen_sock = 0;
-static struct sockaddr_storage source_addr;
-static char addr_str[128] = {0};
-static int sock = 0;
-static char socket_tcp_rx_buffer[WIFI_SOCKET_TCP_SERVER_RECV_BUFFER_SIZE] = {0};
+/* Types - listener runtime state */
+typedef struct
+{
+    int listen_sock;
+    socket_tcp_conn_t *pt_conns;
+    socket_tcp_listener_stats_t stats;
+    socket_tcp_listener_stats_t last_report;
+} listener_state_t;
+
+/* Types - data port output streamed over several loop iterations */
+typedef enum
+{
+    DATA_STREAM_NONE = 0,
+    DATA_STREAM_REPLAY              /* session messages not acknowledged */
+} data_stream_t;
+
+/* Static variables - listeners (listener_order: indexes sorted by priority) */
+static listener_state_t listener_states[WIFI_SOCKET_TCP_SERVER_MAX_LISTENERS];
+static uint8_t listener_order[WIFI_SOCKET_TCP_SERVER_MAX_LISTENERS];
+static size_t listeners_count = 0;
+
+/* Static variables - data port */
+static socket_tcp_conn_t *pt_data_conn = NULL;
 static char socket_tcp_tx_buffer[WIFI_SOCKET_TCP_SERVER_RECV_BUFFER_SIZE+20] = {0};
 
+/* Static variables - data port stream (the client isn't read until it's done) */
+static data_stream_t data_stream = DATA_STREAM_NONE;
+static bool data_stream_paused = false;
+static bool data_stream_error = false;
+
+/* Static variables - statistics */
+static tcp_server_copy_stats_t copy_stats = {0};
+static tcp_server_copy_stats_t copy_stats_last_report = {0};
+static int64_t stats_latency_total_us = 0;
+static int64_t stats_latency_max_us = 0;
+static TickType_t stats_last_report = 0;
+
+#if CONFIG_TCP_SERVER_MSG_CODEC
+/* Static variables - binary protocol messages (kept out of the task stack) */
+static msg_echo_request_t codec_request;
+static msg_echo_response_t codec_response;
+static msg_error_t codec_error;
+#if CONFIG_TS_LOG
+static msg_sensor_sample_t codec_sample;
+#endif
+#endif
+
+#if CONFIG_TCP_SERVER_SESSIONS
+/* Static variables - resumable sessions */
+static tcp_session_t *pt_client_session = NULL;
+static uint8_t session_frame_buffer[sizeof(socket_tcp_tx_buffer) + TCP_SESSION_FRAME_HEADER_SIZE] = {0};
+static int64_t client_lost_time_us = 0;
+static int64_t last_resume_latency_us = 0;
+static int64_t max_resume_latency_us = 0;
+static int64_t replay_start_us = 0;
+static uint32_t replay_next_seq = 0;
+static uint32_t replay_count = 0;
+
+/* The largest echo message must fit the replay buffer (tcp_session_queue fails otherwise, and the connection is closed) */
+_Static_assert(TCP_SESSION_REPLAY_BUFFER_SIZE >= (TCP_SESSION_REPLAY_ENTRY_HEADER_SIZE + sizeof(socket_tcp_tx_buffer)), "replay buffer smaller than an echo message");
+#endif
+
 /* Socket task handler */
 TaskHandle_t socket_task_handler;
 
 /* Tasks */
 static void tcp_socket_server_task(void *arg);
 
+/* Local functions - listeners */
+static void start_listeners_TCP_socket_server(void);
+static void accept_TCP_socket_server(size_t index);
+static void service_conn_TCP_socket_server(size_t index, socket_tcp_conn_t *pt_conn, int64_t wake_time_us);
+static void write_conn_TCP_socket_server(size_t index, socket_tcp_conn_t *pt_conn);
+static bool flush_conn_TCP_socket_server(socket_tcp_conn_t *pt_conn);
+static void close_conn_TCP_socket_server(size_t index, socket_tcp_conn_t *pt_conn, bool is_error);
+static size_t buffer_class_size(socket_tcp_buffer_class_t buffer_class);
+static void report_stats_TCP_socket_server(void);
+
+/* Local functions - data port */
+static void data_on_accept(socket_tcp_conn_t *pt_conn);
+static bool data_on_data(socket_tcp_conn_t *pt_conn, size_t len);
+static bool data_on_writable(socket_tcp_conn_t *pt_conn);
+static void data_on_close(socket_tcp_conn_t *pt_conn, bool is_error);
+static bool send_all_TCP_socket_server(const uint8_t *pt_data, size_t len);
+static bool data_stream_continue(void);
+#if CONFIG_TCP_SERVER_SESSIONS
+static bool data_stream_start(data_stream_t stream);
+static bool data_stream_wait(size_t len);
+static bool send_session_frame(uint8_t type, uint32_t seq, const uint8_t *pt_payload, uint16_t len);
+static bool replay_session_frame(void *ctx, uint32_t seq, const uint8_t *pt_payload, uint16_t len);
+static bool handle_session_frame(const tcp_session_frame_hdr_t *pt_hdr, const uint8_t *pt_payload);
+static bool process_session_bytes(size_t recv_bytes);
+#endif
+#if CONFIG_TCP_SERVER_MSG_CODEC
+static bool send_codec_error(uint32_t seq, uint32_t code, const char *pt_text);
+static bool handle_codec_msg(uint8_t id, const uint8_t *pt_payload, size_t len);
+static bool process_codec_bytes(size_t recv_bytes);
+#endif
+
+/* Handler set - data port */
+const socket_tcp_handlers_t socket_tcp_data_handlers =
+{
+    .on_accept = data_on_accept,
+    .on_data = data_on_data,
+    .on_writable = data_on_writable,
+    .on_close = data_on_close,
+};
+
 /* Function: init TCP socket server
  * Params: none
  * Return: none
@@ -59,25 +178,35 @@ void tcp_socket_server_init(void)
                             CPU_TCP_SOCKET_SERVER);
 }
 
-/* Function: TCP socket server task
+/* Function: TCP socket server task (event loop of all listeners)
  * Params: task arguments
  * Return: none
  */
 static void tcp_socket_server_task(void *arg)
 {
-    int addr_family = AF_INET;
-    int ip_protocol = 0;
-    struct sockaddr_storage dest_addr;
-    struct sockaddr_in *dest_addr_ip4 = (struct sockaddr_in *)&dest_addr;
-    int recv_bytes_counter = 0;
-    int keep_alive = 1;
-    int keep_alive_idle_time = WIFI_SOCKET_TCP_SERVER_KEEPALIVE_IDLE;
-    int keep_alive_time_interval = WIFI_SOCKET_TCP_SERVER_KEEPALIVE_INTERVAL;
-    int keep_alive_attempts = WIFI_SOCKET_TCP_SERVER_KEEPALIVE_COUNT;
-    socklen_t addr_len = sizeof(source_addr);
-    bool is_there_any_client_connected = false;
+    listener_state_t *pt_state;
+    socket_tcp_conn_t *pt_conn;
+    struct timeval timeout;
+    fd_set read_fds;
+    fd_set write_fds;
+    int64_t wake_time_us = 0;
+    size_t index;
+    size_t i;
+    size_t j;
+    int max_fd;
+    int ready;
 
     esp_task_wdt_add(NULL);
+    (void)traffic_capture_init(false);
+    (void)ts_log_init();
+
+#if CONFIG_TCP_SERVER_MSG_CODEC_BENCHMARK
+    msg_codec_run_benchmark();
+#endif
+
+#if CONFIG_TRAFFIC_CAPTURE_BENCHMARK
+    traffic_capture_run_benchmark();
+#endif
 
     /* Wait for wi-fi connection */
     while (get_status_wifi() == false)
@@ -85,99 +214,1149 @@ static void tcp_socket_server_task(void *arg)
         vTaskDelay(100 / portTICK_PERIOD_MS);
     }
 
-    /* Configures IPv4 */
-    dest_addr_ip4->sin_addr.s_addr = htonl(INADDR_ANY);
-    dest_addr_ip4->sin_family = AF_INET;
-    dest_addr_ip4->sin_port = htons(WIFI_PORT_SOCKET_TCP_SERVER);
-    ip_protocol = IPPROTO_IP;
+    start_listeners_TCP_socket_server();
 
-    /* Create TCP socket server */
-    listen_sock = socket(addr_family, SOCK_STREAM, ip_protocol);
-    if (listen_sock < 0)
+    while (1)
     {
-        ESP_LOGE(SOCKET_TCP_SERVER_TAG, "Error: impossible to create TCP socket server. Error code: %d", errno);
-        vTaskDelete(socket_task_handler);
-        return;
+        esp_task_wdt_reset();
+
+        /* Wait until any listening or client socket has something to read, or a client socket with queued output is writable */
+        FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
+        max_fd = -1;
+        wake_time_us = esp_timer_get_time();
+
+        for (i = 0; i < listeners_count; i++)
+        {
+            pt_state = &listener_states[i];
+
+            if (pt_state->listen_sock < 0)
+            {
+                continue;
+            }
+
+            FD_SET(pt_state->listen_sock, &read_fds);
+            max_fd = (pt_state->listen_sock > max_fd) ? pt_state->listen_sock : max_fd;
+
+            for (j = 0; j < socket_tcp_listeners[i].max_clients; j++)
+            {
+                pt_conn = &pt_state->pt_conns[j];
+
+                if (pt_conn->sock < 0)
+                {
+                    continue;
+                }
+
+                if ((pt_conn->tx_fill == 0) && (pt_conn->tx_more == false))
+                {
+                    FD_SET(pt_conn->sock, &read_fds);
+                }
+                else if ((pt_conn->tx_fill > 0) && ((wake_time_us - pt_conn->tx_progress_time_us) >= (WIFI_SOCKET_TCP_SERVER_SEND_TIMEOUT_MS * 1000LL)))
+                {
+                    ESP_LOGW(SOCKET_TCP_SERVER_TAG, "Listener %s: client doesn't read (%u bytes queued). Connection closed",
+                             socket_tcp_listeners[i].pt_name, (unsigned)pt_conn->tx_fill);
+                    close_conn_TCP_socket_server(i, pt_conn, true);
+                    continue;
+                }
+                else
+                {
+                    FD_SET(pt_conn->sock, &write_fds);
+                }
+
+                max_fd = (pt_conn->sock > max_fd) ? pt_conn->sock : max_fd;
+            }
+        }
+
+        timeout.tv_sec = 0;
+        timeout.tv_usec = WIFI_SOCKET_TCP_SERVER_SELECT_TIMEOUT_MS * 1000;
+        ready = select(max_fd + 1, &read_fds, &write_fds, NULL, &timeout);
+        wake_time_us = esp_timer_get_time();
+
+        if (ready < 0)
+        {
+            ESP_LOGE(SOCKET_TCP_SERVER_TAG, "Error: select failed. Error code: %d", errno);
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+        }
+
+        /* Serve listeners in priority order: client connections first, then new clients */
+        for (i = 0; (i < listeners_count) && (ready > 0); i++)
+        {
+            index = listener_order[i];
+            pt_state = &listener_states[index];
+
+            if (pt_state->listen_sock < 0)
+            {
+                continue;
+            }
+
+            for (j = 0; j < socket_tcp_listeners[index].max_clients; j++)
+            {
+                pt_conn = &pt_state->pt_conns[j];
+
+                if ((pt_conn->sock >= 0) && FD_ISSET(pt_conn->sock, &write_fds))
+                {
+                    write_conn_TCP_socket_server(index, pt_conn);
+                }
+                else if ((pt_conn->sock >= 0) && FD_ISSET(pt_conn->sock, &read_fds))
+                {
+                    service_conn_TCP_socket_server(index, pt_conn, wake_time_us);
+                }
+            }
+
+            if (FD_ISSET(pt_state->listen_sock, &read_fds))
+            {
+                accept_TCP_socket_server(index);
+            }
+        }
+
+        report_stats_TCP_socket_server();
+        ts_log_tick();
     }
+}
 
+/* Function: create listening sockets, connection slots and RX buffers of all listeners
+ * Params: none
+ * Return: none
+ */
+static void start_listeners_TCP_socket_server(void)
+{
+    const socket_tcp_listener_t *pt_cfg;
+    listener_state_t *pt_state;
+    struct sockaddr_in dest_addr;
+    uint8_t *pt_buffers;
+    size_t buffer_size;
+    size_t i;
+    size_t j;
+    uint8_t index;
     int opt = 1;
-    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    int flags;
 
-    /* Make socket bind */
-    int err = bind(listen_sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
-    if (err != 0)
+    listeners_count = socket_tcp_listeners_count;
+
+    if (listeners_count > WIFI_SOCKET_TCP_SERVER_MAX_LISTENERS)
     {
-        ESP_LOGE(SOCKET_TCP_SERVER_TAG, "Error: impossible to bind TCP socket server. Error code: %d", errno);
-        ESP_LOGE(SOCKET_TCP_SERVER_TAG, "IPPROTO: %d", addr_family);
-        terminate_TCP_socket_server();
+        ESP_LOGE(SOCKET_TCP_SERVER_TAG, "Error: too many listeners. Only the first %d are started", WIFI_SOCKET_TCP_SERVER_MAX_LISTENERS);
+        listeners_count = WIFI_SOCKET_TCP_SERVER_MAX_LISTENERS;
     }
 
-    err = listen(listen_sock, 1);
-    if (err != 0)
+    for (i = 0; i < listeners_count; i++)
     {
-        ESP_LOGE(SOCKET_TCP_SERVER_TAG, "Error: impossible to enter in the listen state. Error code: %d", errno);
-        terminate_TCP_socket_server();
+        pt_cfg = &socket_tcp_listeners[i];
+        pt_state = &listener_states[i];
+        pt_state->listen_sock = -1;
+        buffer_size = buffer_class_size(pt_cfg->buffer_class);
+
+        /* Connection slots, RX buffers and TX queues are allocated once (one extra byte per RX buffer for a string terminator) */
+        pt_state->pt_conns = calloc(pt_cfg->max_clients, sizeof(socket_tcp_conn_t));
+        pt_buffers = malloc(pt_cfg->max_clients * (buffer_size + 1 + WIFI_SOCKET_TCP_SERVER_TX_QUEUE_SIZE));
+
+        if ((pt_state->pt_conns == NULL) || (pt_buffers == NULL))
+        {
+            ESP_LOGE(SOCKET_TCP_SERVER_TAG, "Error: not enough memory for listener %s", pt_cfg->pt_name);
+            free(pt_state->pt_conns);
+            free(pt_buffers);
+            pt_state->pt_conns = NULL;
+            continue;
+        }
+
+        for (j = 0; j < pt_cfg->max_clients; j++)
+        {
+            pt_state->pt_conns[j].sock = -1;
+            pt_state->pt_conns[j].listener_index = (uint8_t)i;
+            pt_state->pt_conns[j].pt_rx_buffer = &pt_buffers[j * (buffer_size + 1 + WIFI_SOCKET_TCP_SERVER_TX_QUEUE_SIZE)];
+            pt_state->pt_conns[j].rx_buffer_size = buffer_size;
+            pt_state->pt_conns[j].pt_tx_queue = &pt_state->pt_conns[j].pt_rx_buffer[buffer_size + 1];
+        }
+
+        /* Create TCP socket server */
+        memset(&dest_addr, 0x00, sizeof(dest_addr));
+        dest_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        dest_addr.sin_family = AF_INET;
+        dest_addr.sin_port = htons(pt_cfg->port);
+
+        pt_state->listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+        if (pt_state->listen_sock < 0)
+        {
+            ESP_LOGE(SOCKET_TCP_SERVER_TAG, "Error: impossible to create TCP socket server %s. Error code: %d", pt_cfg->pt_name, errno);
+            continue;
+        }
+
+        setsockopt(pt_state->listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+        if ((bind(pt_state->listen_sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) != 0) ||
+            (listen(pt_state->listen_sock, pt_cfg->max_clients) != 0))
+        {
+            ESP_LOGE(SOCKET_TCP_SERVER_TAG, "Error: impossible to listen on port %" PRIu16 " (%s). Error code: %d", pt_cfg->port, pt_cfg->pt_name, errno);
+            close(pt_state->listen_sock);
+            pt_state->listen_sock = -1;
+            continue;
+        }
+
+        /* Configure TCP socket server to work in non-blocking mode */
+        flags = fcntl(pt_state->listen_sock, F_GETFL);
+        fcntl(pt_state->listen_sock, F_SETFL, flags | O_NONBLOCK);
+
+        ESP_LOGI(SOCKET_TCP_SERVER_TAG, "Listener %s: port %" PRIu16 ", %u clients, %u bytes RX buffers, %u bytes TX queues, priority %u",
+                 pt_cfg->pt_name, pt_cfg->port, pt_cfg->max_clients, (unsigned)buffer_size, WIFI_SOCKET_TCP_SERVER_TX_QUEUE_SIZE, pt_cfg->priority);
     }
 
-    /* Configure TCP socket server to work in non-blocking mode */
-    int flags = fcntl(listen_sock, F_GETFL);
-    fcntl(listen_sock, F_SETFL, flags | O_NONBLOCK);
-    is_there_any_client_connected = false;
+    /* Service order: higher priority first (insertion sort, table order for equal priorities) */
+    for (i = 0; i < listeners_count; i++)
+    {
+        index = (uint8_t)i;
 
-    while (1)
+        for (j = i; (j > 0) && (socket_tcp_listeners[listener_order[j - 1]].priority < socket_tcp_listeners[index].priority); j--)
+        {
+            listener_order[j] = listener_order[j - 1];
+        }
+
+        listener_order[j] = index;
+    }
+}
+
+/* Function: accept a new client of a listener (applies the connection limit and socket options)
+ * Params: listener index
+ * Return: none
+ */
+static void accept_TCP_socket_server(size_t index)
+{
+    const socket_tcp_listener_t *pt_cfg = &socket_tcp_listeners[index];
+    listener_state_t *pt_state = &listener_states[index];
+    socket_tcp_conn_t *pt_conn = NULL;
+    socket_tcp_conn_t *pt_oldest = NULL;
+    struct sockaddr_in source_addr;
+    socklen_t addr_len = sizeof(source_addr);
+    int keep_alive = 1;
+    int keep_alive_time_interval = WIFI_SOCKET_TCP_SERVER_KEEPALIVE_INTERVAL;
+    int keep_alive_attempts = WIFI_SOCKET_TCP_SERVER_KEEPALIVE_COUNT;
+    int opt;
+    int client_sock;
+    size_t j;
+
+    REQUEST_TRACE_START(accept_start);
+    client_sock = accept(pt_state->listen_sock, (struct sockaddr *)&source_addr, &addr_len);
+
+    if (client_sock < 0)
     {
-        esp_task_wdt_reset();
+        return;
+    }
+
+    /* Free slot, or the oldest connection if the listener replaces it */
+    for (j = 0; j < pt_cfg->max_clients; j++)
+    {
+        if (pt_state->pt_conns[j].sock < 0)
+        {
+            pt_conn = &pt_state->pt_conns[j];
+            break;
+        }
+
+        if ((pt_oldest == NULL) || (pt_state->pt_conns[j].connected_time_us < pt_oldest->connected_time_us))
+        {
+            pt_oldest = &pt_state->pt_conns[j];
+        }
+    }
+
+    if (pt_conn == NULL)
+    {
+        if (pt_cfg->replace_oldest == false)
+        {
+            ESP_LOGW(SOCKET_TCP_SERVER_TAG, "Listener %s: connection limit reached (%u). Client rejected", pt_cfg->pt_name, pt_cfg->max_clients);
+            pt_state->stats.rejected++;
+            close(client_sock);
+            return;
+        }
+
+        ESP_LOGI(SOCKET_TCP_SERVER_TAG, "Listener %s: new client. Closing previous connection...", pt_cfg->pt_name);
+        close_conn_TCP_socket_server(index, pt_oldest, false);
+        pt_conn = pt_oldest;
+    }
+
+    /* Socket options of the listener */
+    if (pt_cfg->keepalive_idle > 0)
+    {
+        opt = pt_cfg->keepalive_idle;
+        setsockopt(client_sock, SOL_SOCKET, SO_KEEPALIVE, &keep_alive, sizeof(int));
+        setsockopt(client_sock, IPPROTO_TCP, TCP_KEEPIDLE, &opt, sizeof(int));
+        setsockopt(client_sock, IPPROTO_TCP, TCP_KEEPINTVL, &keep_alive_time_interval, sizeof(int));
+        setsockopt(client_sock, IPPROTO_TCP, TCP_KEEPCNT, &keep_alive_attempts, sizeof(int));
+    }
+
+    if (pt_cfg->no_delay == true)
+    {
+        opt = 1;
+        setsockopt(client_sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(int));
+    }
+
+    if (pt_cfg->tos != 0)
+    {
+        opt = pt_cfg->tos;
+        setsockopt(client_sock, IPPROTO_IP, IP_TOS, &opt, sizeof(int));
+    }
+
+    opt = fcntl(client_sock, F_GETFL);
+    fcntl(client_sock, F_SETFL, opt | O_NONBLOCK);
+
+    pt_conn->sock = client_sock;
+    pt_conn->rx_fill = 0;
+    pt_conn->tx_head = 0;
+    pt_conn->tx_fill = 0;
+    pt_conn->tx_more = false;
+    pt_conn->peer_ip = source_addr.sin_addr.s_addr;
+    pt_conn->peer_port = ntohs(source_addr.sin_port);
+    pt_conn->connected_time_us = esp_timer_get_time();
+    pt_state->stats.accepted++;
+    pt_state->stats.active++;
+
+    if (pt_cfg->pt_handlers->on_accept != NULL)
+    {
+        pt_cfg->pt_handlers->on_accept(pt_conn);
+    }
+
+    REQUEST_TRACE_COMPLETE(REQUEST_TRACE_ACCEPT, accept_start);
+}
+
+/* Function: receive bytes from a client connection and pass them to the listener handler
+ * Params: listener index, connection and time select() returned
+ * Return: none
+ */
+static void service_conn_TCP_socket_server(size_t index, socket_tcp_conn_t *pt_conn, int64_t wake_time_us)
+{
+    listener_state_t *pt_state = &listener_states[index];
+    int64_t latency_us = 0;
+    int recv_bytes_counter = 0;
+    bool keep_conn = true;
+
+    /* Handler didn't consume its buffer (e.g. frame bigger than the buffer class) */
+    if (pt_conn->rx_fill >= pt_conn->rx_buffer_size)
+    {
+        close_conn_TCP_socket_server(index, pt_conn, true);
+        return;
+    }
+
+    REQUEST_TRACE_START(recv_start);
+    recv_bytes_counter = recv(pt_conn->sock, &pt_conn->pt_rx_buffer[pt_conn->rx_fill], pt_conn->rx_buffer_size - pt_conn->rx_fill, MSG_DONTWAIT);
+
+    if (recv_bytes_counter > 0)
+    {
+        REQUEST_TRACE_COMPLETE(REQUEST_TRACE_RECV, recv_start);
+        pt_conn->pt_rx_buffer[pt_conn->rx_fill + recv_bytes_counter] = 0;
+        pt_state->stats.msgs++;
+        pt_state->stats.rx_bytes += recv_bytes_counter;
+
+        REQUEST_TRACE_BEGIN(REQUEST_TRACE_HANDLER);
+        keep_conn = socket_tcp_listeners[index].pt_handlers->on_data(pt_conn, recv_bytes_counter);
+        REQUEST_TRACE_END(REQUEST_TRACE_HANDLER);
+
+        /* Service latency: from select() wake-up to handler done, so it includes the listeners served before */
+        latency_us = esp_timer_get_time() - wake_time_us;
+        pt_state->stats.latency_total_us += latency_us;
+        pt_state->stats.latency_max_us = (latency_us > pt_state->stats.latency_max_us) ? latency_us : pt_state->stats.latency_max_us;
+
+        if (keep_conn == false)
+        {
+            close_conn_TCP_socket_server(index, pt_conn, false);
+        }
+    }
+    else if ((recv_bytes_counter == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK)))
+    {
+        close_conn_TCP_socket_server(index, pt_conn, (recv_bytes_counter < 0));
+    }
+}
+
+/* Function: close a client connection
+ * Params: listener index, connection and whether it's closed due to an error
+ * Return: none
+ */
+static void close_conn_TCP_socket_server(size_t index, socket_tcp_conn_t *pt_conn, bool is_error)
+{
+    if (socket_tcp_listeners[index].pt_handlers->on_close != NULL)
+    {
+        socket_tcp_listeners[index].pt_handlers->on_close(pt_conn, is_error);
+    }
+
+    shutdown(pt_conn->sock, SHUT_RDWR);
+    close(pt_conn->sock);
+    pt_conn->sock = -1;
+    pt_conn->rx_fill = 0;
+    pt_conn->tx_head = 0;
+    pt_conn->tx_fill = 0;
+    pt_conn->tx_more = false;
+    listener_states[index].stats.active--;
+}
+
+/* Function: client socket writable: send queued output, then let the handler send its next chunk
+ * Params: listener index and connection
+ * Return: none
+ */
+static void write_conn_TCP_socket_server(size_t index, socket_tcp_conn_t *pt_conn)
+{
+    const socket_tcp_handlers_t *pt_handlers = socket_tcp_listeners[index].pt_handlers;
+
+    REQUEST_TRACE_BEGIN(REQUEST_TRACE_SEND);
+
+    if (flush_conn_TCP_socket_server(pt_conn) == false)
+    {
+        REQUEST_TRACE_END(REQUEST_TRACE_SEND);
+        close_conn_TCP_socket_server(index, pt_conn, true);
+        return;
+    }
+
+    REQUEST_TRACE_END(REQUEST_TRACE_SEND);
+
+    if ((pt_conn->tx_fill > 0) || (pt_conn->tx_more == false))
+    {
+        return;
+    }
+
+    /* Handler clears tx_more with its last chunk */
+    if (pt_handlers->on_writable == NULL)
+    {
+        pt_conn->tx_more = false;
+    }
+    else if (pt_handlers->on_writable(pt_conn) == false)
+    {
+        close_conn_TCP_socket_server(index, pt_conn, true);
+    }
+}
+
+/* Function: send queued output of a connection (as much as the socket takes)
+ * Params: connection
+ * Return: true: success (queue may still hold bytes)
+ *         false: fail (client connection must be closed)
+ */
+static bool flush_conn_TCP_socket_server(socket_tcp_conn_t *pt_conn)
+{
+    size_t chunk;
+    int sent_bytes;
+
+    while (pt_conn->tx_fill > 0)
+    {
+        /* Queued bytes may wrap: send up to the end of the queue first */
+        chunk = WIFI_SOCKET_TCP_SERVER_TX_QUEUE_SIZE - pt_conn->tx_head;
+        chunk = (chunk < pt_conn->tx_fill) ? chunk : pt_conn->tx_fill;
+        sent_bytes = send(pt_conn->sock, &pt_conn->pt_tx_queue[pt_conn->tx_head], chunk, MSG_DONTWAIT);
+
+        if (sent_bytes > 0)
+        {
+            listener_states[pt_conn->listener_index].stats.tx_bytes += sent_bytes;
+            pt_conn->tx_head = (pt_conn->tx_head + sent_bytes) % WIFI_SOCKET_TCP_SERVER_TX_QUEUE_SIZE;
+            pt_conn->tx_fill -= sent_bytes;
+            pt_conn->tx_progress_time_us = esp_timer_get_time();
+            continue;
+        }
+
+        if ((sent_bytes < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        {
+            return true;
+        }
+
+        ESP_LOGE(SOCKET_TCP_SERVER_TAG, "Error: fail to send data to TCP socket client. Error code: %d", errno);
+        return false;
+    }
+
+    pt_conn->tx_head = 0;
+    return true;
+}
+
+/* Function: send bytes to a client connection without waiting. What the socket doesn't take is queued
+ *           (and sent when the socket is writable)
+ * Params: connection, data and length
+ * Return: true: success (sent or queued)
+ *         false: fail (socket error or TX queue full: client connection must be closed)
+ */
+bool socket_tcp_server_send(socket_tcp_conn_t *pt_conn, const uint8_t *pt_data, size_t len)
+{
+    size_t tail;
+    size_t chunk;
+    int sent_bytes;
+    bool ret = true;
+
+    REQUEST_TRACE_BEGIN(REQUEST_TRACE_SEND);
+
+    /* Nothing queued: straight to the socket (queued bytes must go first otherwise) */
+    while ((pt_conn->tx_fill == 0) && (len > 0))
+    {
+        sent_bytes = send(pt_conn->sock, pt_data, len, MSG_DONTWAIT);
+
+        if (sent_bytes > 0)
+        {
+            listener_states[pt_conn->listener_index].stats.tx_bytes += sent_bytes;
+            pt_data += sent_bytes;
+            len -= sent_bytes;
+            continue;
+        }
+
+        if ((sent_bytes < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        {
+            pt_conn->tx_progress_time_us = esp_timer_get_time();
+            break;
+        }
+
+        ESP_LOGE(SOCKET_TCP_SERVER_TAG, "Error: fail to send data to TCP socket client. Error code: %d", errno);
+        len = 0;
+        ret = false;
+    }
+
+    if (len > socket_tcp_server_tx_space(pt_conn))
+    {
+        ESP_LOGE(SOCKET_TCP_SERVER_TAG, "Error: TX queue full (%u bytes queued, %u more)", (unsigned)pt_conn->tx_fill, (unsigned)len);
+        len = 0;
+        ret = false;
+    }
+
+    while (len > 0)
+    {
+        tail = (pt_conn->tx_head + pt_conn->tx_fill) % WIFI_SOCKET_TCP_SERVER_TX_QUEUE_SIZE;
+        chunk = WIFI_SOCKET_TCP_SERVER_TX_QUEUE_SIZE - tail;
+        chunk = (chunk < len) ? chunk : len;
+        memcpy(&pt_conn->pt_tx_queue[tail], pt_data, chunk);
+        pt_conn->tx_fill += chunk;
+
+        /* Data port: one more copy of what the socket didn't take (copy statistics) */
+        if (pt_conn == pt_data_conn)
+        {
+            copy_stats.copied_bytes += chunk;
+        }
+        pt_data += chunk;
+        len -= chunk;
+    }
+
+    REQUEST_TRACE_END(REQUEST_TRACE_SEND);
+    return ret;
+}
+
+/* Function: free space in the TX queue of a connection (handlers sending in chunks check it before each chunk)
+ * Params: connection
+ * Return: bytes
+ */
+size_t socket_tcp_server_tx_space(const socket_tcp_conn_t *pt_conn)
+{
+    return WIFI_SOCKET_TCP_SERVER_TX_QUEUE_SIZE - pt_conn->tx_fill;
+}
+
+/* Function: get statistics of a listener
+ * Params: listener index and statistics (output)
+ * Return: none
+ */
+void socket_tcp_server_get_listener_stats(size_t index, socket_tcp_listener_stats_t *pt_stats)
+{
+    if (index >= listeners_count)
+    {
+        memset(pt_stats, 0x00, sizeof(socket_tcp_listener_stats_t));
+        return;
+    }
+
+    *pt_stats = listener_states[index].stats;
+}
+
+/* Function: get copy statistics since boot (data port)
+ * Params: statistics (output)
+ * Return: none
+ */
+void socket_tcp_server_get_copy_stats(tcp_server_copy_stats_t *pt_stats)
+{
+    *pt_stats = copy_stats;
+}
+
+/* Function: RX buffer size of a buffer class
+ * Params: buffer class
+ * Return: size (bytes)
+ */
+static size_t buffer_class_size(socket_tcp_buffer_class_t buffer_class)
+{
+    switch (buffer_class)
+    {
+        case SOCKET_TCP_BUFFER_SMALL:
+            return WIFI_SOCKET_TCP_SERVER_BUFFER_SMALL;
+
+        case SOCKET_TCP_BUFFER_LARGE:
+            return WIFI_SOCKET_TCP_SERVER_BUFFER_LARGE;
+
+        default:
+            return WIFI_SOCKET_TCP_SERVER_BUFFER_MEDIUM;
+    }
+}
+
+/* Function: new client on the data port
+ * Params: connection
+ * Return: none
+ */
+static void data_on_accept(socket_tcp_conn_t *pt_conn)
+{
+    struct sockaddr_in server_addr;
+    socklen_t server_addr_len = sizeof(server_addr);
+    struct in_addr peer_addr = { .s_addr = pt_conn->peer_ip };
+    char addr_str[16] = {0};
+
+    pt_data_conn = pt_conn;
+    inet_ntoa_r(peer_addr, addr_str, sizeof(addr_str) - 1);
+
+    if (getsockname(pt_conn->sock, (struct sockaddr *)&server_addr, &server_addr_len) == 0)
+    {
+        traffic_capture_set_endpoints(pt_conn->peer_ip, pt_conn->peer_port, server_addr.sin_addr.s_addr, ntohs(server_addr.sin_port));
+    }
+
+    ESP_LOGI(SOCKET_TCP_SERVER_TAG, "TCP socket client IP: %s", addr_str);
+}
+
+/* Function: bytes received on the data port. Echo them back to TCP socket client
+ * Params: connection and number of bytes just received
+ * Return: true: success
+ *         false: fail (client connection must be closed)
+ */
+static bool data_on_data(socket_tcp_conn_t *pt_conn, size_t len)
+{
+    int64_t recv_time_us = esp_timer_get_time();
+    bool ret = true;
+
+    copy_stats.msgs++;
+    copy_stats.rx_bytes += len;
+
+#if CONFIG_TCP_SERVER_SESSIONS
+    traffic_capture_record(TRAFFIC_CAPTURE_RX, &pt_conn->pt_rx_buffer[pt_conn->rx_fill], len);
+    copy_stats.copied_bytes += len;
+    ret = process_session_bytes(len);
+#elif CONFIG_TCP_SERVER_MSG_CODEC
+    traffic_capture_record(TRAFFIC_CAPTURE_RX, &pt_conn->pt_rx_buffer[pt_conn->rx_fill], len);
+    copy_stats.copied_bytes += len;
+    ret = process_codec_bytes(len);
+#else
+    char *pt_rx = (char *)pt_conn->pt_rx_buffer;
+
+    traffic_capture_record(TRAFFIC_CAPTURE_RX, pt_rx, len);
+
+    memset(socket_tcp_tx_buffer, 0x00, sizeof(socket_tcp_tx_buffer));
+    snprintf(socket_tcp_tx_buffer, sizeof(socket_tcp_tx_buffer), "\n\rReceived: %s", pt_rx);
+    ret = send_all_TCP_socket_server((uint8_t *)socket_tcp_tx_buffer, strlen(socket_tcp_tx_buffer));
+    ESP_LOGI(SOCKET_TCP_SERVER_TAG, "%u bytes received from TCP socket client. Echoing them back to client...", (unsigned)len);
+
+    /* Copies: pbuf -> rx buffer (recv), rx -> tx buffer (snprintf), tx buffer -> lwIP (send).
+     * Bytes the socket doesn't take are copied to the TX queue as well (counted in socket_tcp_server_send) */
+    copy_stats.copied_bytes += len + 2 * strlen(socket_tcp_tx_buffer);
+#endif
+
+    /* Handling latency: from data received to response sent */
+    recv_time_us = esp_timer_get_time() - recv_time_us;
+    stats_latency_total_us += recv_time_us;
+    stats_latency_max_us = (recv_time_us > stats_latency_max_us) ? recv_time_us : stats_latency_max_us;
+    traffic_capture_check_latency(recv_time_us);
+
+    return ret;
+}
+
+/* Function: data port client socket writable (queued output sent): continue the stream in progress
+ * Params: connection
+ * Return: true: success
+ *         false: fail (client connection must be closed)
+ */
+static bool data_on_writable(socket_tcp_conn_t *pt_conn)
+{
+    return data_stream_continue();
+}
+
+/* Function: data port client disconnected
+ * Params: connection and whether it's closed due to an error
+ * Return: none
+ */
+static void data_on_close(socket_tcp_conn_t *pt_conn, bool is_error)
+{
+    if (is_error == true)
+    {
+        traffic_capture_trigger(TRAFFIC_CAPTURE_TRIGGER_ERROR);
+    }
+
+    data_stream = DATA_STREAM_NONE;
+
+    ESP_LOGI(SOCKET_TCP_SERVER_TAG, "TCP socket client disconnected");
+    pt_data_conn = NULL;
+
+#if CONFIG_TCP_SERVER_SESSIONS
+    /* Session (and its replay buffer) is kept, so the client can resume it */
+    pt_client_session = NULL;
+    client_lost_time_us = esp_timer_get_time();
+#endif
+}
+
+/* Function: send all bytes to the data port client
+ * Params: data and length
+ * Return: true: success
+ *         false: fail (client connection must be closed)
+ */
+static bool send_all_TCP_socket_server(const uint8_t *pt_data, size_t len)
+{
+    traffic_capture_record(TRAFFIC_CAPTURE_TX, pt_data, len);
+
+    if (socket_tcp_server_send(pt_data_conn, pt_data, len) == false)
+    {
+        traffic_capture_trigger(TRAFFIC_CAPTURE_TRIGGER_ERROR);
+        return false;
+    }
+
+    return true;
+}
+
+#if CONFIG_TCP_SERVER_SESSIONS
+/* Function: start streaming an output that may not fit the TX queue (session replay)
+ * Params: stream (its position must be reset by the caller)
+ * Return: true: success (stream done, or continued when the socket is writable)
+ *         false: fail (client connection must be closed)
+ */
+static bool data_stream_start(data_stream_t stream)
+{
+    data_stream = stream;
+    return data_stream_continue();
+}
+#endif
+
+/* Function: send the stream in progress until the TX queue is full (the rest is sent on the next writable events)
+ * Params: none
+ * Return: true: success
+ *         false: fail (client connection must be closed)
+ */
+static bool data_stream_continue(void)
+{
+    data_stream_paused = false;
+    data_stream_error = false;
 
-        /* Proceed if a TCP socket client connects */
-        if (is_there_any_client_connected == false)
+    switch (data_stream)
+    {
+#if CONFIG_TCP_SERVER_SESSIONS
+        case DATA_STREAM_REPLAY:
+            replay_count += tcp_session_replay(pt_client_session, replay_next_seq, replay_session_frame, NULL);
+            break;
+#endif
+
+        default:
+            break;
+    }
+
+    if (data_stream_error == true)
+    {
+        return false;
+    }
+
+    /* Client is behind: the stream continues when its socket is writable */
+    pt_data_conn->tx_more = data_stream_paused;
+
+    if (data_stream_paused == true)
+    {
+        return true;
+    }
+
+#if CONFIG_TCP_SERVER_SESSIONS
+    if (data_stream == DATA_STREAM_REPLAY)
+    {
+        last_resume_latency_us = esp_timer_get_time() - replay_start_us;
+
+        if (last_resume_latency_us > max_resume_latency_us)
         {
-            sock = accept(listen_sock, (struct sockaddr *)&source_addr, &addr_len);
+            max_resume_latency_us = last_resume_latency_us;
+        }
+
+        ESP_LOGI(SOCKET_TCP_SERVER_TAG, "Session resumed (token: 0x%08" PRIx32 "): %" PRIu32 " msgs replayed in %" PRId64 " us, %" PRId64 " ms after disconnection",
+                 pt_client_session->token, replay_count, last_resume_latency_us, (replay_start_us - client_lost_time_us) / 1000);
+    }
+#endif
+
+    data_stream = DATA_STREAM_NONE;
+    return true;
+}
+
+#if CONFIG_TCP_SERVER_SESSIONS
+/* Function: check whether the next chunk of the stream must wait for the client (TX queue can't take it)
+ * Params: chunk length
+ * Return: true: wait (stream paused)
+ *         false: send it now
+ */
+static bool data_stream_wait(size_t len)
+{
+    if ((pt_data_conn->tx_fill > 0) && (socket_tcp_server_tx_space(pt_data_conn) < len))
+    {
+        data_stream_paused = true;
+        return true;
+    }
+
+    return false;
+}
+#endif
+
+#if CONFIG_TCP_SERVER_SESSIONS
+/* Function: build and send a session frame
+ * Params: frame type, seq, payload and payload length
+ * Return: true: success
+ *         false: fail
+ */
+static bool send_session_frame(uint8_t type, uint32_t seq, const uint8_t *pt_payload, uint16_t len)
+{
+    size_t frame_size = tcp_session_frame_build(session_frame_buffer, sizeof(session_frame_buffer), type, seq, pt_payload, len);
+
+    if (frame_size == 0)
+    {
+        return false;
+    }
+
+    copy_stats.copied_bytes += 2 * frame_size;
+    return send_all_TCP_socket_server(session_frame_buffer, frame_size);
+}
+
+/* Function: replay callback (sends an unacknowledged message again)
+ * Params: context (unused), seq, payload and payload length
+ * Return: true: success
+ *         false: stream paused (client is behind) or fail (data_stream_error)
+ */
+static bool replay_session_frame(void *ctx, uint32_t seq, const uint8_t *pt_payload, uint16_t len)
+{
+    if (data_stream_wait(TCP_SESSION_FRAME_HEADER_SIZE + len) == true)
+    {
+        return false;
+    }
+
+    if (send_session_frame(TCP_SESSION_FRAME_DATA_SERVER, seq, pt_payload, len) == false)
+    {
+        data_stream_error = true;
+        return false;
+    }
+
+    replay_next_seq = seq + 1;
+    return true;
+}
+
+/* Function: handle a frame received from TCP socket client
+ * Params: frame header and payload
+ * Return: true: success
+ *         false: fail (client connection must be closed)
+ */
+static bool handle_session_frame(const tcp_session_frame_hdr_t *pt_hdr, const uint8_t *pt_payload)
+{
+    uint8_t session_payload[5] = {0};
+    uint32_t token = 0;
+    uint32_t seq = 0;
+    int64_t resume_start_us = esp_timer_get_time();
+    bool is_resume = false;
+    int len = 0;
+
+    switch (pt_hdr->type)
+    {
+        case TCP_SESSION_FRAME_HELLO:
+        case TCP_SESSION_FRAME_RESUME:
+            is_resume = ((pt_hdr->type == TCP_SESSION_FRAME_RESUME) && (pt_hdr->len == sizeof(token)));
+
+            if (is_resume == true)
+            {
+                token = ((uint32_t)pt_payload[0] << 24) | ((uint32_t)pt_payload[1] << 16) | ((uint32_t)pt_payload[2] << 8) | pt_payload[3];
+            }
+
+            /* Handshake on a live session: the client gave it up, so its slot is released now (instead of
+             * staying in use until LRU eviction pushes out another client's resumable session) */
+            if ((pt_client_session != NULL) && ((is_resume == false) || (token != pt_client_session->token)))
+            {
+                tcp_session_close(pt_client_session);
+            }
+
+            pt_client_session = NULL;
+
+            if (is_resume == true)
+            {
+                pt_client_session = tcp_session_resume(token, pt_hdr->seq);
+            }
+
+            session_payload[4] = (pt_client_session != NULL) ? 1 : 0;
 
-            if (sock >= 0)
+            if (pt_client_session == NULL)
             {
-                /* There's TCP socket client connected. Configure Keep-Alive */
-                setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &keep_alive, sizeof(int));
-                setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &keep_alive_idle_time, sizeof(int));
-                setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &keep_alive_time_interval, sizeof(int));
-                setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &keep_alive_attempts, sizeof(int));
-                int flags_client = fcntl(sock, F_GETFL);
-                fcntl(sock, F_SETFL, flags_client | O_NONBLOCK);
+                pt_client_session = tcp_session_open(esp_random());
+            }
+
+            token = pt_client_session->token;
+            session_payload[0] = (uint8_t)(token >> 24);
+            session_payload[1] = (uint8_t)(token >> 16);
+            session_payload[2] = (uint8_t)(token >> 8);
+            session_payload[3] = (uint8_t)token;
+
+            if (send_session_frame(TCP_SESSION_FRAME_SESSION, pt_client_session->last_rx_seq, session_payload, sizeof(session_payload)) == false)
+            {
+                return false;
+            }
+
+            if (session_payload[4] == 0)
+            {
+                ESP_LOGI(SOCKET_TCP_SERVER_TAG, "New session (token: 0x%08" PRIx32 ")", token);
+                return true;
+            }
 
-                if (source_addr.ss_family == PF_INET)
+            /* Resumed: send again everything the client hasn't acknowledged (resume latency is logged when it's all sent) */
+            replay_start_us = resume_start_us;
+            replay_next_seq = pt_hdr->seq + 1;
+            replay_count = 0;
+            return data_stream_start(DATA_STREAM_REPLAY);
+
+        case TCP_SESSION_FRAME_DATA:
+            if (pt_client_session == NULL)
+            {
+                ESP_LOGE(SOCKET_TCP_SERVER_TAG, "Error: data received before session handshake");
+                return false;
+            }
+
+            /* Messages replayed by client are acknowledged again, but not processed twice */
+            if (tcp_session_rx_accept(pt_client_session, pt_hdr->seq) == true)
+            {
+                len = snprintf(socket_tcp_tx_buffer, sizeof(socket_tcp_tx_buffer), "\n\rReceived: %.*s", pt_hdr->len, pt_payload);
+                len = (len < (int)sizeof(socket_tcp_tx_buffer)) ? len : (int)sizeof(socket_tcp_tx_buffer) - 1;
+                ESP_LOGI(SOCKET_TCP_SERVER_TAG, "%d bytes received from TCP socket client (seq %" PRIu32 "). Echoing them back to client...", pt_hdr->len, pt_hdr->seq);
+
+                if (tcp_session_queue(pt_client_session, (uint8_t *)socket_tcp_tx_buffer, len, &seq) == false)
                 {
-                    inet_ntoa_r(((struct sockaddr_in *)&source_addr)->sin_addr, addr_str, sizeof(addr_str) - 1);
+                    return false;
                 }
 
-                is_there_any_client_connected = true;
-                ESP_LOGI(SOCKET_TCP_SERVER_TAG, "TCP socket client IP: %s", addr_str);                
+                if (send_session_frame(TCP_SESSION_FRAME_DATA_SERVER, seq, (uint8_t *)socket_tcp_tx_buffer, len) == false)
+                {
+                    return false;
+                }
+            }
+
+            return send_session_frame(TCP_SESSION_FRAME_ACK_SERVER, pt_client_session->last_rx_seq, NULL, 0);
+
+        case TCP_SESSION_FRAME_ACK:
+            if (pt_client_session != NULL)
+            {
+                tcp_session_ack(pt_client_session, pt_hdr->seq);
+            }
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/* Function: reassemble and handle frames from bytes received from TCP socket client
+ * Params: number of bytes just received (appended to RX buffer)
+ * Return: true: success
+ *         false: fail (client connection must be closed)
+ */
+static bool process_session_bytes(size_t recv_bytes)
+{
+    tcp_session_frame_hdr_t hdr;
+    uint8_t *pt_rx = pt_data_conn->pt_rx_buffer;
+    size_t offset = 0;
+    int frame_size = 0;
+
+    pt_data_conn->rx_fill += recv_bytes;
+
+    while ((frame_size = tcp_session_frame_parse(&pt_rx[offset], pt_data_conn->rx_fill - offset, &hdr)) > 0)
+    {
+        if (handle_session_frame(&hdr, &pt_rx[offset + TCP_SESSION_FRAME_HEADER_SIZE]) == false)
+        {
+            return false;
+        }
+
+        offset += frame_size;
+    }
+
+    /* Invalid frame, or frame bigger than RX buffer */
+    if ((frame_size < 0) || ((offset == 0) && (pt_data_conn->rx_fill == pt_data_conn->rx_buffer_size)))
+    {
+        ESP_LOGE(SOCKET_TCP_SERVER_TAG, "Error: invalid frame received from TCP socket client");
+        traffic_capture_trigger(TRAFFIC_CAPTURE_TRIGGER_ERROR);
+        return false;
+    }
+
+    memmove(pt_rx, &pt_rx[offset], pt_data_conn->rx_fill - offset);
+    pt_data_conn->rx_fill -= offset;
+    return true;
+}
+#endif
+
+#if CONFIG_TCP_SERVER_MSG_CODEC
+/* Function: send an error message to TCP socket client
+ * Params: seq of the message that caused the error, error code and text
+ * Return: true: success
+ *         false: fail
+ */
+static bool send_codec_error(uint32_t seq, uint32_t code, const char *pt_text)
+{
+    size_t frame_size;
+
+    codec_error.seq = seq;
+    codec_error.code = code;
+    snprintf(codec_error.text, sizeof(codec_error.text), "%s", pt_text);
+    frame_size = msg_error_encode(&codec_error, (uint8_t *)socket_tcp_tx_buffer, sizeof(socket_tcp_tx_buffer));
+
+    return send_all_TCP_socket_server((uint8_t *)socket_tcp_tx_buffer, frame_size);
+}
+
+/* Function: handle a message received from TCP socket client (binary protocol)
+ * Params: message id, payload and payload length
+ * Return: true: success
+ *         false: fail (client connection must be closed)
+ */
+static bool handle_codec_msg(uint8_t id, const uint8_t *pt_payload, size_t len)
+{
+    size_t frame_size;
+
+    switch (id)
+    {
+        case MSG_ID_ECHO_REQUEST:
+            if (msg_echo_request_decode(&codec_request, pt_payload, len) == false)
+            {
+                return send_codec_error(0, WIFI_SOCKET_TCP_SERVER_ERROR_INVALID_MSG, "invalid echo_request");
             }
-            else
+
+            ESP_LOGI(SOCKET_TCP_SERVER_TAG, "echo_request (seq %" PRIu32 ", %u bytes). Echoing it back to client...",
+                     codec_request.seq, codec_request.payload_len);
+
+            codec_response.seq = codec_request.seq;
+            codec_response.uptime_ms = (uint32_t)(esp_timer_get_time() / 1000);
+            codec_response.payload_len = codec_request.payload_len;
+            memcpy(codec_response.payload, codec_request.payload, codec_request.payload_len);
+            frame_size = msg_echo_response_encode(&codec_response, (uint8_t *)socket_tcp_tx_buffer, sizeof(socket_tcp_tx_buffer));
+
+            /* Copies: payload -> request (decode), request -> response, response -> tx buffer (encode), tx buffer -> lwIP (send) */
+            copy_stats.copied_bytes += 2 * codec_request.payload_len + 2 * frame_size;
+            return send_all_TCP_socket_server((uint8_t *)socket_tcp_tx_buffer, frame_size);
+
+#if CONFIG_TS_LOG
+        case MSG_ID_SENSOR_SAMPLE:
+            if (msg_sensor_sample_decode(&codec_sample, pt_payload, len) == false)
             {
-                is_there_any_client_connected = false;
+                return send_codec_error(0, WIFI_SOCKET_TCP_SERVER_ERROR_INVALID_MSG, "invalid sensor_sample");
             }
 
-            if (is_there_any_client_connected == false)
+            /* No answer on success (samples are streamed by the client) */
+            if (ts_log_append(codec_sample.timestamp, codec_sample.sensor_id, codec_sample.value) == false)
             {
-                vTaskDelay(10 / portTICK_PERIOD_MS);
-                continue;
+                return send_codec_error(0, WIFI_SOCKET_TCP_SERVER_ERROR_LOG_REJECTED, "sample not logged");
             }
+            return true;
+#endif
+
+        default:
+            return send_codec_error(0, WIFI_SOCKET_TCP_SERVER_ERROR_UNKNOWN_MSG, "unknown message");
+    }
+}
+
+/* Function: reassemble and handle messages from bytes received from TCP socket client
+ * Params: number of bytes just received (appended to RX buffer)
+ * Return: true: success
+ *         false: fail (client connection must be closed)
+ */
+static bool process_codec_bytes(size_t recv_bytes)
+{
+    uint8_t *pt_rx = pt_data_conn->pt_rx_buffer;
+    const uint8_t *pt_payload = NULL;
+    size_t payload_len = 0;
+    size_t offset = 0;
+    uint8_t id = 0;
+    int frame_size = 0;
+
+    pt_data_conn->rx_fill += recv_bytes;
+
+    while ((frame_size = msg_codec_frame_parse(&pt_rx[offset], pt_data_conn->rx_fill - offset, &id, &pt_payload, &payload_len)) > 0)
+    {
+        if (handle_codec_msg(id, pt_payload, payload_len) == false)
+        {
+            return false;
         }
 
-        /* Check for incoming bytes. If there are bytes to receive, echo them back to TCP socket client */
-        memset(socket_tcp_rx_buffer, 0x00, sizeof(socket_tcp_rx_buffer));
-        recv_bytes_counter = recv(sock, socket_tcp_rx_buffer, sizeof(socket_tcp_rx_buffer) - 1, MSG_DONTWAIT);
-        
-        if (recv_bytes_counter > 0)
+        offset += frame_size;
+    }
+
+    /* Invalid frame, or frame bigger than RX buffer */
+    if ((frame_size < 0) || ((offset == 0) && (pt_data_conn->rx_fill == pt_data_conn->rx_buffer_size)))
+    {
+        ESP_LOGE(SOCKET_TCP_SERVER_TAG, "Error: invalid message received from TCP socket client");
+        traffic_capture_trigger(TRAFFIC_CAPTURE_TRIGGER_ERROR);
+        return false;
+    }
+
+    memmove(pt_rx, &pt_rx[offset], pt_data_conn->rx_fill - offset);
+    pt_data_conn->rx_fill -= offset;
+    return true;
+}
+#endif
+
+/* Function: log TCP socket server statistics (bytes copied per message, throughput and latency per listener)
+ * Params: none
+ * Return: none
+ */
+static void report_stats_TCP_socket_server(void)
+{
+    TickType_t now = xTaskGetTickCount();
+    uint32_t elapsed_ms = (now - stats_last_report) * portTICK_PERIOD_MS;
+    socket_tcp_listener_stats_t *pt_stats;
+    socket_tcp_listener_stats_t *pt_last;
+    uint32_t msgs;
+    size_t i;
+
+    if (elapsed_ms < WIFI_SOCKET_TCP_SERVER_STATS_PERIOD_MS)
+    {
+        return;
+    }
+
+    msgs = copy_stats.msgs - copy_stats_last_report.msgs;
+
+    if (msgs > 0)
+    {
+        ESP_LOGI(SOCKET_TCP_SERVER_TAG, "Stats (sockets): %" PRIu32 " msgs, %" PRIu32 " bytes received, %" PRIu32 " bytes copied per msg, %" PRIu32 " bytes/s",
+                 msgs, copy_stats.rx_bytes - copy_stats_last_report.rx_bytes,
+                 (copy_stats.copied_bytes - copy_stats_last_report.copied_bytes) / msgs,
+                 (uint32_t)(((uint64_t)(copy_stats.rx_bytes - copy_stats_last_report.rx_bytes) * 1000) / elapsed_ms));
+        ESP_LOGI(SOCKET_TCP_SERVER_TAG, "Latency per msg: %" PRId64 " us average, %" PRId64 " us max",
+                 stats_latency_total_us / msgs, stats_latency_max_us);
+    }
+
+    /* Per listener: compare control port latency with and without a bulk transfer running */
+    for (i = 0; i < listeners_count; i++)
+    {
+        pt_stats = &listener_states[i].stats;
+        pt_last = &listener_states[i].last_report;
+        msgs = pt_stats->msgs - pt_last->msgs;
+
+        if ((msgs > 0) || (pt_stats->active > 0))
         {
-            memset(socket_tcp_tx_buffer, 0x00, sizeof(socket_tcp_tx_buffer));
-            snprintf(socket_tcp_tx_buffer, sizeof(socket_tcp_tx_buffer), "\n\rReceived: %s", socket_tcp_rx_buffer);
-            send(sock, socket_tcp_tx_buffer, strlen(socket_tcp_tx_buffer), 0);
-            ESP_LOGI(SOCKET_TCP_SERVER_TAG, "%d bytes received from TCP socket client. Echoing them back to client...", recv_bytes_counter);
-            
+            ESP_LOGI(SOCKET_TCP_SERVER_TAG, "Listener %s: %" PRIu32 " clients, %" PRIu32 " msgs, %" PRIu32 " bytes/s in, %" PRIu32 " bytes/s out, latency %" PRId64 " us average, %" PRId64 " us max",
+                     socket_tcp_listeners[i].pt_name, pt_stats->active, msgs,
+                     (uint32_t)(((uint64_t)(pt_stats->rx_bytes - pt_last->rx_bytes) * 1000) / elapsed_ms),
+                     (uint32_t)(((uint64_t)(pt_stats->tx_bytes - pt_last->tx_bytes) * 1000) / elapsed_ms),
+                     (msgs > 0) ? ((pt_stats->latency_total_us - pt_last->latency_total_us) / msgs) : 0, pt_stats->latency_max_us);
         }
 
-        vTaskDelay(10 / portTICK_PERIOD_MS);
+        pt_stats->latency_max_us = 0;
+        *pt_last = *pt_stats;
     }
+
+#if CONFIG_TRAFFIC_CAPTURE
+    /* Capture overhead: compare latency above with capture armed and off ("capture off" on the control port) */
+    traffic_capture_stats_t capture_stats;
+    traffic_capture_get_stats(&capture_stats);
+
+    if (capture_stats.records > 0)
+    {
+        ESP_LOGI(SOCKET_TCP_SERVER_TAG, "Capture (%s): %" PRIu32 " records, %" PRIu32 " cycles per record, %" PRIu32 " triggers",
+                 (traffic_capture_get_state() == TRAFFIC_CAPTURE_OFF) ? "off" : "on",
+                 capture_stats.records, (uint32_t)(capture_stats.record_cycles / capture_stats.records), capture_stats.triggers);
+    }
+#endif
+
+#if CONFIG_TCP_SERVER_SESSIONS
+    tcp_session_stats_t session_stats;
+    tcp_session_get_stats(&session_stats);
+
+    if (session_stats.sessions_opened > 0)
+    {
+        ESP_LOGI(SOCKET_TCP_SERVER_TAG, "Sessions: %" PRIu32 " opened, %" PRIu32 " resumed, %" PRIu32 " resume failures, %" PRIu32 " overflows, %" PRIu32 " msgs replayed",
+                 session_stats.sessions_opened, session_stats.resumes, session_stats.resume_failures,
+                 session_stats.overflows, session_stats.replayed_msgs);
+        ESP_LOGI(SOCKET_TCP_SERVER_TAG, "Replay buffers: %u/%u bytes used (high-water: %u). Resume latency: %" PRId64 " us (max: %" PRId64 " us)",
+                 (unsigned)session_stats.replay_bytes_used, (unsigned)session_stats.replay_bytes_allocated,
+                 (unsigned)session_stats.replay_bytes_high_water, last_resume_latency_us, max_resume_latency_us);
+    }
+#endif
+
+    copy_stats_last_report = copy_stats;
+    stats_latency_total_us = 0;
+    stats_latency_max_us = 0;
+    stats_last_report = now;
 }
 
 /* Function: terminate TCP socket server
@@ -186,6 +1365,15 @@ static void tcp_socket_server_task(void *arg)
  */
 void terminate_TCP_socket_server(void)
 {
-    close(listen_sock);
+    size_t i;
+
+    for (i = 0; i < listeners_count; i++)
+    {
+        if (listener_states[i].listen_sock >= 0)
+        {
+            close(listener_states[i].listen_sock);
+        }
+    }
+
     vTaskDelete(socket_task_handler);
 }
\ No newline at end of file
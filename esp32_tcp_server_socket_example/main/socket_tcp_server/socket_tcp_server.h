@@ -3,15 +3,118 @@
 #ifndef HEADER_MOD_SOCKET_TCP_OTA_SERVER_WIFI
 #define HEADER_MOD_SOCKET_TCP_OTA_SERVER_WIFI
 
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
 /* Defines: TCP socket server params */
 #define WIFI_PORT_SOCKET_TCP_SERVER                  5000
 #define WIFI_SOCKET_TCP_SERVER_KEEPALIVE_IDLE        5
 #define WIFI_SOCKET_TCP_SERVER_KEEPALIVE_INTERVAL    5
 #define WIFI_SOCKET_TCP_SERVER_KEEPALIVE_COUNT       10
 #define WIFI_SOCKET_TCP_SERVER_RECV_BUFFER_SIZE      1024
+#define WIFI_SOCKET_TCP_SERVER_SEND_TIMEOUT_MS       2000        /* a client whose TX queue doesn't move for this long is dropped */
+#define WIFI_SOCKET_TCP_SERVER_TX_QUEUE_SIZE         2048        /* bytes per connection not taken by the socket yet */
+#define WIFI_SOCKET_TCP_SERVER_SELECT_TIMEOUT_MS     100
+#define WIFI_SOCKET_TCP_SERVER_MAX_LISTENERS         4
+
+/* Defines: buffer classes (RX buffer size per connection) */
+#define WIFI_SOCKET_TCP_SERVER_BUFFER_SMALL          256
+#define WIFI_SOCKET_TCP_SERVER_BUFFER_MEDIUM         WIFI_SOCKET_TCP_SERVER_RECV_BUFFER_SIZE
+#define WIFI_SOCKET_TCP_SERVER_BUFFER_LARGE          4096
+
+/* Defines: error codes (binary protocol "error" message) */
+#define WIFI_SOCKET_TCP_SERVER_ERROR_INVALID_MSG     1
+#define WIFI_SOCKET_TCP_SERVER_ERROR_UNKNOWN_MSG     2
+#define WIFI_SOCKET_TCP_SERVER_ERROR_LOG_REJECTED    3
+
+/* Defines: TCP socket server statistics (bytes copied per message and throughput) */
+#define WIFI_SOCKET_TCP_SERVER_STATS_PERIOD_MS       10000
+
+/* Buffer classes */
+typedef enum
+{
+    SOCKET_TCP_BUFFER_SMALL = 0,
+    SOCKET_TCP_BUFFER_MEDIUM,
+    SOCKET_TCP_BUFFER_LARGE
+} socket_tcp_buffer_class_t;
+
+/* Client connection. RX buffer has one extra byte, so handlers can terminate received text.
+   TX queue is a ring holding what the socket didn't take yet; the connection isn't read until it's empty */
+typedef struct
+{
+    int sock;
+    uint8_t listener_index;
+    uint8_t *pt_rx_buffer;
+    size_t rx_buffer_size;
+    size_t rx_fill;
+    uint8_t *pt_tx_queue;
+    size_t tx_head;
+    size_t tx_fill;
+    int64_t tx_progress_time_us;
+    bool tx_more;                               /* set by the handler: it has more to send (see on_writable) */
+    uint32_t peer_ip;
+    uint16_t peer_port;
+    int64_t connected_time_us;
+} socket_tcp_conn_t;
+
+/* Handler set of a listener. New bytes are at pt_rx_buffer[rx_fill] (handler updates rx_fill
+   if it keeps bytes, e.g. an incomplete frame). on_data returns false to close the connection.
+   Answers bigger than the TX queue are sent in chunks: the handler sets tx_more, and on_writable
+   is called (once per loop iteration) when the TX queue is empty, until it clears tx_more */
+typedef struct
+{
+    void (*on_accept)(socket_tcp_conn_t *pt_conn);
+    bool (*on_data)(socket_tcp_conn_t *pt_conn, size_t len);
+    bool (*on_writable)(socket_tcp_conn_t *pt_conn);
+    void (*on_close)(socket_tcp_conn_t *pt_conn, bool is_error);
+} socket_tcp_handlers_t;
+
+/* Listener configuration (see socket_tcp_listeners.c) */
+typedef struct
+{
+    const char *pt_name;
+    uint16_t port;
+    uint8_t max_clients;
+    bool replace_oldest;                        /* at the limit, a new client replaces the oldest one instead of being rejected */
+    socket_tcp_buffer_class_t buffer_class;
+    uint8_t priority;                           /* listeners with higher priority are served first in every loop iteration */
+    bool no_delay;                              /* TCP_NODELAY */
+    uint8_t tos;                                /* IP_TOS */
+    int keepalive_idle;                         /* s (0: keep-alive disabled) */
+    const socket_tcp_handlers_t *pt_handlers;
+} socket_tcp_listener_t;
+
+/* Listener statistics (since boot, except latency max: since last report) */
+typedef struct
+{
+    uint32_t accepted;
+    uint32_t rejected;
+    uint32_t active;
+    uint32_t msgs;
+    uint32_t rx_bytes;
+    uint32_t tx_bytes;
+    int64_t latency_total_us;
+    int64_t latency_max_us;
+} socket_tcp_listener_stats_t;
+
+/* Copy statistics since boot (compared by the backend benchmark) */
+typedef struct
+{
+    uint32_t msgs;
+    uint32_t rx_bytes;
+    uint32_t copied_bytes;
+} tcp_server_copy_stats_t;
+
+/* Handler set of the data port (echo / sessions / binary protocol) */
+extern const socket_tcp_handlers_t socket_tcp_data_handlers;
 
 #endif
 
 /* Prototypes */
 void tcp_socket_server_init(void);
-void terminate_TCP_socket_server(void);
\ No newline at end of file
+bool socket_tcp_server_send(socket_tcp_conn_t *pt_conn, const uint8_t *pt_data, size_t len);
+size_t socket_tcp_server_tx_space(const socket_tcp_conn_t *pt_conn);
+void socket_tcp_server_get_listener_stats(size_t index, socket_tcp_listener_stats_t *pt_stats);
+void socket_tcp_server_get_copy_stats(tcp_server_copy_stats_t *pt_stats);
+void terminate_TCP_socket_server(void);
@@ -5,5 +5,6 @@
 
 #define BREATHING_LIGHT_TAM_TASK_STACK                        4096
 #define SOCKET_TCP_TAM_TASK_STACK                             4096
+#define BACKEND_BENCH_TAM_TASK_STACK                          4096
 
 #endif
\ No newline at end of file
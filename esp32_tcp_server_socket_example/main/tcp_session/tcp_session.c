@@ -0,0 +1,422 @@
+/* Module: tcp session (resumable sessions with replay buffer)
+ *
+ * Each session keeps the messages sent to the client until they are acknowledged.
+ * Messages are stored in a byte ring as: seq (4 bytes) | len (2 bytes) | payload.
+ * An entry never wraps: if it doesn't fit at the end of the ring, it's written at
+ * the beginning and replay_end_mark records where valid data ends.
+ * If the ring overflows, the oldest messages are dropped and the session can't be
+ * resumed anymore (the client gets a new session instead of silently losing data).
+ *
+ * This module doesn't depend on ESP-IDF (tokens and timing come from the caller).
+ */
+
+/* Includes */
+#include <string.h>
+#include "tcp_session.h"
+
+/* Defines - sequence number comparison (wrap-around safe) */
+#define SEQ_LEQ(a, b)                  ((int32_t)((uint32_t)(a) - (uint32_t)(b)) <= 0)
+
+/* Static variables */
+static tcp_session_t sessions[TCP_SESSION_MAX_SESSIONS];
+static tcp_session_stats_t session_stats = {0};
+static uint32_t use_counter = 0;
+
+/* Local functions */
+static void put_u32_be(uint8_t *pt_buf, uint32_t value);
+static void put_u16_be(uint8_t *pt_buf, uint16_t value);
+static uint32_t get_u32_be(const uint8_t *pt_buf);
+static uint16_t get_u16_be(const uint8_t *pt_buf);
+static void reset_replay(tcp_session_t *pt_session);
+static void drop_oldest_entry(tcp_session_t *pt_session);
+static void update_high_water(void);
+
+/* Function: parse a frame header
+ * Params: buffer, number of bytes in buffer and header (output)
+ * Return: >0: size of the complete frame at the beginning of buffer
+ *         0: frame is incomplete
+ *         -1: invalid frame
+ */
+int tcp_session_frame_parse(const uint8_t *pt_buf, size_t len, tcp_session_frame_hdr_t *pt_hdr)
+{
+    if (len < TCP_SESSION_FRAME_HEADER_SIZE)
+    {
+        return 0;
+    }
+
+    pt_hdr->type = pt_buf[0];
+    pt_hdr->seq = get_u32_be(&pt_buf[1]);
+    pt_hdr->len = get_u16_be(&pt_buf[5]);
+
+    switch (pt_hdr->type)
+    {
+        case TCP_SESSION_FRAME_HELLO:
+        case TCP_SESSION_FRAME_RESUME:
+        case TCP_SESSION_FRAME_DATA:
+        case TCP_SESSION_FRAME_ACK:
+            break;
+
+        default:
+            return -1;
+    }
+
+    if (len < (TCP_SESSION_FRAME_HEADER_SIZE + (size_t)pt_hdr->len))
+    {
+        return 0;
+    }
+
+    return TCP_SESSION_FRAME_HEADER_SIZE + pt_hdr->len;
+}
+
+/* Function: build a frame
+ * Params: output buffer and its size, frame type, seq, payload and payload length
+ * Return: frame size (0 if it doesn't fit into output buffer)
+ */
+size_t tcp_session_frame_build(uint8_t *pt_buf, size_t size, uint8_t type, uint32_t seq, const uint8_t *pt_payload, uint16_t len)
+{
+    if (size < (TCP_SESSION_FRAME_HEADER_SIZE + (size_t)len))
+    {
+        return 0;
+    }
+
+    pt_buf[0] = type;
+    put_u32_be(&pt_buf[1], seq);
+    put_u16_be(&pt_buf[5], len);
+
+    if (len > 0)
+    {
+        memcpy(&pt_buf[TCP_SESSION_FRAME_HEADER_SIZE], pt_payload, len);
+    }
+
+    return TCP_SESSION_FRAME_HEADER_SIZE + len;
+}
+
+/* Function: open a new session. If all sessions are in use, the least recently used one is replaced
+ * Params: session token (must be random, chosen by caller)
+ * Return: session pointer
+ */
+tcp_session_t * tcp_session_open(uint32_t token)
+{
+    tcp_session_t *pt_session = &sessions[0];
+    int i;
+
+    for (i = 0; i < TCP_SESSION_MAX_SESSIONS; i++)
+    {
+        if (sessions[i].in_use == false)
+        {
+            pt_session = &sessions[i];
+            break;
+        }
+
+        if (sessions[i].last_used < pt_session->last_used)
+        {
+            pt_session = &sessions[i];
+        }
+    }
+
+    pt_session->in_use = true;
+    pt_session->resumable = true;
+    pt_session->token = token;
+    pt_session->next_tx_seq = 1;
+    pt_session->last_rx_seq = 0;
+    pt_session->last_used = ++use_counter;
+    reset_replay(pt_session);
+
+    session_stats.sessions_opened++;
+    return pt_session;
+}
+
+/* Function: resume a session
+ * Params: session token and last seq the client has received
+ * Return: session pointer (NULL if session doesn't exist or can't be resumed without loss)
+ */
+tcp_session_t * tcp_session_resume(uint32_t token, uint32_t acked_seq)
+{
+    int i;
+
+    for (i = 0; i < TCP_SESSION_MAX_SESSIONS; i++)
+    {
+        if ((sessions[i].in_use == true) && (sessions[i].token == token))
+        {
+            if ((sessions[i].resumable == false) || !SEQ_LEQ(acked_seq, sessions[i].next_tx_seq - 1))
+            {
+                break;
+            }
+
+            sessions[i].last_used = ++use_counter;
+            tcp_session_ack(&sessions[i], acked_seq);
+            session_stats.resumes++;
+            return &sessions[i];
+        }
+    }
+
+    session_stats.resume_failures++;
+    return NULL;
+}
+
+/* Function: close a session and release its replay buffer
+ * Params: session
+ * Return: none
+ */
+void tcp_session_close(tcp_session_t *pt_session)
+{
+    reset_replay(pt_session);
+    pt_session->in_use = false;
+}
+
+/* Function: store an outbound message into replay buffer (until acknowledged)
+ * Params: session, payload, payload length and assigned seq (output)
+ * Return: true: stored
+ *         false: message bigger than replay buffer
+ */
+bool tcp_session_queue(tcp_session_t *pt_session, const uint8_t *pt_payload, uint16_t len, uint32_t *pt_seq)
+{
+    size_t entry_size = TCP_SESSION_REPLAY_ENTRY_HEADER_SIZE + len;
+    size_t pos = 0;
+
+    if (entry_size > TCP_SESSION_REPLAY_BUFFER_SIZE)
+    {
+        return false;
+    }
+
+    while (1)
+    {
+        if (pt_session->replay_count == 0)
+        {
+            reset_replay(pt_session);
+            pos = 0;
+            break;
+        }
+
+        if (pt_session->replay_tail > pt_session->replay_head)
+        {
+            /* Not wrapped: free space at the end, then at the beginning */
+            if ((TCP_SESSION_REPLAY_BUFFER_SIZE - pt_session->replay_tail) >= entry_size)
+            {
+                pos = pt_session->replay_tail;
+                break;
+            }
+
+            if (pt_session->replay_head >= entry_size)
+            {
+                pt_session->replay_end_mark = pt_session->replay_tail;
+                pos = 0;
+                break;
+            }
+        }
+        else if ((pt_session->replay_head - pt_session->replay_tail) >= entry_size)
+        {
+            /* Wrapped: free space between tail and head */
+            pos = pt_session->replay_tail;
+            break;
+        }
+
+        /* Replay buffer full: oldest message is lost, so the session can't be resumed anymore */
+        drop_oldest_entry(pt_session);
+        pt_session->resumable = false;
+        session_stats.overflows++;
+    }
+
+    *pt_seq = pt_session->next_tx_seq++;
+    put_u32_be(&pt_session->replay[pos], *pt_seq);
+    put_u16_be(&pt_session->replay[pos + 4], len);
+    memcpy(&pt_session->replay[pos + TCP_SESSION_REPLAY_ENTRY_HEADER_SIZE], pt_payload, len);
+    pt_session->replay_tail = pos + entry_size;
+    pt_session->replay_count++;
+
+    update_high_water();
+    return true;
+}
+
+/* Function: release messages acknowledged by the client
+ * Params: session and last seq received by client (cumulative)
+ * Return: none
+ */
+void tcp_session_ack(tcp_session_t *pt_session, uint32_t acked_seq)
+{
+    while (pt_session->replay_count > 0)
+    {
+        if (!SEQ_LEQ(get_u32_be(&pt_session->replay[pt_session->replay_head]), acked_seq))
+        {
+            break;
+        }
+
+        drop_oldest_entry(pt_session);
+    }
+}
+
+/* Function: check an inbound message seq. Duplicates (replayed by client) must be discarded
+ * Params: session and seq
+ * Return: true: new message (session last received seq is updated)
+ *         false: duplicate or out of order
+ */
+bool tcp_session_rx_accept(tcp_session_t *pt_session, uint32_t seq)
+{
+    if (seq != (pt_session->last_rx_seq + 1))
+    {
+        return false;
+    }
+
+    pt_session->last_rx_seq = seq;
+    return true;
+}
+
+/* Function: replay unacknowledged messages, oldest first, starting at a given seq (a replay stopped by
+ *           the callback continues from the seq it refused)
+ * Params: session, first seq to replay, callback (returns false to stop) and callback context
+ * Return: number of messages replayed
+ */
+uint32_t tcp_session_replay(tcp_session_t *pt_session, uint32_t from_seq, tcp_session_replay_cb_t cb, void *ctx)
+{
+    size_t pos = pt_session->replay_head;
+    uint32_t replayed = 0;
+    uint32_t entry;
+    uint32_t seq;
+    uint16_t len;
+
+    for (entry = 0; entry < pt_session->replay_count; entry++)
+    {
+        if ((pt_session->replay_tail <= pt_session->replay_head) && (pos == pt_session->replay_end_mark))
+        {
+            pos = 0;
+        }
+
+        seq = get_u32_be(&pt_session->replay[pos]);
+        len = get_u16_be(&pt_session->replay[pos + 4]);
+
+        if (SEQ_LEQ(from_seq, seq))
+        {
+            if (cb(ctx, seq, &pt_session->replay[pos + TCP_SESSION_REPLAY_ENTRY_HEADER_SIZE], len) == false)
+            {
+                break;
+            }
+
+            replayed++;
+        }
+
+        pos += TCP_SESSION_REPLAY_ENTRY_HEADER_SIZE + len;
+    }
+
+    session_stats.replayed_msgs += replayed;
+    return replayed;
+}
+
+/* Function: bytes used in a session replay buffer (wrap padding included)
+ * Params: session
+ * Return: bytes used
+ */
+size_t tcp_session_replay_bytes_used(const tcp_session_t *pt_session)
+{
+    if (pt_session->replay_count == 0)
+    {
+        return 0;
+    }
+
+    if (pt_session->replay_tail > pt_session->replay_head)
+    {
+        return pt_session->replay_tail - pt_session->replay_head;
+    }
+
+    return (pt_session->replay_end_mark - pt_session->replay_head) + pt_session->replay_tail;
+}
+
+/* Function: get sessions statistics
+ * Params: statistics (output)
+ * Return: none
+ */
+void tcp_session_get_stats(tcp_session_stats_t *pt_stats)
+{
+    int i;
+
+    session_stats.replay_bytes_allocated = sizeof(sessions);
+    session_stats.replay_bytes_used = 0;
+
+    for (i = 0; i < TCP_SESSION_MAX_SESSIONS; i++)
+    {
+        session_stats.replay_bytes_used += tcp_session_replay_bytes_used(&sessions[i]);
+    }
+
+    *pt_stats = session_stats;
+}
+
+/* Function: reset replay buffer
+ * Params: session
+ * Return: none
+ */
+static void reset_replay(tcp_session_t *pt_session)
+{
+    pt_session->replay_head = 0;
+    pt_session->replay_tail = 0;
+    pt_session->replay_end_mark = TCP_SESSION_REPLAY_BUFFER_SIZE;
+    pt_session->replay_count = 0;
+}
+
+/* Function: drop oldest message from replay buffer
+ * Params: session
+ * Return: none
+ */
+static void drop_oldest_entry(tcp_session_t *pt_session)
+{
+    bool wrapped = (pt_session->replay_tail <= pt_session->replay_head);
+
+    pt_session->replay_head += TCP_SESSION_REPLAY_ENTRY_HEADER_SIZE + get_u16_be(&pt_session->replay[pt_session->replay_head + 4]);
+    pt_session->replay_count--;
+
+    if (pt_session->replay_count == 0)
+    {
+        reset_replay(pt_session);
+    }
+    else if ((wrapped == true) && (pt_session->replay_head == pt_session->replay_end_mark))
+    {
+        pt_session->replay_head = 0;
+        pt_session->replay_end_mark = TCP_SESSION_REPLAY_BUFFER_SIZE;
+    }
+}
+
+/* Function: update replay buffers high-water mark
+ * Params: none
+ * Return: none
+ */
+static void update_high_water(void)
+{
+    size_t used = 0;
+    int i;
+
+    for (i = 0; i < TCP_SESSION_MAX_SESSIONS; i++)
+    {
+        used += tcp_session_replay_bytes_used(&sessions[i]);
+    }
+
+    if (used > session_stats.replay_bytes_high_water)
+    {
+        session_stats.replay_bytes_high_water = used;
+    }
+}
+
+/* Function: big endian helpers
+ * Params: buffer (and value)
+ * Return: value (get functions)
+ */
+static void put_u32_be(uint8_t *pt_buf, uint32_t value)
+{
+    pt_buf[0] = (uint8_t)(value >> 24);
+    pt_buf[1] = (uint8_t)(value >> 16);
+    pt_buf[2] = (uint8_t)(value >> 8);
+    pt_buf[3] = (uint8_t)value;
+}
+
+static void put_u16_be(uint8_t *pt_buf, uint16_t value)
+{
+    pt_buf[0] = (uint8_t)(value >> 8);
+    pt_buf[1] = (uint8_t)value;
+}
+
+static uint32_t get_u32_be(const uint8_t *pt_buf)
+{
+    return ((uint32_t)pt_buf[0] << 24) | ((uint32_t)pt_buf[1] << 16) | ((uint32_t)pt_buf[2] << 8) | (uint32_t)pt_buf[3];
+}
+
+static uint16_t get_u16_be(const uint8_t *pt_buf)
+{
+    return (uint16_t)(((uint16_t)pt_buf[0] << 8) | (uint16_t)pt_buf[1]);
+}
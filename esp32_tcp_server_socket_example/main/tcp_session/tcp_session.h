@@ -0,0 +1,88 @@
+/* Header file: tcp session (resumable sessions with replay buffer) */
+
+#ifndef HEADER_MOD_TCP_SESSION
+#define HEADER_MOD_TCP_SESSION
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* Defines: sessions and replay buffer size (bytes per session) */
+#ifdef CONFIG_TCP_SERVER_SESSIONS_REPLAY_BUFFER_SIZE
+#define TCP_SESSION_REPLAY_BUFFER_SIZE      CONFIG_TCP_SERVER_SESSIONS_REPLAY_BUFFER_SIZE
+#else
+#define TCP_SESSION_REPLAY_BUFFER_SIZE      4096
+#endif
+#define TCP_SESSION_MAX_SESSIONS            2
+
+/* Defines: replay entry = seq (4 bytes) | len (2 bytes) | payload */
+#define TCP_SESSION_REPLAY_ENTRY_HEADER_SIZE    6
+
+/* Defines: frame format = type (1 byte) | seq (4 bytes, big endian) | len (2 bytes, big endian) | payload */
+#define TCP_SESSION_FRAME_HEADER_SIZE       7
+
+/* Defines: frame types (client -> server) */
+#define TCP_SESSION_FRAME_HELLO             0x01    /* start a new session */
+#define TCP_SESSION_FRAME_RESUME            0x02    /* payload: token. seq: last seq received from server */
+#define TCP_SESSION_FRAME_DATA              0x03
+#define TCP_SESSION_FRAME_ACK               0x04    /* seq: last seq received (cumulative) */
+
+/* Defines: frame types (server -> client) */
+#define TCP_SESSION_FRAME_SESSION           0x81    /* payload: token + resumed flag. seq: last seq received from client */
+#define TCP_SESSION_FRAME_DATA_SERVER       0x83
+#define TCP_SESSION_FRAME_ACK_SERVER        0x84
+
+/* Session. Sequence numbers start at 1; 0 means nothing sent/received yet */
+typedef struct
+{
+    bool in_use;
+    bool resumable;
+    uint32_t token;
+    uint32_t next_tx_seq;
+    uint32_t last_rx_seq;
+    uint32_t last_used;
+    uint32_t replay_count;
+    size_t replay_head;
+    size_t replay_tail;
+    size_t replay_end_mark;
+    uint8_t replay[TCP_SESSION_REPLAY_BUFFER_SIZE];
+} tcp_session_t;
+
+/* Frame header */
+typedef struct
+{
+    uint8_t type;
+    uint32_t seq;
+    uint16_t len;
+} tcp_session_frame_hdr_t;
+
+/* Statistics */
+typedef struct
+{
+    uint32_t sessions_opened;
+    uint32_t resumes;
+    uint32_t resume_failures;
+    uint32_t overflows;
+    uint32_t replayed_msgs;
+    size_t replay_bytes_allocated;
+    size_t replay_bytes_used;
+    size_t replay_bytes_high_water;
+} tcp_session_stats_t;
+
+/* Replay callback: called for each unacknowledged message, oldest first */
+typedef bool (*tcp_session_replay_cb_t)(void *ctx, uint32_t seq, const uint8_t *pt_payload, uint16_t len);
+
+#endif
+
+/* Prototypes */
+int tcp_session_frame_parse(const uint8_t *pt_buf, size_t len, tcp_session_frame_hdr_t *pt_hdr);
+size_t tcp_session_frame_build(uint8_t *pt_buf, size_t size, uint8_t type, uint32_t seq, const uint8_t *pt_payload, uint16_t len);
+tcp_session_t * tcp_session_open(uint32_t token);
+tcp_session_t * tcp_session_resume(uint32_t token, uint32_t acked_seq);
+void tcp_session_close(tcp_session_t *pt_session);
+bool tcp_session_queue(tcp_session_t *pt_session, const uint8_t *pt_payload, uint16_t len, uint32_t *pt_seq);
+void tcp_session_ack(tcp_session_t *pt_session, uint32_t acked_seq);
+bool tcp_session_rx_accept(tcp_session_t *pt_session, uint32_t seq);
+uint32_t tcp_session_replay(tcp_session_t *pt_session, uint32_t from_seq, tcp_session_replay_cb_t cb, void *ctx);
+size_t tcp_session_replay_bytes_used(const tcp_session_t *pt_session);
+void tcp_session_get_stats(tcp_session_stats_t *pt_stats);
@@ -0,0 +1,538 @@
+/* Module: traffic capture (RX/TX ring buffer with pcapng export)
+ *
+ * Records are fixed-size (header + TRAFFIC_CAPTURE_SNAPLEN bytes), so recording is
+ * a single bounded copy into a ring preallocated at init (PSRAM when available).
+ * The ring keeps recording while armed; a trigger (latency threshold or error) lets
+ * TRAFFIC_CAPTURE_POST_TRIGGER_RECORDS more records in and then freezes it, so the
+ * traffic around the event is kept until it's downloaded.
+ *
+ * Export synthesizes IPv4/TCP headers (LINKTYPE_RAW) from the connection endpoints
+ * and stream offsets, so Wireshark decodes records as a regular TCP conversation.
+ * It's resumable block by block (the caller keeps the position), so a slow client
+ * can download the file over several loop iterations; recording is paused meanwhile.
+ *
+ * Recording and export must be called from the same task (TCP server task).
+ */
+
+/* Includes */
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "hal/cpu_hal.h"
+#include "traffic_capture.h"
+
+#if CONFIG_TRAFFIC_CAPTURE
+
+/* Defines - debug */
+#define TRAFFIC_CAPTURE_TAG                "TRAFFIC_CAPTURE"
+
+/* Defines - synthesized headers and pcapng blocks */
+#define SYNTH_HEADERS_SIZE                 40          /* IPv4 (20) + TCP (20) */
+#define SYNTH_TCP_WINDOW                   5744
+#define PCAPNG_LINKTYPE_RAW                101
+#define PCAPNG_BLOCK_SHB                   0x0A0D0D0A
+#define PCAPNG_BLOCK_IDB                   0x00000001
+#define PCAPNG_BLOCK_EPB                   0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC            0x1A2B3C4D
+#define PCAPNG_OPT_ENDOFOPT                0
+#define PCAPNG_OPT_COMMENT                 1
+#define PCAPNG_OPT_EPB_FLAGS               2
+#define PCAPNG_OPT_IF_NAME                 2
+#define PCAPNG_MAX_COMMENT_SIZE            32
+#define EXPORT_SHB_BLOCK                   0
+#define EXPORT_IDB_BLOCK                   1
+#define EXPORT_FIRST_RECORD_BLOCK          2
+#define PCAPNG_BLOCK_BUFFER_SIZE           (28 + SYNTH_HEADERS_SIZE + TRAFFIC_CAPTURE_SNAPLEN + 3 + 8 + 4 + PCAPNG_MAX_COMMENT_SIZE + 4 + 4)
+
+/* Types - capture record */
+typedef struct
+{
+    int64_t timestamp_us;
+    uint32_t stream_offset;
+    uint32_t ack_offset;
+    uint32_t client_ip;
+    uint32_t server_ip;
+    uint16_t client_port;
+    uint16_t server_port;
+    uint16_t orig_len;
+    uint16_t cap_len;
+    uint8_t dir;
+    uint8_t trigger;
+    uint8_t data[TRAFFIC_CAPTURE_SNAPLEN];
+} capture_record_t;
+
+/* Static variables */
+static capture_record_t *pt_ring = NULL;
+static uint32_t ring_write_index = 0;
+static uint32_t ring_count = 0;
+static uint32_t post_trigger_left = 0;
+static volatile traffic_capture_state_t capture_state = TRAFFIC_CAPTURE_OFF;
+static traffic_capture_stats_t capture_stats = {0};
+static uint8_t block_buffer[PCAPNG_BLOCK_BUFFER_SIZE];
+static bool export_active = false;
+static traffic_capture_state_t export_saved_state = TRAFFIC_CAPTURE_OFF;
+
+/* Static variables - current connection */
+static uint32_t conn_client_ip = 0;
+static uint32_t conn_server_ip = 0;
+static uint16_t conn_client_port = 0;
+static uint16_t conn_server_port = 0;
+static uint32_t conn_rx_offset = 0;
+static uint32_t conn_tx_offset = 0;
+
+/* Local functions */
+static void put_u16_be(uint8_t *pt_buf, uint16_t value);
+static void put_u32_be(uint8_t *pt_buf, uint32_t value);
+static size_t block_put(size_t pos, const void *pt_data, size_t len);
+static size_t block_put_u16(size_t pos, uint16_t value);
+static size_t block_put_u32(size_t pos, uint32_t value);
+static size_t block_pad(size_t pos);
+static size_t block_finish(size_t pos);
+static size_t build_synth_headers(const capture_record_t *pt_rec, uint8_t *pt_buf);
+static size_t build_export_block(uint32_t block);
+static size_t build_epb(const capture_record_t *pt_rec);
+
+/* Function: init traffic capture (allocates capture ring)
+ * Params: arm: start recording right away
+ * Return: true: success
+ *         false: fail (no memory for capture ring)
+ */
+bool traffic_capture_init(bool arm)
+{
+    size_t ring_size = TRAFFIC_CAPTURE_RECORDS * sizeof(capture_record_t);
+
+#if CONFIG_SPIRAM
+    pt_ring = heap_caps_malloc(ring_size, MALLOC_CAP_SPIRAM);
+#endif
+
+    if (pt_ring == NULL)
+    {
+        pt_ring = heap_caps_malloc(ring_size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+
+    if (pt_ring == NULL)
+    {
+        ESP_LOGE(TRAFFIC_CAPTURE_TAG, "Error: impossible to allocate capture ring (%u bytes)", (unsigned)ring_size);
+        return false;
+    }
+
+    ESP_LOGI(TRAFFIC_CAPTURE_TAG, "Capture ring: %d records x %d bytes (%u bytes)",
+             TRAFFIC_CAPTURE_RECORDS, TRAFFIC_CAPTURE_SNAPLEN, (unsigned)ring_size);
+
+    if (arm == true)
+    {
+        traffic_capture_arm();
+    }
+
+    return true;
+}
+
+/* Function: clear capture ring and start recording (waiting for a trigger)
+ * Params: none
+ * Return: none
+ */
+void traffic_capture_arm(void)
+{
+    if (pt_ring == NULL)
+    {
+        return;
+    }
+
+    ring_write_index = 0;
+    ring_count = 0;
+    capture_state = TRAFFIC_CAPTURE_ARMED;
+}
+
+/* Function: stop recording (capture ring content is kept)
+ * Params: none
+ * Return: none
+ */
+void traffic_capture_off(void)
+{
+    capture_state = TRAFFIC_CAPTURE_OFF;
+}
+
+/* Function: get capture state
+ * Params: none
+ * Return: capture state
+ */
+traffic_capture_state_t traffic_capture_get_state(void)
+{
+    return capture_state;
+}
+
+/* Function: set current connection endpoints (used to synthesize IPv4/TCP headers)
+ * Params: client and server IPs (network byte order) and ports (host byte order)
+ * Return: none
+ */
+void traffic_capture_set_endpoints(uint32_t client_ip, uint16_t client_port, uint32_t server_ip, uint16_t server_port)
+{
+    conn_client_ip = client_ip;
+    conn_client_port = client_port;
+    conn_server_ip = server_ip;
+    conn_server_port = server_port;
+    conn_rx_offset = 0;
+    conn_tx_offset = 0;
+}
+
+/* Function: record received / sent data. Only a flag check (and stream offset update) when capture is not recording
+ * Params: direction, data and length
+ * Return: none
+ */
+void traffic_capture_record(traffic_capture_dir_t dir, const void *pt_data, size_t len)
+{
+    capture_record_t *pt_rec;
+    uint32_t start_cycles;
+    uint32_t *pt_offset = (dir == TRAFFIC_CAPTURE_RX) ? &conn_rx_offset : &conn_tx_offset;
+
+    /* Stream offsets always advance, so gaps show up in the capture as missing segments */
+    *pt_offset += len;
+
+    if ((capture_state == TRAFFIC_CAPTURE_OFF) || (capture_state == TRAFFIC_CAPTURE_FROZEN))
+    {
+        return;
+    }
+
+    start_cycles = cpu_hal_get_cycle_count();
+
+    pt_rec = &pt_ring[ring_write_index];
+    pt_rec->timestamp_us = esp_timer_get_time();
+    pt_rec->dir = (uint8_t)dir;
+    pt_rec->trigger = TRAFFIC_CAPTURE_TRIGGER_NONE;
+    pt_rec->client_ip = conn_client_ip;
+    pt_rec->client_port = conn_client_port;
+    pt_rec->server_ip = conn_server_ip;
+    pt_rec->server_port = conn_server_port;
+    pt_rec->stream_offset = *pt_offset - len;
+    pt_rec->ack_offset = (dir == TRAFFIC_CAPTURE_RX) ? conn_tx_offset : conn_rx_offset;
+    pt_rec->orig_len = (len > 0xFFFF) ? 0xFFFF : (uint16_t)len;
+    pt_rec->cap_len = (len > TRAFFIC_CAPTURE_SNAPLEN) ? TRAFFIC_CAPTURE_SNAPLEN : (uint16_t)len;
+    memcpy(pt_rec->data, pt_data, pt_rec->cap_len);
+
+    ring_write_index = (ring_write_index + 1) % TRAFFIC_CAPTURE_RECORDS;
+
+    if (ring_count < TRAFFIC_CAPTURE_RECORDS)
+    {
+        ring_count++;
+    }
+    else
+    {
+        capture_stats.dropped++;
+    }
+
+    if ((capture_state == TRAFFIC_CAPTURE_TRIGGERED) && (--post_trigger_left == 0))
+    {
+        capture_state = TRAFFIC_CAPTURE_FROZEN;
+        ESP_LOGW(TRAFFIC_CAPTURE_TAG, "Capture frozen (%" PRIu32 " records). Send \"%s\" to the control port to download it", ring_count, TRAFFIC_CAPTURE_CMD_DUMP);
+    }
+
+    capture_stats.records++;
+    capture_stats.record_cycles += (uint32_t)(cpu_hal_get_cycle_count() - start_cycles);
+}
+
+/* Function: latency trigger. Triggers capture if latency reaches TRAFFIC_CAPTURE_LATENCY_TRIGGER_US
+ * Params: measured latency (us)
+ * Return: none
+ */
+void traffic_capture_check_latency(int64_t latency_us)
+{
+    if (latency_us >= TRAFFIC_CAPTURE_LATENCY_TRIGGER_US)
+    {
+        traffic_capture_trigger(TRAFFIC_CAPTURE_TRIGGER_LATENCY);
+    }
+}
+
+/* Function: trigger capture. The last record is marked and capture freezes after the post-trigger records
+ * Params: trigger reason
+ * Return: none
+ */
+void traffic_capture_trigger(traffic_capture_trigger_t reason)
+{
+    if (capture_state != TRAFFIC_CAPTURE_ARMED)
+    {
+        return;
+    }
+
+    if (ring_count > 0)
+    {
+        pt_ring[(ring_write_index + TRAFFIC_CAPTURE_RECORDS - 1) % TRAFFIC_CAPTURE_RECORDS].trigger = (uint8_t)reason;
+    }
+
+    capture_stats.triggers++;
+    post_trigger_left = TRAFFIC_CAPTURE_POST_TRIGGER_RECORDS;
+    capture_state = (post_trigger_left > 0) ? TRAFFIC_CAPTURE_TRIGGERED : TRAFFIC_CAPTURE_FROZEN;
+    ESP_LOGW(TRAFFIC_CAPTURE_TAG, "Capture triggered (%s)", (reason == TRAFFIC_CAPTURE_TRIGGER_LATENCY) ? "latency" : "error");
+}
+
+/* Function: export capture ring as a pcapng file, streamed block by block. Recording is paused until the
+ *           export is done (or cancelled), so the file can be written over several calls
+ * Params: export position (next block: 0 starts an export), write callback and callback context
+ * Return: true: file complete
+ *         false: callback stopped the export (call again with the same position to continue it, or
+ *                traffic_capture_export_cancel), or there's no capture ring
+ */
+bool traffic_capture_export_pcapng(uint32_t *pt_block, traffic_capture_write_cb_t cb, void *ctx)
+{
+    size_t pos;
+
+    if (pt_ring == NULL)
+    {
+        return false;
+    }
+
+    if (export_active == false)
+    {
+        export_saved_state = capture_state;
+        export_active = true;
+        capture_state = TRAFFIC_CAPTURE_OFF;
+    }
+
+    /* Blocks: section header, interface description, then one packet per record (oldest first) */
+    while (*pt_block < (EXPORT_FIRST_RECORD_BLOCK + ring_count))
+    {
+        pos = build_export_block(*pt_block);
+
+        if (cb(ctx, block_buffer, pos) == false)
+        {
+            return false;
+        }
+
+        (*pt_block)++;
+    }
+
+    capture_state = export_saved_state;
+    export_active = false;
+
+    ESP_LOGI(TRAFFIC_CAPTURE_TAG, "Capture export done (%" PRIu32 " records)", ring_count);
+    return true;
+}
+
+/* Function: cancel an unfinished export (recording state before the export is restored)
+ * Params: none
+ * Return: none
+ */
+void traffic_capture_export_cancel(void)
+{
+    if (export_active == true)
+    {
+        capture_state = export_saved_state;
+        export_active = false;
+        ESP_LOGW(TRAFFIC_CAPTURE_TAG, "Capture export cancelled");
+    }
+}
+
+/* Function: get capture statistics
+ * Params: statistics (output)
+ * Return: none
+ */
+void traffic_capture_get_stats(traffic_capture_stats_t *pt_stats)
+{
+    *pt_stats = capture_stats;
+}
+
+/* Function: clear capture statistics
+ * Params: none
+ * Return: none
+ */
+void traffic_capture_clear_stats(void)
+{
+    memset(&capture_stats, 0, sizeof(capture_stats));
+}
+
+/* Function: build an export block into block buffer
+ * Params: block number (0: Section Header Block, 1: Interface Description Block, then one Enhanced Packet Block per record)
+ * Return: block size
+ */
+static size_t build_export_block(uint32_t block)
+{
+    static const char if_name[] = "esp32 tcp server";
+    uint32_t index;
+    size_t pos;
+
+    if (block == EXPORT_SHB_BLOCK)
+    {
+        pos = block_put_u32(0, PCAPNG_BLOCK_SHB);
+        pos = block_put_u32(pos, 0);
+        pos = block_put_u32(pos, PCAPNG_BYTE_ORDER_MAGIC);
+        pos = block_put_u16(pos, 1);
+        pos = block_put_u16(pos, 0);
+        pos = block_put_u32(pos, 0xFFFFFFFF);
+        pos = block_put_u32(pos, 0xFFFFFFFF);
+        return block_finish(pos);
+    }
+
+    if (block == EXPORT_IDB_BLOCK)
+    {
+        /* Timestamps in us, default resolution */
+        pos = block_put_u32(0, PCAPNG_BLOCK_IDB);
+        pos = block_put_u32(pos, 0);
+        pos = block_put_u16(pos, PCAPNG_LINKTYPE_RAW);
+        pos = block_put_u16(pos, 0);
+        pos = block_put_u32(pos, SYNTH_HEADERS_SIZE + TRAFFIC_CAPTURE_SNAPLEN);
+        pos = block_put_u16(pos, PCAPNG_OPT_IF_NAME);
+        pos = block_put_u16(pos, sizeof(if_name) - 1);
+        pos = block_put(pos, if_name, sizeof(if_name) - 1);
+        pos = block_pad(pos);
+        pos = block_put_u32(pos, PCAPNG_OPT_ENDOFOPT);
+        return block_finish(pos);
+    }
+
+    index = (ring_write_index + TRAFFIC_CAPTURE_RECORDS - ring_count + (block - EXPORT_FIRST_RECORD_BLOCK)) % TRAFFIC_CAPTURE_RECORDS;
+    return build_epb(&pt_ring[index]);
+}
+
+/* Function: build an Enhanced Packet Block into block buffer
+ * Params: capture record
+ * Return: block size
+ */
+static size_t build_epb(const capture_record_t *pt_rec)
+{
+    char comment[PCAPNG_MAX_COMMENT_SIZE] = {0};
+    size_t comment_len = 0;
+    size_t pos;
+
+    pos = block_put_u32(0, PCAPNG_BLOCK_EPB);
+    pos = block_put_u32(pos, 0);
+    pos = block_put_u32(pos, 0);
+    pos = block_put_u32(pos, (uint32_t)((uint64_t)pt_rec->timestamp_us >> 32));
+    pos = block_put_u32(pos, (uint32_t)pt_rec->timestamp_us);
+    pos = block_put_u32(pos, SYNTH_HEADERS_SIZE + pt_rec->cap_len);
+    pos = block_put_u32(pos, SYNTH_HEADERS_SIZE + pt_rec->orig_len);
+    pos += build_synth_headers(pt_rec, &block_buffer[pos]);
+    pos = block_put(pos, pt_rec->data, pt_rec->cap_len);
+    pos = block_pad(pos);
+
+    /* epb_flags: direction (bits 0-1: 01 inbound, 10 outbound) */
+    pos = block_put_u16(pos, PCAPNG_OPT_EPB_FLAGS);
+    pos = block_put_u16(pos, 4);
+    pos = block_put_u32(pos, (pt_rec->dir == TRAFFIC_CAPTURE_RX) ? 1 : 2);
+
+    if (pt_rec->trigger != TRAFFIC_CAPTURE_TRIGGER_NONE)
+    {
+        comment_len = snprintf(comment, sizeof(comment), "trigger: %s",
+                               (pt_rec->trigger == TRAFFIC_CAPTURE_TRIGGER_LATENCY) ? "latency" : "error");
+        pos = block_put_u16(pos, PCAPNG_OPT_COMMENT);
+        pos = block_put_u16(pos, comment_len);
+        pos = block_put(pos, comment, comment_len);
+        pos = block_pad(pos);
+    }
+
+    pos = block_put_u32(pos, PCAPNG_OPT_ENDOFOPT);
+    return block_finish(pos);
+}
+
+/* Function: synthesize IPv4 + TCP headers for a record
+ * Params: capture record and output buffer (SYNTH_HEADERS_SIZE bytes)
+ * Return: headers size
+ */
+static size_t build_synth_headers(const capture_record_t *pt_rec, uint8_t *pt_buf)
+{
+    const uint32_t *pt_src_ip = (pt_rec->dir == TRAFFIC_CAPTURE_RX) ? &pt_rec->client_ip : &pt_rec->server_ip;
+    const uint32_t *pt_dst_ip = (pt_rec->dir == TRAFFIC_CAPTURE_RX) ? &pt_rec->server_ip : &pt_rec->client_ip;
+    uint16_t src_port = (pt_rec->dir == TRAFFIC_CAPTURE_RX) ? pt_rec->client_port : pt_rec->server_port;
+    uint16_t dst_port = (pt_rec->dir == TRAFFIC_CAPTURE_RX) ? pt_rec->server_port : pt_rec->client_port;
+    uint32_t checksum = 0;
+    int i;
+
+    memset(pt_buf, 0x00, SYNTH_HEADERS_SIZE);
+
+    /* IPv4 header */
+    pt_buf[0] = 0x45;
+    put_u16_be(&pt_buf[2], SYNTH_HEADERS_SIZE + pt_rec->orig_len);
+    pt_buf[8] = 64;
+    pt_buf[9] = 6;
+    memcpy(&pt_buf[12], pt_src_ip, 4);
+    memcpy(&pt_buf[16], pt_dst_ip, 4);
+
+    for (i = 0; i < 20; i += 2)
+    {
+        checksum += ((uint32_t)pt_buf[i] << 8) | pt_buf[i + 1];
+    }
+
+    while (checksum > 0xFFFF)
+    {
+        checksum = (checksum & 0xFFFF) + (checksum >> 16);
+    }
+
+    put_u16_be(&pt_buf[10], (uint16_t)~checksum);
+
+    /* TCP header (PSH + ACK, checksum not computed) */
+    put_u16_be(&pt_buf[20], src_port);
+    put_u16_be(&pt_buf[22], dst_port);
+    put_u32_be(&pt_buf[24], pt_rec->stream_offset + 1);
+    put_u32_be(&pt_buf[28], pt_rec->ack_offset + 1);
+    pt_buf[32] = 5 << 4;
+    pt_buf[33] = 0x18;
+    put_u16_be(&pt_buf[34], SYNTH_TCP_WINDOW);
+
+    return SYNTH_HEADERS_SIZE;
+}
+
+/* Function: block buffer helpers (pcapng blocks use host byte order)
+ * Params: position in block buffer and data
+ * Return: new position
+ */
+static size_t block_put(size_t pos, const void *pt_data, size_t len)
+{
+    memcpy(&block_buffer[pos], pt_data, len);
+    return pos + len;
+}
+
+static size_t block_put_u16(size_t pos, uint16_t value)
+{
+    return block_put(pos, &value, sizeof(value));
+}
+
+static size_t block_put_u32(size_t pos, uint32_t value)
+{
+    return block_put(pos, &value, sizeof(value));
+}
+
+static size_t block_pad(size_t pos)
+{
+    while ((pos % 4) != 0)
+    {
+        block_buffer[pos++] = 0;
+    }
+
+    return pos;
+}
+
+/* Function: write block total length (header and trailer)
+ * Params: position after options
+ * Return: block size
+ */
+static size_t block_finish(size_t pos)
+{
+    uint32_t total_len = pos + 4;
+
+    memcpy(&block_buffer[4], &total_len, sizeof(total_len));
+    return block_put_u32(pos, total_len);
+}
+
+/* Function: big endian helpers
+ * Params: buffer and value
+ * Return: none
+ */
+static void put_u16_be(uint8_t *pt_buf, uint16_t value)
+{
+    pt_buf[0] = (uint8_t)(value >> 8);
+    pt_buf[1] = (uint8_t)value;
+}
+
+static void put_u32_be(uint8_t *pt_buf, uint32_t value)
+{
+    pt_buf[0] = (uint8_t)(value >> 24);
+    pt_buf[1] = (uint8_t)(value >> 16);
+    pt_buf[2] = (uint8_t)(value >> 8);
+    pt_buf[3] = (uint8_t)value;
+}
+
+#endif
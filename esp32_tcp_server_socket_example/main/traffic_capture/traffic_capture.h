@@ -0,0 +1,96 @@
+/* Header file: traffic capture (RX/TX ring buffer with pcapng export) */
+
+#ifndef HEADER_MOD_TRAFFIC_CAPTURE
+#define HEADER_MOD_TRAFFIC_CAPTURE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+
+/* Defines: capture ring (number of records and bytes captured per record) */
+#ifdef CONFIG_TRAFFIC_CAPTURE_RECORDS
+#define TRAFFIC_CAPTURE_RECORDS                 CONFIG_TRAFFIC_CAPTURE_RECORDS
+#define TRAFFIC_CAPTURE_SNAPLEN                 CONFIG_TRAFFIC_CAPTURE_SNAPLEN
+#define TRAFFIC_CAPTURE_LATENCY_TRIGGER_US      CONFIG_TRAFFIC_CAPTURE_LATENCY_TRIGGER_US
+#define TRAFFIC_CAPTURE_POST_TRIGGER_RECORDS    CONFIG_TRAFFIC_CAPTURE_POST_TRIGGER_RECORDS
+#else
+#define TRAFFIC_CAPTURE_RECORDS                 64
+#define TRAFFIC_CAPTURE_SNAPLEN                 64
+#define TRAFFIC_CAPTURE_LATENCY_TRIGGER_US      50000
+#define TRAFFIC_CAPTURE_POST_TRIGGER_RECORDS    16
+#endif
+
+/* Defines: commands received through the control port */
+#define TRAFFIC_CAPTURE_CMD_PREFIX              "capture"
+#define TRAFFIC_CAPTURE_CMD_ARM                 "capture arm"
+#define TRAFFIC_CAPTURE_CMD_OFF                 "capture off"
+#define TRAFFIC_CAPTURE_CMD_DUMP                "capture dump"
+
+/* Capture direction */
+typedef enum
+{
+    TRAFFIC_CAPTURE_RX = 1,
+    TRAFFIC_CAPTURE_TX = 2
+} traffic_capture_dir_t;
+
+/* Trigger reasons */
+typedef enum
+{
+    TRAFFIC_CAPTURE_TRIGGER_NONE = 0,
+    TRAFFIC_CAPTURE_TRIGGER_LATENCY,
+    TRAFFIC_CAPTURE_TRIGGER_ERROR
+} traffic_capture_trigger_t;
+
+/* Capture state */
+typedef enum
+{
+    TRAFFIC_CAPTURE_OFF = 0,
+    TRAFFIC_CAPTURE_ARMED,      /* recording, waiting for a trigger */
+    TRAFFIC_CAPTURE_TRIGGERED,  /* recording post-trigger records */
+    TRAFFIC_CAPTURE_FROZEN      /* ring holds the records around the trigger, waiting for download */
+} traffic_capture_state_t;
+
+/* Statistics (overhead measurement) */
+typedef struct
+{
+    uint32_t records;
+    uint32_t dropped;
+    uint32_t triggers;
+    uint64_t record_cycles;
+} traffic_capture_stats_t;
+
+/* Export callback: writes a chunk of the pcapng file */
+typedef bool (*traffic_capture_write_cb_t)(void *ctx, const uint8_t *pt_data, size_t len);
+
+#endif
+
+/* Prototypes */
+#if CONFIG_TRAFFIC_CAPTURE
+bool traffic_capture_init(bool arm);
+void traffic_capture_arm(void);
+void traffic_capture_off(void);
+traffic_capture_state_t traffic_capture_get_state(void);
+void traffic_capture_set_endpoints(uint32_t client_ip, uint16_t client_port, uint32_t server_ip, uint16_t server_port);
+void traffic_capture_record(traffic_capture_dir_t dir, const void *pt_data, size_t len);
+void traffic_capture_check_latency(int64_t latency_us);
+void traffic_capture_trigger(traffic_capture_trigger_t reason);
+bool traffic_capture_export_pcapng(uint32_t *pt_block, traffic_capture_write_cb_t cb, void *ctx);
+void traffic_capture_export_cancel(void);
+void traffic_capture_get_stats(traffic_capture_stats_t *pt_stats);
+void traffic_capture_clear_stats(void);
+#else
+/* Capture disabled in menuconfig: hooks compile to nothing */
+#define traffic_capture_init(arm)                                        ((void)(arm), false)
+#define traffic_capture_arm()                                            do { } while (0)
+#define traffic_capture_off()                                            do { } while (0)
+#define traffic_capture_get_state()                                      (TRAFFIC_CAPTURE_OFF)
+#define traffic_capture_set_endpoints(client_ip, client_port, server_ip, server_port)   do { } while (0)
+#define traffic_capture_record(dir, pt_data, len)                        do { } while (0)
+#define traffic_capture_check_latency(latency_us)                        do { } while (0)
+#define traffic_capture_trigger(reason)                                  do { } while (0)
+#define traffic_capture_export_pcapng(pt_block, cb, ctx)                 ((void)(pt_block), (void)(cb), (void)(ctx), false)
+#define traffic_capture_export_cancel()                                  do { } while (0)
+#define traffic_capture_get_stats(pt_stats)                              memset((pt_stats), 0, sizeof(traffic_capture_stats_t))
+#define traffic_capture_clear_stats()                                    do { } while (0)
+#endif
@@ -0,0 +1,128 @@
+/* Module: traffic capture benchmark (data path cost with capture armed, off and compiled out)
+ *
+ * Runs the per-message hooks of the data port (record RX, latency check, record TX) around
+ * the copy of an echo answer, for a small and a large message:
+ * - no hooks: what the data path costs with capture disabled in menuconfig
+ * - capture off: hooks compiled in, capture not recording (default at boot)
+ * - capture armed: hooks recording into the ring
+ * Capture state and statistics are restored afterwards.
+ */
+
+/* Includes */
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <esp_task_wdt.h>
+#include "traffic_capture.h"
+#include "traffic_capture_bench.h"
+
+#if CONFIG_TRAFFIC_CAPTURE_BENCHMARK
+
+/* Defines - debug */
+#define TRAFFIC_CAPTURE_BENCH_TAG          "TRAFFIC_CAPTURE_BENCH"
+
+/* Types - benchmark mode */
+typedef enum
+{
+    BENCH_NO_HOOKS = 0,
+    BENCH_CAPTURE_OFF,
+    BENCH_CAPTURE_ARMED
+} bench_mode_t;
+
+/* Static variables (kept out of the task stack) */
+static uint8_t bench_rx[TRAFFIC_CAPTURE_BENCH_LARGE_SIZE];
+static uint8_t bench_tx[TRAFFIC_CAPTURE_BENCH_LARGE_SIZE];
+static volatile uint32_t bench_sink = 0;
+
+/* Local functions */
+static int64_t run_data_path(bench_mode_t mode, size_t len);
+static void run_size(size_t len);
+
+/* Function: run benchmark and log ns per message for each mode
+ * Params: none
+ * Return: none
+ */
+void traffic_capture_run_benchmark(void)
+{
+    traffic_capture_state_t saved_state = traffic_capture_get_state();
+
+    memset(bench_rx, 'a', sizeof(bench_rx));
+    traffic_capture_set_endpoints(0x0100007F, 50000, 0x0100007F, 5000);
+
+    run_size(TRAFFIC_CAPTURE_BENCH_SMALL_SIZE);
+    run_size(TRAFFIC_CAPTURE_BENCH_LARGE_SIZE);
+
+    /* Benchmark records must not show up in the capture or in the server statistics */
+    if (saved_state == TRAFFIC_CAPTURE_OFF)
+    {
+        traffic_capture_off();
+    }
+    else
+    {
+        traffic_capture_arm();
+    }
+
+    traffic_capture_clear_stats();
+    ESP_LOGI(TRAFFIC_CAPTURE_BENCH_TAG, "(%d iterations, snap length %d bytes)", TRAFFIC_CAPTURE_BENCH_ITERATIONS, TRAFFIC_CAPTURE_SNAPLEN);
+}
+
+/* Function: run and log the three modes for one message size
+ * Params: message size
+ * Return: none
+ */
+static void run_size(size_t len)
+{
+    int64_t no_hooks_ns = run_data_path(BENCH_NO_HOOKS, len);
+    int64_t off_ns = run_data_path(BENCH_CAPTURE_OFF, len);
+    int64_t armed_ns = run_data_path(BENCH_CAPTURE_ARMED, len);
+
+    ESP_LOGI(TRAFFIC_CAPTURE_BENCH_TAG, "%4u bytes: no hooks %" PRId64 " ns/msg, capture off %" PRId64 " ns/msg (+%" PRId64 "), armed %" PRId64 " ns/msg (+%" PRId64 ")",
+             (unsigned)len, no_hooks_ns, off_ns, off_ns - no_hooks_ns, armed_ns, armed_ns - no_hooks_ns);
+    esp_task_wdt_reset();
+}
+
+/* Function: run the data path of one message (hooks + echo answer copy) many times
+ * Params: mode and message size
+ * Return: ns per message
+ */
+static int64_t run_data_path(bench_mode_t mode, size_t len)
+{
+    int64_t start_us;
+    int i;
+
+    if (mode == BENCH_CAPTURE_ARMED)
+    {
+        traffic_capture_arm();
+    }
+    else
+    {
+        traffic_capture_off();
+    }
+
+    start_us = esp_timer_get_time();
+
+    for (i = 0; i < TRAFFIC_CAPTURE_BENCH_ITERATIONS; i++)
+    {
+        if (mode != BENCH_NO_HOOKS)
+        {
+            traffic_capture_record(TRAFFIC_CAPTURE_RX, bench_rx, len);
+            traffic_capture_check_latency(0);
+        }
+
+        memcpy(bench_tx, bench_rx, len);
+        bench_sink += bench_tx[i % len];
+
+        if (mode != BENCH_NO_HOOKS)
+        {
+            traffic_capture_record(TRAFFIC_CAPTURE_TX, bench_tx, len);
+        }
+    }
+
+    return ((esp_timer_get_time() - start_us) * 1000) / TRAFFIC_CAPTURE_BENCH_ITERATIONS;
+}
+
+#endif
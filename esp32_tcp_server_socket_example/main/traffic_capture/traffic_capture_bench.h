@@ -0,0 +1,14 @@
+/* Header file: traffic capture benchmark (data path cost with capture armed, off and compiled out) */
+
+#ifndef HEADER_MOD_TRAFFIC_CAPTURE_BENCH
+#define HEADER_MOD_TRAFFIC_CAPTURE_BENCH
+
+/* Defines: benchmark params */
+#define TRAFFIC_CAPTURE_BENCH_ITERATIONS   2000
+#define TRAFFIC_CAPTURE_BENCH_SMALL_SIZE   64
+#define TRAFFIC_CAPTURE_BENCH_LARGE_SIZE   1024
+
+#endif
+
+/* Prototypes */
+void traffic_capture_run_benchmark(void);
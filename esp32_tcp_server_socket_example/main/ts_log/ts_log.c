@@ -0,0 +1,1057 @@
+/* Module: time-series log (append-only sample log in a flash partition)
+ *
+ * The "tslog" partition is a ring of 4 kB sectors. Each sector starts with a header
+ * (sequence number, erase count) followed by blocks packed back to back; a block is a
+ * header (sample count, first/last timestamp, CRC32) plus up to TS_LOG_BATCH_SAMPLES
+ * samples, written with a single flash write. Flash is only written where it's erased,
+ * and when the ring is full the oldest sector is erased and reused, so every sector is
+ * erased once per lap (wear is spread evenly over the partition).
+ *
+ * Timestamps never decrease, so the first timestamp of every sector (kept in RAM, 4 bytes
+ * per sector) is a sparse index: a range query binary searches it, then walks blocks of
+ * flash mapped in 64 kB windows, skipping whole blocks by their first/last timestamp.
+ * RAM used doesn't depend on the query range. A query is a cursor (sector sequence number,
+ * block offset, sample), so it can be paused and resumed while samples are appended; if
+ * the ring reuses the sector it points to meanwhile, it goes on from the oldest sector.
+ *
+ * At mount, the sector with the highest sequence number is the head; a block that fails
+ * its CRC (power lost while writing) seals the head sector, and the next block goes to a
+ * new sector. The index and the newest timestamp only come from blocks that pass their
+ * CRC, so a torn block doesn't hide the samples written before it.
+ *
+ * Without ESP_PLATFORM (host builds), a file (TS_LOG_HOST_FILE) stands in for the partition:
+ * erase fills a sector with 0xFF and writes can only clear bits, like NOR flash.
+ *
+ * All functions must be called from the same task (TCP server task).
+ */
+
+/* Includes */
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "ts_log.h"
+
+#if CONFIG_TS_LOG
+
+#ifdef ESP_PLATFORM
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#else
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/* Defines - debug */
+#define TS_LOG_TAG                         "TS_LOG"
+
+/* Defines - platform */
+#ifdef ESP_PLATFORM
+#define TS_LOG_TIME_MS()                   ((uint32_t)(esp_timer_get_time() / 1000))
+#define TS_LOG_CRC32(crc, pt_data, len)    esp_rom_crc32_le((crc), (const uint8_t *)(pt_data), (len))
+#define TS_LOGI(fmt, ...)                  ESP_LOGI(TS_LOG_TAG, fmt, ##__VA_ARGS__)
+#define TS_LOGE(fmt, ...)                  ESP_LOGE(TS_LOG_TAG, fmt, ##__VA_ARGS__)
+#else
+#define TS_LOG_TIME_MS()                   host_time_ms()
+#define TS_LOG_CRC32(crc, pt_data, len)    host_crc32_le((crc), (const uint8_t *)(pt_data), (len))
+#define TS_LOGI(fmt, ...)                  printf(TS_LOG_TAG ": " fmt "\n", ##__VA_ARGS__)
+#define TS_LOGE(fmt, ...)                  printf(TS_LOG_TAG ": " fmt "\n", ##__VA_ARGS__)
+#endif
+
+/* Defines - flash format */
+#define SECTOR_MAGIC                       0x474C5354  /* "TSLG" */
+#define BLOCK_MAGIC                        0x5B1C
+#define BLOCK_MAGIC_ERASED                 0xFFFF
+#define SAMPLE_SIZE                        sizeof(ts_log_sample_t)
+#define INDEX_EMPTY                        UINT32_MAX  /* sector without blocks */
+
+/* Types - sector header (CRC over the fields before it) */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t erase_count;
+    uint32_t crc;
+} sector_header_t;
+
+/* Types - block header (CRC over the fields before it and the samples) */
+typedef struct
+{
+    uint16_t magic;
+    uint16_t count;
+    uint32_t first_timestamp;
+    uint32_t last_timestamp;
+    uint32_t crc;
+} block_header_t;
+
+/* Types - block being filled (header and samples are contiguous, so a block is one flash write) */
+typedef struct
+{
+    block_header_t header;
+    ts_log_sample_t samples[TS_LOG_BATCH_SAMPLES];
+} block_buffer_t;
+
+_Static_assert(sizeof(sector_header_t) == TS_LOG_SECTOR_HEADER_SIZE, "sector header size");
+_Static_assert(sizeof(block_header_t) == TS_LOG_BLOCK_HEADER_SIZE, "block header size");
+_Static_assert(sizeof(ts_log_sample_t) == 12, "sample size");
+_Static_assert(sizeof(block_buffer_t) == TS_LOG_BLOCK_HEADER_SIZE + TS_LOG_BATCH_SAMPLES * 12, "block buffer size");
+
+/* Static variables - flash */
+#ifdef ESP_PLATFORM
+static const esp_partition_t *pt_partition = NULL;
+static spi_flash_mmap_handle_t map_handle = 0;
+#else
+static int host_fd = -1;
+static size_t host_map_size = 0;
+#endif
+static const uint8_t *pt_map = NULL;
+static uint32_t map_first_sector = 0;
+
+/* Static variables - ring */
+static bool mounted = false;
+static uint32_t sector_count = 0;
+static uint32_t *pt_index = NULL;           /* first timestamp of every sector */
+static uint32_t tail_sector = 0;
+static uint32_t head_sector = 0;
+static uint32_t head_seq = 0;
+static uint32_t used_sectors = 0;
+static uint32_t write_offset = 0;           /* in head sector */
+static uint32_t last_timestamp = 0;
+
+/* Static variables - batch and statistics */
+static block_buffer_t batch;
+static uint32_t batch_count = 0;
+static uint32_t batch_start_ms = 0;
+static ts_log_stats_t log_stats = {0};
+
+/* Local functions */
+static bool flash_open(void);
+static bool flash_read(uint32_t offset, void *pt_dst, size_t len);
+static bool flash_write(uint32_t offset, const void *pt_src, size_t len);
+static bool flash_erase_sector(uint32_t sector);
+static const uint8_t * flash_map_sector(uint32_t sector);
+static void flash_unmap(void);
+static bool read_sector_header(uint32_t sector, sector_header_t *pt_header);
+static bool block_header_valid(const block_header_t *pt_header, uint32_t offset);
+static bool read_block(uint32_t sector, uint32_t offset);
+static bool scan_sector(uint32_t sector, uint32_t *pt_end_offset, uint32_t *pt_last_timestamp);
+static bool open_sector(uint32_t sector, uint32_t seq);
+static bool open_next_sector(void);
+static bool write_block(uint32_t count);
+static uint32_t find_start_position(uint32_t from_timestamp);
+#ifndef ESP_PLATFORM
+static uint32_t host_time_ms(void);
+static uint32_t host_crc32_le(uint32_t crc, const uint8_t *pt_data, size_t len);
+#endif
+
+/* Function: init time-series log (mount the partition, rebuild the sparse index)
+ * Params: none
+ * Return: true: success
+ *         false: fail (partition not found or flash error)
+ */
+bool ts_log_init(void)
+{
+    sector_header_t header;
+    uint32_t head_found = 0;
+    uint32_t sector;
+    uint32_t end_offset;
+    uint32_t i;
+    bool found = false;
+
+    if (mounted == true)
+    {
+        return true;
+    }
+
+    if (flash_open() == false)
+    {
+        return false;
+    }
+
+    pt_index = malloc(sector_count * sizeof(uint32_t));
+    if (pt_index == NULL)
+    {
+        TS_LOGE("Error: no memory for index (%" PRIu32 " sectors)", sector_count);
+        return false;
+    }
+
+    /* Head: valid sector with the highest sequence number */
+    for (i = 0; i < sector_count; i++)
+    {
+        pt_index[i] = INDEX_EMPTY;
+
+        if ((read_sector_header(i, &header) == true) && ((found == false) || (header.seq > head_seq)))
+        {
+            head_found = i;
+            head_seq = header.seq;
+            found = true;
+        }
+    }
+
+    if (found == false)
+    {
+        /* Blank (or foreign) partition */
+        TS_LOGI("Formatting time-series log (%" PRIu32 " sectors)", sector_count);
+        head_seq = 0;
+        used_sectors = 0;
+        head_sector = sector_count - 1;
+
+        if (open_next_sector() == false)
+        {
+            return false;
+        }
+
+        tail_sector = head_sector;
+        mounted = true;
+        return true;
+    }
+
+    /* Tail: walk back while sequence numbers are contiguous */
+    head_sector = head_found;
+    used_sectors = 1;
+    tail_sector = head_sector;
+
+    while (used_sectors < sector_count)
+    {
+        sector = (tail_sector + sector_count - 1) % sector_count;
+
+        if ((read_sector_header(sector, &header) == false) || (header.seq != head_seq - used_sectors))
+        {
+            break;
+        }
+
+        tail_sector = sector;
+        used_sectors++;
+    }
+
+    /* Sparse index: first timestamp of every sector (from its first block, if it passes its CRC) */
+    for (i = 0; i < used_sectors; i++)
+    {
+        sector = (tail_sector + i) % sector_count;
+
+        if (read_block(sector, TS_LOG_SECTOR_HEADER_SIZE) == true)
+        {
+            pt_index[sector] = batch.header.first_timestamp;
+        }
+    }
+
+    /* Sectors sealed without blocks take the first timestamp of the next one (keeps the index sorted) */
+    for (i = used_sectors - 1; i > 0; i--)
+    {
+        sector = (tail_sector + i - 1) % sector_count;
+
+        if (pt_index[sector] == INDEX_EMPTY)
+        {
+            pt_index[sector] = pt_index[(sector + 1) % sector_count];
+        }
+    }
+
+    /* Write position and newest timestamp (previous sectors when the head has no valid block, e.g. its first one is torn) */
+    if (scan_sector(head_sector, &end_offset, &last_timestamp) == false)
+    {
+        TS_LOGE("Error: invalid block in head sector %" PRIu32 ", sealing it", head_sector);
+        log_stats.crc_errors++;
+        end_offset = TS_LOG_SECTOR_SIZE;
+    }
+    write_offset = end_offset;
+
+    for (i = 1, sector = head_sector; (i < used_sectors) && (pt_index[sector] == INDEX_EMPTY); i++)
+    {
+        sector = (sector + sector_count - 1) % sector_count;
+        (void)scan_sector(sector, &end_offset, &last_timestamp);
+    }
+
+    mounted = true;
+
+    TS_LOGI("Time-series log mounted: %" PRIu32 "/%" PRIu32 " sectors used, head %" PRIu32 " (seq %" PRIu32 ", offset %" PRIu32 "), newest timestamp %" PRIu32,
+            used_sectors, sector_count, head_sector, head_seq, write_offset, last_timestamp);
+
+    return true;
+}
+
+/* Function: append a sample (kept in RAM until the batch is full or ts_log_tick flushes it)
+ * Params: timestamp (must not be older than the previous sample), sensor id and value
+ * Return: true: success
+ *         false: fail (log not mounted, timestamp out of order or flash error)
+ */
+bool ts_log_append(uint32_t timestamp, uint8_t sensor_id, int32_t value)
+{
+    ts_log_sample_t *pt_sample;
+
+    if ((mounted == false) || (timestamp < last_timestamp))
+    {
+        log_stats.samples_rejected++;
+        return false;
+    }
+
+    if ((batch_count == TS_LOG_BATCH_SAMPLES) && (ts_log_flush() == false))
+    {
+        log_stats.samples_rejected++;
+        return false;
+    }
+
+    if (batch_count == 0)
+    {
+        batch_start_ms = TS_LOG_TIME_MS();
+    }
+
+    pt_sample = &batch.samples[batch_count++];
+    pt_sample->timestamp = timestamp;
+    pt_sample->value = value;
+    pt_sample->sensor_id = sensor_id;
+    memset(pt_sample->reserved, 0xFF, sizeof(pt_sample->reserved));
+
+    last_timestamp = timestamp;
+    log_stats.samples_appended++;
+
+    if (batch_count == TS_LOG_BATCH_SAMPLES)
+    {
+        (void)ts_log_flush();
+    }
+
+    return true;
+}
+
+/* Function: write samples kept in RAM to flash (as many blocks as needed to fill the head sector)
+ * Params: none
+ * Return: true: success
+ *         false: fail (samples that weren't written stay in RAM)
+ */
+bool ts_log_flush(void)
+{
+    uint32_t room;
+    uint32_t count;
+
+    if (mounted == false)
+    {
+        return false;
+    }
+
+    while (batch_count > 0)
+    {
+        room = TS_LOG_SECTOR_SIZE - write_offset;
+        count = (room > TS_LOG_BLOCK_HEADER_SIZE) ? (room - TS_LOG_BLOCK_HEADER_SIZE) / SAMPLE_SIZE : 0;
+
+        if (count == 0)
+        {
+            if (open_next_sector() == false)
+            {
+                return false;
+            }
+            continue;
+        }
+
+        count = (count < batch_count) ? count : batch_count;
+
+        if (write_block(count) == false)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Function: periodic work (flush an incomplete batch older than TS_LOG_FLUSH_INTERVAL_MS)
+ * Params: none
+ * Return: none
+ */
+void ts_log_tick(void)
+{
+    if ((batch_count > 0) && ((uint32_t)(TS_LOG_TIME_MS() - batch_start_ms) >= TS_LOG_FLUSH_INTERVAL_MS))
+    {
+        (void)ts_log_flush();
+    }
+}
+
+/* Function: stream the samples of a timestamp range (samples still in RAM are flushed first)
+ * Params: range (inclusive), callback and its context
+ * Return: true: success (all samples of the range were passed to the callback)
+ *         false: fail (log not mounted, flash error or callback stopped the query)
+ */
+bool ts_log_query(uint32_t from_timestamp, uint32_t to_timestamp, ts_log_sample_cb_t cb, void *ctx)
+{
+    ts_log_query_t query;
+
+    if ((ts_log_query_start(&query, from_timestamp, to_timestamp) == false) ||
+        (ts_log_query_next(&query, cb, ctx) == false))
+    {
+        return false;
+    }
+
+    return query.done;
+}
+
+/* Function: start a query (binary search of the sparse index). Samples still in RAM are flushed,
+ *           so the query only reads flash and can be paused between ts_log_query_next calls
+ * Params: query (output) and range (inclusive)
+ * Return: true: success
+ *         false: fail (log not mounted, invalid range or flash error)
+ */
+bool ts_log_query_start(ts_log_query_t *pt_query, uint32_t from_timestamp, uint32_t to_timestamp)
+{
+    if ((mounted == false) || (from_timestamp > to_timestamp) || (ts_log_flush() == false))
+    {
+        return false;
+    }
+
+    pt_query->from_timestamp = from_timestamp;
+    pt_query->to_timestamp = to_timestamp;
+    pt_query->seq = head_seq + 1 - used_sectors + find_start_position(from_timestamp);
+    pt_query->offset = TS_LOG_SECTOR_HEADER_SIZE;
+    pt_query->sample = 0;
+    pt_query->end_seq = head_seq;
+    pt_query->end_offset = write_offset;
+    pt_query->done = false;
+    pt_query->lost = false;
+
+    return true;
+}
+
+/* Function: pass the next samples of a query to the callback, until the callback pauses it or the
+ *           range ends. Flash is mapped in 64 kB windows, whole blocks out of range are skipped
+ * Params: query, callback and its context
+ * Return: true: success (query done, or paused by the callback: see pt_query->done)
+ *         false: fail (log not mounted or flash error)
+ */
+bool ts_log_query_next(ts_log_query_t *pt_query, ts_log_sample_cb_t cb, void *ctx)
+{
+    const uint8_t *pt_sector;
+    block_header_t block;
+    ts_log_sample_t sample;
+    uint32_t tail_seq;
+    uint32_t sector;
+    uint32_t end;
+    uint32_t crc;
+    bool paused = false;
+    bool result = true;
+
+    if (mounted == false)
+    {
+        return false;
+    }
+
+    /* Sectors dropped by the ring while the query was paused: go on from the oldest one */
+    tail_seq = head_seq + 1 - used_sectors;
+
+    if ((int32_t)(pt_query->seq - tail_seq) < 0)
+    {
+        pt_query->seq = tail_seq;
+        pt_query->offset = TS_LOG_SECTOR_HEADER_SIZE;
+        pt_query->sample = 0;
+        pt_query->lost = true;
+    }
+
+    while ((pt_query->done == false) && (paused == false))
+    {
+        sector = (tail_sector + (pt_query->seq - tail_seq)) % sector_count;
+
+        if (((int32_t)(pt_query->seq - pt_query->end_seq) > 0) ||
+            ((pt_index[sector] != INDEX_EMPTY) && (pt_index[sector] > pt_query->to_timestamp)))
+        {
+            pt_query->done = true;
+            break;
+        }
+
+        if (pt_index[sector] != INDEX_EMPTY)
+        {
+            pt_sector = flash_map_sector(sector);
+            if (pt_sector == NULL)
+            {
+                result = false;
+                break;
+            }
+
+            end = (pt_query->seq == pt_query->end_seq) ? pt_query->end_offset : TS_LOG_SECTOR_SIZE;
+
+            while ((pt_query->offset + TS_LOG_BLOCK_HEADER_SIZE <= end) && (pt_query->done == false) && (paused == false))
+            {
+                memcpy(&block, &pt_sector[pt_query->offset], sizeof(block));
+
+                if (block.magic == BLOCK_MAGIC_ERASED)
+                {
+                    break;
+                }
+
+                if (block_header_valid(&block, pt_query->offset) == false)
+                {
+                    log_stats.crc_errors++;
+                    break;
+                }
+
+                if (block.first_timestamp > pt_query->to_timestamp)
+                {
+                    pt_query->done = true;
+                    break;
+                }
+
+                /* Whole block before the range: skip it without reading its samples */
+                if (block.last_timestamp >= pt_query->from_timestamp)
+                {
+                    crc = TS_LOG_CRC32(0, &pt_sector[pt_query->offset], offsetof(block_header_t, crc));
+                    crc = TS_LOG_CRC32(crc, &pt_sector[pt_query->offset + TS_LOG_BLOCK_HEADER_SIZE], block.count * SAMPLE_SIZE);
+                    if (crc != block.crc)
+                    {
+                        log_stats.crc_errors++;
+                        break;
+                    }
+
+                    for (; pt_query->sample < block.count; pt_query->sample++)
+                    {
+                        memcpy(&sample, &pt_sector[pt_query->offset + TS_LOG_BLOCK_HEADER_SIZE + pt_query->sample * SAMPLE_SIZE], sizeof(sample));
+
+                        if (sample.timestamp > pt_query->to_timestamp)
+                        {
+                            pt_query->done = true;
+                            break;
+                        }
+
+                        if ((sample.timestamp >= pt_query->from_timestamp) && (cb(ctx, &sample) == false))
+                        {
+                            paused = true;
+                            break;
+                        }
+                    }
+
+                    if ((pt_query->done == true) || (paused == true))
+                    {
+                        break;
+                    }
+                }
+
+                pt_query->offset += TS_LOG_BLOCK_HEADER_SIZE + block.count * SAMPLE_SIZE;
+                pt_query->sample = 0;
+            }
+        }
+
+        if ((pt_query->done == false) && (paused == false))
+        {
+            pt_query->seq++;
+            pt_query->offset = TS_LOG_SECTOR_HEADER_SIZE;
+            pt_query->sample = 0;
+        }
+    }
+
+    flash_unmap();
+
+    return result;
+}
+
+/* Function: get statistics (erase count range comes from a scan of all sector headers)
+ * Params: statistics (output)
+ * Return: none
+ */
+void ts_log_get_stats(ts_log_stats_t *pt_stats)
+{
+    sector_header_t header;
+    uint32_t i;
+
+    *pt_stats = log_stats;
+    pt_stats->sectors_total = sector_count;
+    pt_stats->sectors_used = used_sectors;
+    pt_stats->erase_count_min = UINT32_MAX;
+    pt_stats->erase_count_max = 0;
+    pt_stats->oldest_timestamp = 0;
+    pt_stats->newest_timestamp = last_timestamp;
+
+    if (mounted == false)
+    {
+        pt_stats->erase_count_min = 0;
+        return;
+    }
+
+    for (i = 0; i < sector_count; i++)
+    {
+        /* Sectors never used by the log count as not erased */
+        header.erase_count = (read_sector_header(i, &header) == true) ? header.erase_count : 0;
+        pt_stats->erase_count_min = (header.erase_count < pt_stats->erase_count_min) ? header.erase_count : pt_stats->erase_count_min;
+        pt_stats->erase_count_max = (header.erase_count > pt_stats->erase_count_max) ? header.erase_count : pt_stats->erase_count_max;
+    }
+
+    for (i = 0; i < used_sectors; i++)
+    {
+        if (pt_index[(tail_sector + i) % sector_count] != INDEX_EMPTY)
+        {
+            pt_stats->oldest_timestamp = pt_index[(tail_sector + i) % sector_count];
+            break;
+        }
+    }
+
+    if ((pt_stats->oldest_timestamp == 0) && (batch_count > 0))
+    {
+        pt_stats->oldest_timestamp = batch.samples[0].timestamp;
+    }
+}
+
+/* Function: read and check a sector header
+ * Params: sector and header (output)
+ * Return: true: valid header
+ *         false: blank, corrupted or not a log sector
+ */
+static bool read_sector_header(uint32_t sector, sector_header_t *pt_header)
+{
+    if (flash_read(sector * TS_LOG_SECTOR_SIZE, pt_header, sizeof(*pt_header)) == false)
+    {
+        return false;
+    }
+
+    return ((pt_header->magic == SECTOR_MAGIC) &&
+            (pt_header->crc == TS_LOG_CRC32(0, pt_header, offsetof(sector_header_t, crc))));
+}
+
+/* Function: check a block header (CRC is checked by the caller, with the samples)
+ * Params: block header and its offset in the sector
+ * Return: true: valid
+ *         false: invalid
+ */
+static bool block_header_valid(const block_header_t *pt_header, uint32_t offset)
+{
+    return ((pt_header->magic == BLOCK_MAGIC) && (pt_header->count > 0) &&
+            (offset + TS_LOG_BLOCK_HEADER_SIZE + pt_header->count * SAMPLE_SIZE <= TS_LOG_SECTOR_SIZE) &&
+            (pt_header->first_timestamp <= pt_header->last_timestamp));
+}
+
+/* Function: read a block into the batch buffer (empty while mounting) and check it, CRC included
+ * Params: sector and offset of the block
+ * Return: true: valid block
+ *         false: erased, invalid (e.g. torn by a power loss) or flash error
+ */
+static bool read_block(uint32_t sector, uint32_t offset)
+{
+    uint32_t base = sector * TS_LOG_SECTOR_SIZE;
+    uint32_t crc;
+
+    if ((offset + TS_LOG_BLOCK_HEADER_SIZE > TS_LOG_SECTOR_SIZE) ||
+        (flash_read(base + offset, &batch.header, sizeof(batch.header)) == false) ||
+        (block_header_valid(&batch.header, offset) == false) || (batch.header.count > TS_LOG_BATCH_SAMPLES) ||
+        (flash_read(base + offset, &batch, TS_LOG_BLOCK_HEADER_SIZE + batch.header.count * SAMPLE_SIZE) == false))
+    {
+        return false;
+    }
+
+    crc = TS_LOG_CRC32(0, &batch.header, offsetof(block_header_t, crc));
+    crc = TS_LOG_CRC32(crc, batch.samples, batch.header.count * SAMPLE_SIZE);
+    return (crc == batch.header.crc);
+}
+
+/* Function: walk the blocks of a sector (checking their CRC) to find where they end
+ * Params: sector, end offset and newest timestamp (output; timestamp unchanged if there are no valid blocks)
+ * Return: true: all blocks are valid
+ *         false: a block is invalid (end offset is the start of that block)
+ */
+static bool scan_sector(uint32_t sector, uint32_t *pt_end_offset, uint32_t *pt_last_timestamp)
+{
+    uint32_t offset = TS_LOG_SECTOR_HEADER_SIZE;
+    uint16_t magic;
+
+    while (offset + TS_LOG_BLOCK_HEADER_SIZE <= TS_LOG_SECTOR_SIZE)
+    {
+        if (flash_read(sector * TS_LOG_SECTOR_SIZE + offset, &magic, sizeof(magic)) == false)
+        {
+            break;
+        }
+
+        if (magic == BLOCK_MAGIC_ERASED)
+        {
+            *pt_end_offset = offset;
+            return true;
+        }
+
+        if (read_block(sector, offset) == false)
+        {
+            break;
+        }
+
+        *pt_last_timestamp = batch.header.last_timestamp;
+        offset += TS_LOG_BLOCK_HEADER_SIZE + batch.header.count * SAMPLE_SIZE;
+    }
+
+    *pt_end_offset = offset;
+    return (offset + TS_LOG_BLOCK_HEADER_SIZE > TS_LOG_SECTOR_SIZE);
+}
+
+/* Function: erase a sector and write its header (erase count carried over from the previous header)
+ * Params: sector and sequence number
+ * Return: true: success
+ *         false: fail
+ */
+static bool open_sector(uint32_t sector, uint32_t seq)
+{
+    sector_header_t header;
+    uint32_t erase_count;
+
+    erase_count = (read_sector_header(sector, &header) == true) ? header.erase_count : 0;
+
+    if (flash_erase_sector(sector) == false)
+    {
+        return false;
+    }
+
+    header.magic = SECTOR_MAGIC;
+    header.seq = seq;
+    header.erase_count = erase_count + 1;
+    header.crc = TS_LOG_CRC32(0, &header, offsetof(sector_header_t, crc));
+
+    log_stats.sectors_erased++;
+
+    return flash_write(sector * TS_LOG_SECTOR_SIZE, &header, sizeof(header));
+}
+
+/* Function: move the head to the next sector (dropping the oldest sector when the ring is full)
+ * Params: none
+ * Return: true: success
+ *         false: fail
+ */
+static bool open_next_sector(void)
+{
+    uint32_t sector = (head_sector + 1) % sector_count;
+
+    if (used_sectors == sector_count)
+    {
+        tail_sector = (tail_sector + 1) % sector_count;
+        used_sectors--;
+        log_stats.sectors_dropped++;
+    }
+
+    pt_index[sector] = INDEX_EMPTY;
+
+    if (open_sector(sector, head_seq + 1) == false)
+    {
+        TS_LOGE("Error: can't open sector %" PRIu32, sector);
+        return false;
+    }
+
+    head_sector = sector;
+    head_seq++;
+    used_sectors++;
+    write_offset = TS_LOG_SECTOR_HEADER_SIZE;
+
+    return true;
+}
+
+/* Function: write the first samples of the batch as a block at the write offset
+ * Params: number of samples (must fit in the head sector)
+ * Return: true: success
+ *         false: fail (head sector is sealed, samples stay in the batch)
+ */
+static bool write_block(uint32_t count)
+{
+    uint32_t size = TS_LOG_BLOCK_HEADER_SIZE + count * SAMPLE_SIZE;
+    uint32_t sector;
+    uint32_t i;
+
+    batch.header.magic = BLOCK_MAGIC;
+    batch.header.count = (uint16_t)count;
+    batch.header.first_timestamp = batch.samples[0].timestamp;
+    batch.header.last_timestamp = batch.samples[count - 1].timestamp;
+    batch.header.crc = TS_LOG_CRC32(0, &batch.header, offsetof(block_header_t, crc));
+    batch.header.crc = TS_LOG_CRC32(batch.header.crc, batch.samples, count * SAMPLE_SIZE);
+
+    if (flash_write(head_sector * TS_LOG_SECTOR_SIZE + write_offset, &batch, size) == false)
+    {
+        TS_LOGE("Error: can't write block (sector %" PRIu32 ", offset %" PRIu32 ")", head_sector, write_offset);
+        write_offset = TS_LOG_SECTOR_SIZE;
+        return false;
+    }
+
+    /* First block of the sector (sectors sealed without blocks before it get the same index) */
+    for (i = 0, sector = head_sector; (i < used_sectors) && (pt_index[sector] == INDEX_EMPTY); i++)
+    {
+        pt_index[sector] = batch.header.first_timestamp;
+        sector = (sector + sector_count - 1) % sector_count;
+    }
+
+    write_offset += size;
+    batch_count -= count;
+    memmove(batch.samples, &batch.samples[count], batch_count * SAMPLE_SIZE);
+
+    log_stats.blocks_written++;
+    log_stats.bytes_written += size;
+
+    return true;
+}
+
+/* Function: find where a query starts (binary search of the sparse index, in ring order)
+ * Params: first timestamp of the range
+ * Return: ring position (0: tail) of the last sector whose first timestamp is older than it
+ */
+static uint32_t find_start_position(uint32_t from_timestamp)
+{
+    uint32_t low = 0;
+    uint32_t high = used_sectors;
+    uint32_t middle;
+
+    /* Sectors starting at from_timestamp may be preceded by samples with the same timestamp */
+    while (low < high)
+    {
+        middle = low + (high - low) / 2;
+
+        if (pt_index[(tail_sector + middle) % sector_count] < from_timestamp)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return (low > 0) ? low - 1 : 0;
+}
+
+#ifdef ESP_PLATFORM
+
+/* Function: find the log partition
+ * Params: none
+ * Return: true: success
+ *         false: fail
+ */
+static bool flash_open(void)
+{
+    pt_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, TS_LOG_PARTITION_SUBTYPE, TS_LOG_PARTITION_LABEL);
+    if (pt_partition == NULL)
+    {
+        TS_LOGE("Error: partition \"%s\" not found", TS_LOG_PARTITION_LABEL);
+        return false;
+    }
+
+    sector_count = pt_partition->size / TS_LOG_SECTOR_SIZE;
+    return (sector_count > 1);
+}
+
+/* Function: read from the log partition
+ * Params: offset, destination and length
+ * Return: true: success
+ *         false: fail
+ */
+static bool flash_read(uint32_t offset, void *pt_dst, size_t len)
+{
+    return (esp_partition_read(pt_partition, offset, pt_dst, len) == ESP_OK);
+}
+
+/* Function: write to the log partition (erased area)
+ * Params: offset, source and length
+ * Return: true: success
+ *         false: fail
+ */
+static bool flash_write(uint32_t offset, const void *pt_src, size_t len)
+{
+    return (esp_partition_write(pt_partition, offset, pt_src, len) == ESP_OK);
+}
+
+/* Function: erase a sector of the log partition
+ * Params: sector
+ * Return: true: success
+ *         false: fail
+ */
+static bool flash_erase_sector(uint32_t sector)
+{
+    return (esp_partition_erase_range(pt_partition, sector * TS_LOG_SECTOR_SIZE, TS_LOG_SECTOR_SIZE) == ESP_OK);
+}
+
+/* Function: map the 64 kB window holding a sector (kept mapped for the next sectors)
+ * Params: sector
+ * Return: sector data, NULL on failure
+ */
+static const uint8_t * flash_map_sector(uint32_t sector)
+{
+    uint32_t first = sector - (sector % TS_LOG_MAP_WINDOW_SECTORS);
+    uint32_t count = ((sector_count - first) < TS_LOG_MAP_WINDOW_SECTORS) ? (sector_count - first) : TS_LOG_MAP_WINDOW_SECTORS;
+    const void *pt_window = NULL;
+
+    if ((pt_map == NULL) || (map_first_sector != first))
+    {
+        flash_unmap();
+
+        if (esp_partition_mmap(pt_partition, first * TS_LOG_SECTOR_SIZE, count * TS_LOG_SECTOR_SIZE,
+                               SPI_FLASH_MMAP_DATA, &pt_window, &map_handle) != ESP_OK)
+        {
+            TS_LOGE("Error: can't map sectors %" PRIu32 "-%" PRIu32, first, first + count - 1);
+            return NULL;
+        }
+
+        pt_map = pt_window;
+        map_first_sector = first;
+    }
+
+    return &pt_map[(sector - first) * TS_LOG_SECTOR_SIZE];
+}
+
+/* Function: unmap the current window
+ * Params: none
+ * Return: none
+ */
+static void flash_unmap(void)
+{
+    if (pt_map != NULL)
+    {
+        spi_flash_munmap(map_handle);
+        pt_map = NULL;
+    }
+}
+
+#else
+
+/* Function: open the file standing in for the log partition (created erased if missing)
+ * Params: none
+ * Return: true: success
+ *         false: fail
+ */
+static bool flash_open(void)
+{
+    struct stat file_stat;
+    off_t size;
+
+    host_fd = open(TS_LOG_HOST_FILE, O_RDWR | O_CREAT, 0644);
+    if ((host_fd < 0) || (fstat(host_fd, &file_stat) != 0))
+    {
+        TS_LOGE("Error: can't open %s", TS_LOG_HOST_FILE);
+        return false;
+    }
+
+    for (size = file_stat.st_size - (file_stat.st_size % TS_LOG_SECTOR_SIZE); size < TS_LOG_HOST_FILE_SIZE; size += TS_LOG_SECTOR_SIZE)
+    {
+        if (flash_erase_sector(size / TS_LOG_SECTOR_SIZE) == false)
+        {
+            return false;
+        }
+    }
+
+    sector_count = TS_LOG_HOST_FILE_SIZE / TS_LOG_SECTOR_SIZE;
+    return true;
+}
+
+/* Function: read from the stand-in file
+ * Params: offset, destination and length
+ * Return: true: success
+ *         false: fail
+ */
+static bool flash_read(uint32_t offset, void *pt_dst, size_t len)
+{
+    return (pread(host_fd, pt_dst, len, offset) == (ssize_t)len);
+}
+
+/* Function: write to the stand-in file (bits can only be cleared, like NOR flash)
+ * Params: offset, source and length
+ * Return: true: success
+ *         false: fail
+ */
+static bool flash_write(uint32_t offset, const void *pt_src, size_t len)
+{
+    uint8_t buffer[TS_LOG_SECTOR_SIZE];
+    size_t i;
+
+    if ((len > sizeof(buffer)) || (flash_read(offset, buffer, len) == false))
+    {
+        return false;
+    }
+
+    for (i = 0; i < len; i++)
+    {
+        buffer[i] &= ((const uint8_t *)pt_src)[i];
+    }
+
+    return (pwrite(host_fd, buffer, len, offset) == (ssize_t)len);
+}
+
+/* Function: erase a sector of the stand-in file
+ * Params: sector
+ * Return: true: success
+ *         false: fail
+ */
+static bool flash_erase_sector(uint32_t sector)
+{
+    uint8_t erased[TS_LOG_SECTOR_SIZE];
+
+    memset(erased, 0xFF, sizeof(erased));
+    return (pwrite(host_fd, erased, sizeof(erased), (off_t)sector * TS_LOG_SECTOR_SIZE) == (ssize_t)sizeof(erased));
+}
+
+/* Function: map the 64 kB window holding a sector (kept mapped for the next sectors)
+ * Params: sector
+ * Return: sector data, NULL on failure
+ */
+static const uint8_t * flash_map_sector(uint32_t sector)
+{
+    uint32_t first = sector - (sector % TS_LOG_MAP_WINDOW_SECTORS);
+    uint32_t count = ((sector_count - first) < TS_LOG_MAP_WINDOW_SECTORS) ? (sector_count - first) : TS_LOG_MAP_WINDOW_SECTORS;
+    void *pt_window;
+
+    if ((pt_map == NULL) || (map_first_sector != first))
+    {
+        flash_unmap();
+
+        pt_window = mmap(NULL, count * TS_LOG_SECTOR_SIZE, PROT_READ, MAP_SHARED, host_fd, (off_t)first * TS_LOG_SECTOR_SIZE);
+        if (pt_window == MAP_FAILED)
+        {
+            TS_LOGE("Error: can't map sectors %" PRIu32 "-%" PRIu32, first, first + count - 1);
+            return NULL;
+        }
+
+        pt_map = pt_window;
+        host_map_size = count * TS_LOG_SECTOR_SIZE;
+        map_first_sector = first;
+    }
+
+    return &pt_map[(sector - first) * TS_LOG_SECTOR_SIZE];
+}
+
+/* Function: unmap the current window
+ * Params: none
+ * Return: none
+ */
+static void flash_unmap(void)
+{
+    if (pt_map != NULL)
+    {
+        munmap((void *)pt_map, host_map_size);
+        pt_map = NULL;
+    }
+}
+
+/* Function: monotonic time (host builds)
+ * Params: none
+ * Return: ms
+ */
+static uint32_t host_time_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000);
+}
+
+/* Function: CRC32 (same as esp_rom_crc32_le: reflected 0xEDB88320, inverted in and out)
+ * Params: previous CRC (0 to start), data and length
+ * Return: CRC
+ */
+static uint32_t host_crc32_le(uint32_t crc, const uint8_t *pt_data, size_t len)
+{
+    size_t i;
+    int bit;
+
+    crc = ~crc;
+
+    for (i = 0; i < len; i++)
+    {
+        crc ^= pt_data[i];
+
+        for (bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+
+    return ~crc;
+}
+
+#endif
+
+#endif
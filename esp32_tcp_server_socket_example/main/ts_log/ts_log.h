@@ -0,0 +1,102 @@
+/* Header file: time-series log (append-only sample log in a flash partition) */
+
+#ifndef HEADER_MOD_TS_LOG
+#define HEADER_MOD_TS_LOG
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#ifdef ESP_PLATFORM
+#include "sdkconfig.h"
+#endif
+
+/* Defines: log partition (partitions.csv) */
+#define TS_LOG_PARTITION_LABEL              "tslog"
+#define TS_LOG_PARTITION_SUBTYPE            0x40
+#define TS_LOG_HOST_FILE                    "ts_log_flash.bin"
+#define TS_LOG_HOST_FILE_SIZE               (64 * 4096)
+
+/* Defines: samples per block (one flash write) and flush interval of an incomplete block */
+#ifdef CONFIG_TS_LOG_BATCH_SAMPLES
+#define TS_LOG_BATCH_SAMPLES                CONFIG_TS_LOG_BATCH_SAMPLES
+#define TS_LOG_FLUSH_INTERVAL_MS            CONFIG_TS_LOG_FLUSH_INTERVAL_MS
+#else
+#define TS_LOG_BATCH_SAMPLES                32
+#define TS_LOG_FLUSH_INTERVAL_MS            5000
+#endif
+
+/* Defines: flash layout */
+#define TS_LOG_SECTOR_SIZE                  4096
+#define TS_LOG_SECTOR_HEADER_SIZE           16
+#define TS_LOG_BLOCK_HEADER_SIZE            16
+#define TS_LOG_MAP_WINDOW_SECTORS           16          /* queries map 64 kB of flash at a time */
+
+/* Defines: commands received through the control port */
+#define TS_LOG_CMD_PREFIX                   "tslog"
+#define TS_LOG_CMD_QUERY                    "tslog query"
+#define TS_LOG_CMD_STATS                    "tslog stats"
+
+/* Sample (stored as is in flash, little endian) */
+typedef struct
+{
+    uint32_t timestamp;
+    int32_t value;
+    uint8_t sensor_id;
+    uint8_t reserved[3];
+} ts_log_sample_t;
+
+/* Statistics */
+typedef struct
+{
+    uint32_t samples_appended;
+    uint32_t samples_rejected;
+    uint32_t blocks_written;
+    uint32_t bytes_written;
+    uint32_t sectors_erased;
+    uint32_t sectors_dropped;
+    uint32_t crc_errors;
+    uint32_t sectors_total;
+    uint32_t sectors_used;
+    uint32_t erase_count_min;
+    uint32_t erase_count_max;
+    uint32_t oldest_timestamp;
+    uint32_t newest_timestamp;
+} ts_log_stats_t;
+
+/* Query in progress (ts_log_query_start, then ts_log_query_next until done): next sample to read.
+   Samples appended after the start aren't returned */
+typedef struct
+{
+    uint32_t from_timestamp;
+    uint32_t to_timestamp;
+    uint32_t seq;                               /* sequence number of the sector being read */
+    uint32_t offset;                            /* block being read in that sector */
+    uint32_t sample;                            /* next sample of that block */
+    uint32_t end_seq;                           /* head sector and its write offset at the start */
+    uint32_t end_offset;
+    bool done;
+    bool lost;                                  /* sectors were reused while the query was paused: samples are missing */
+} ts_log_query_t;
+
+/* Query callback: one sample (in timestamp order). Returns false to pause the query (the next
+   ts_log_query_next call passes the same sample again) */
+typedef bool (*ts_log_sample_cb_t)(void *ctx, const ts_log_sample_t *pt_sample);
+
+#endif
+
+/* Prototypes. With the time-series log disabled in menuconfig, calls compile to nothing */
+#if CONFIG_TS_LOG
+bool ts_log_init(void);
+bool ts_log_append(uint32_t timestamp, uint8_t sensor_id, int32_t value);
+bool ts_log_flush(void);
+void ts_log_tick(void);
+bool ts_log_query(uint32_t from_timestamp, uint32_t to_timestamp, ts_log_sample_cb_t cb, void *ctx);
+bool ts_log_query_start(ts_log_query_t *pt_query, uint32_t from_timestamp, uint32_t to_timestamp);
+bool ts_log_query_next(ts_log_query_t *pt_query, ts_log_sample_cb_t cb, void *ctx);
+void ts_log_get_stats(ts_log_stats_t *pt_stats);
+#else
+#define ts_log_init()                                   (false)
+#define ts_log_append(timestamp, sensor_id, value)      ((void)(timestamp), (void)(sensor_id), (void)(value), false)
+#define ts_log_flush()                                  (false)
+#define ts_log_tick()                                   do { } while (0)
+#endif
@@ -18,12 +18,16 @@
 /* Includes - modules */
 #include "../nvs_rw/nvs_rw.h"
 #include "../socket_tcp_server/socket_tcp_server.h"
+#include "../netconn_tcp_server/netconn_tcp_server.h"
+#include "../request_trace/request_trace.h"
+#include "../backend_bench/backend_bench.h"
 
 /* Defines - debug */
 #define WIFI_TAG                "WIFI"
 
 /* Static variables */
 static bool is_ESP32_connected_to_wifi = false;
+static bool is_tcp_server_started = false;
 
 /* Funções locais */
 static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
@@ -46,6 +50,8 @@ bool get_status_wifi(void)
 static void wifi_event_handler(void* arg, esp_event_base_t event_base,
                                 int32_t event_id, void* event_data)
 {
+    REQUEST_TRACE_BEGIN(REQUEST_TRACE_WIFI_EVENT);
+
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) 
     {
         ESP_LOGI(WIFI_TAG, "Conecting to wi-fi network...");
@@ -62,7 +68,22 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
         is_ESP32_connected_to_wifi = true;
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         ESP_LOGI(WIFI_TAG, "Wi-fi connection is established. IP:" IPSTR, IP2STR(&event->ip_info.ip));
-        tcp_socket_server_init();
+
+        /* TCP server task keeps running across wi-fi reconnections */
+        if (is_tcp_server_started == false)
+        {
+            is_tcp_server_started = true;
+#if CONFIG_TCP_SERVER_BACKEND_BENCHMARK
+            /* Both backends (netconn on its own port), compared by the benchmark task */
+            tcp_socket_server_init();
+            netconn_tcp_server_init();
+            backend_bench_init();
+#elif CONFIG_TCP_SERVER_BACKEND_NETCONN
+            netconn_tcp_server_init();
+#else
+            tcp_socket_server_init();
+#endif
+        }
     }
     else if (event_id == WIFI_EVENT_AP_STACONNECTED)
     {
@@ -74,6 +95,8 @@ static void wifi_event_handler(void* arg, esp_event_base_t event_base,
         wifi_event_ap_stadisconnected_t* event = (wifi_event_ap_stadisconnected_t*) event_data;
         ESP_LOGI(WIFI_TAG, "station "MACSTR" desconectado, AID=%d", MAC2STR(event->mac), event->aid);
     }
+
+    REQUEST_TRACE_END(REQUEST_TRACE_WIFI_EVENT);
 }
 
 /* Function: init wifi